@@ -1,6 +1,9 @@
 #pragma once
 #include <cassert>
+#include <cctype>
+#include <cerrno>
 #include <cstdio>
+#include <cstdlib>
 #include <memory>
 #include <string>
 #include <iterator>
@@ -10,6 +13,11 @@
 #include <variant>
 #include <sstream>
 #include <optional>
+#include <algorithm>
+#include <stdexcept>
+#include <unordered_map>
+#include <array>
+#include <limits>
 #include "symbol-identifiers.h"
 
 extern "C" {
@@ -17,14 +25,256 @@ extern "C" {
 }
 #define STR(...) static_cast<std::stringstream &&>(std::stringstream() << __VA_ARGS__).str()
 
+/// <summary>
+/// Optional features of the generated instrumentation
+/// </summary>
+struct InstrumentOptions
+{
+	/// <summary>
+	/// Inject an AFL-style fork server at the start of main. The fuzzer then starts the program only once and it forks itself for every execution.
+	/// </summary>
+	bool forkServer = false;
+
+	/// <summary>
+	/// Run main in a loop inside the forked child, once per input, instead of forking for every input. Implies forkServer.
+	/// The original main is renamed and called from a generated main, that resets the coverage and stops the process between the inputs.
+	/// </summary>
+	bool persistent = false;
+
+	/// <summary>
+	/// Instrument a libFuzzer-style harness linked into the fuzzer. The runtime is placed into the file defining LLVMFuzzerTestOneInput, with _MapCoverage for the fuzzer to move the counters into its shared memory and _ResetCoverage to call between the inputs, and nothing is injected into main.
+	/// </summary>
+	bool inProcess = false;
+
+	/// <summary>
+	/// Besides the lines, record AFL-style edges (pairs of consecutive probes) into a map of EDGE_MAP_SIZE byte counters. The fuzzer uses them as its feedback, so that the same lines reached in a different order count as a new path.
+	/// </summary>
+	bool edges = false;
+
+	/// <summary>
+	/// Bytes of a line counter, 1 or 8. A byte counter saturates at 255, so that the counters of a large program fit into the L1 cache of the fuzzer, which only needs the buckets of the counts.
+	/// 8 bytes count exactly, for the LCOV of a program run without the fuzzer.
+	/// </summary>
+	unsigned counterBytes = 1;
+
+	/// <summary>
+	/// Byte probes compare their counter with 255 and skip it, instead of always storing it. The fuzzer sets the counters of lines it already knows to 255 before every execution,
+	/// so that these probes cost a load and a predicted branch, and write no memory.
+	/// </summary>
+	bool prune = false;
+
+	/// <summary>
+	/// Rewrite comparisons (==, !=, <, >, <=, >=) and calls of strcmp, memcmp and similar into hooks that log both operands into a table shared with the fuzzer (CmpLog),
+	/// which then puts the other operand into the input where it finds one of them (input-to-state replacement).
+	/// </summary>
+	bool cmpLog = false;
+
+	/// <summary>
+	/// Split equality with a wide integer literal and string comparisons with a string literal (strcmp, memcmp and similar) into byte-by-byte comparisons, laf-intel style.
+	/// Every matching byte of the prefix hits a counter of its own (on the line of the comparison), so that coming closer to the magic value is new coverage for the fuzzer.
+	/// </summary>
+	bool splitCompares = false;
+
+	/// <summary>
+	/// Mix a hash of the calling context into the edges, so that a shared helper reached from a different caller counts as a new path. Needs edges.
+	/// Every function keeps the context of its caller and sets its own on entry, and restores the caller's one when it leaves (a cleanup variable, so also on every return).
+	/// </summary>
+	bool context = false;
+
+	/// <summary>
+	/// Record the control flow between the probes and the calls made at them, from which computeDistances finds how far every probe is from target lines (directed fuzzing)
+	/// </summary>
+	bool controlFlow = false;
+};
+
+/// <summary>
+/// File descriptors the fork server talks over. The fuzzer writes requests to FORKSRV_FD and reads replies from FORKSRV_FD + 1.
+/// </summary>
+constexpr int FORKSRV_FD = 198;
+
+/// <summary>
+/// Bits of the hello message of the fork server. Must be the same as in the fuzzer.
+/// </summary>
+enum FORKSRV_OPT : uint32_t
+{
+	FORKSRV_OPT_DEFERRED = 1, // Fork point was moved to the marker, followed by 4 bytes of microseconds spent in main before it
+	FORKSRV_OPT_PERSISTENT = 2, // Child runs main in a loop and stops itself with SIGSTOP after every input
+};
+
+/// <summary>
+/// Original main of a persistent program is renamed to this prefix + main
+/// </summary>
+constexpr std::string_view PERSISTENT_TARGET_PREFIX = "_FuzzTarget_";
+
+/// <summary>
+/// Environment variable with the number of inputs a persistent program runs before it exits, set by the fuzzer
+/// </summary>
+constexpr std::string_view PERSISTENT_ITERATIONS_ENV = "FUZZ_PERSISTENT_ITERATIONS";
+constexpr unsigned long long PERSISTENT_ITERATIONS_DEFAULT = 1000;
+
+/// <summary>
+/// Environment variable with the path the coverage is written to, set by the fuzzer so that its workers do not overwrite each other's coverage. Defaults to coverage.lcov.
+/// </summary>
+constexpr std::string_view COVERAGE_FILE_ENV = "FUZZ_COVERAGE_FILE";
+
+/// <summary>
+/// Environment variable with the id of a SysV shared memory segment, set by the fuzzer. The program then counts into the segment instead of its own memory and does not write the coverage file.
+/// The segment starts with a header of four words written by the program when it maps it, the number of counters, the size of the edge map (0 without edges), the bytes of a counter
+/// and how many of the counters are of lines, followed by the counters (of the lines of all files, then of the split comparisons) and the edge map.
+/// </summary>
+constexpr std::string_view COVERAGE_SHM_ENV = "FUZZ_COVERAGE_SHM";
+
+/// <summary>
+/// Environment variable with the format of the coverage file. When it is COVERAGE_FORMAT_BINARY, the counters are dumped in one write instead of formatted as LCOV:
+/// a header of five words (COVERAGE_BINARY_MAGIC, number of counters, size of the edge map, bytes of a counter, number of line counters), then the counters and the edge map, as in the shared memory.
+/// </summary>
+constexpr std::string_view COVERAGE_FORMAT_ENV = "FUZZ_COVERAGE_FORMAT";
+constexpr std::string_view COVERAGE_FORMAT_BINARY = "binary";
+constexpr unsigned long long COVERAGE_BINARY_MAGIC = 0x33564F435A5A5546; // "FUZZCOV3"
+
+/// <summary>
+/// Environment variable with the id of a SysV shared memory segment for the operands of comparisons (InstrumentOptions::cmpLog), set by the fuzzer.
+/// The segment holds a word the fuzzer sets to nonzero to turn the logging on, the number of logged comparisons and CMPLOG_ENTRIES entries of:
+/// id of the comparison (4 bytes), kind (0 integers, 1 memory), bytes of the first and of the second operand, one unused byte, both operands (CMPLOG_BYTES each, integers little endian).
+/// Must be the same as in the fuzzer.
+/// </summary>
+constexpr std::string_view CMPLOG_SHM_ENV = "FUZZ_CMPLOG_SHM";
+constexpr size_t CMPLOG_ENTRIES = 1024;
+constexpr size_t CMPLOG_BYTES = 32;
+
+/// <summary>
+/// Functions comparing strings or memory whose calls are logged (InstrumentOptions::cmpLog). A call of strcmp becomes _Fuzz_strcmp, with the id of the comparison as the first argument.
+/// </summary>
+constexpr std::array<std::string_view, 5> CMPLOG_FUNCTIONS = { "strcmp", "strncmp", "strcasecmp", "strncasecmp", "memcmp" };
+
+/// <summary>
+/// Most bytes of a string literal compared byte by byte (InstrumentOptions::splitCompares), a longer one gets counters only for its beginning.
+/// Calls of CMPLOG_FUNCTIONS with a string literal are split, strcmp becomes _FuzzSplit_strcmp, with the first counter and the number of counters as the first arguments.
+/// </summary>
+constexpr size_t SPLIT_STRING_BYTES = 32;
+
+/// <summary>
+/// Number of byte counters of the edge map (InstrumentOptions::edges), a power of two. Placed in the shared memory right after the line counters, its size is the second word of the header.
+/// </summary>
+constexpr size_t EDGE_MAP_SIZE = 1 << 16;
+
+/// <summary>
+/// C type of a line counter (InstrumentOptions::counterBytes)
+/// </summary>
+std::string_view counterType(const InstrumentOptions& options)
+{
+	return options.counterBytes == 1 ? "unsigned char" : "unsigned long long";
+}
+
+/// <summary>
+/// Macro every probe increments its counter with. The empty asm tells the compiler that it reads and writes the counter, so that the increment stays in memory at the probe even at -O2,
+/// instead of being added up in a register and stored after a loop, which loses the hits when the program crashes inside it. Nothing else is held back, the rest of the program is optimized as usual.
+/// Byte counters stop at 255 instead of wrapping around to zero.
+/// </summary>
+std::string probeMacro(const InstrumentOptions& options)
+{
+	if (options.prune && options.counterBytes == 1)
+		return "#define _FuzzHit(c) do{if(__builtin_expect((c)!=255,0)){++(c);__asm__ volatile(\"\":\"+m\"(c));}}while(0)\n";
+	return STR("#define _FuzzHit(c) do{" << (options.counterBytes == 1 ? "(c)+=(c)!=255;" : "++(c);") << "__asm__ volatile(\"\":\"+m\"(c));}while(0)\n");
+}
+
+/// <summary>
+/// Declarations of the CmpLog hooks (InstrumentOptions::cmpLog) and the macro a rewritten comparison calls. The operands are evaluated once, left first, into variables of their own type
+/// (promoted, as the comparison does). Only integers are logged, and only while the fuzzer turns the logging on, otherwise it costs one load and a branch.
+/// </summary>
+std::string cmpLogMacro(const InstrumentOptions& options)
+{
+	if (!options.cmpLog)
+		return {};
+	std::string res = "extern unsigned*_FuzzCmpLog;void _FuzzCmpInt(unsigned,unsigned long long,unsigned long long,unsigned);"
+		"int _Fuzz_strcmp(unsigned,const char*,const char*);int _Fuzz_strncmp(unsigned,const char*,const char*,unsigned long);"
+		"int _Fuzz_strcasecmp(unsigned,const char*,const char*);int _Fuzz_strncasecmp(unsigned,const char*,const char*,unsigned long);"
+		"int _Fuzz_memcmp(unsigned,const void*,const void*,unsigned long);\n";
+	res +=
+		"#define _FuzzCmp(id,a,op,b) ({__auto_type _FuzzA=0?0:(a);__auto_type _FuzzB=0?0:(b);"
+		"if(__builtin_expect(_FuzzCmpLog&&*_FuzzCmpLog,0)&&__builtin_classify_type(_FuzzA)<=4&&__builtin_classify_type(_FuzzB)<=4)"
+		"_FuzzCmpInt(id,(unsigned long long)_FuzzA,(unsigned long long)_FuzzB,sizeof(_FuzzA)>sizeof(_FuzzB)?sizeof(_FuzzA):sizeof(_FuzzB));"
+		"_FuzzA op _FuzzB;})\n";
+	return res;
+}
+
+/// <summary>
+/// Counter of a prefix of a split comparison (InstrumentOptions::splitCompares) and the macro it is rewritten into, _FuzzSplit(counter,counters,(left),op,(right)).
+/// The operands are evaluated once, as in _FuzzCmp. Counter k is hit when the lowest k + 1 bytes of the operands are equal, the same as nested comparisons of single bytes would.
+/// With edges the fuzzer only looks at the edge map, so a counter also hits an edge of its own.
+/// </summary>
+std::string splitComparesMacro(const InstrumentOptions& options)
+{
+	if (!options.splitCompares)
+		return {};
+	std::string res = "int _FuzzSplit_strcmp(unsigned,unsigned,const char*,const char*);int _FuzzSplit_strncmp(unsigned,unsigned,const char*,const char*,unsigned long);"
+		"int _FuzzSplit_strcasecmp(unsigned,unsigned,const char*,const char*);int _FuzzSplit_strncasecmp(unsigned,unsigned,const char*,const char*,unsigned long);"
+		"int _FuzzSplit_memcmp(unsigned,unsigned,const void*,const void*,unsigned long);\n";
+	if (options.edges)
+		res += STR("#define _FuzzProgress(c) do{_FuzzHit(_FuzzCov[c]);_FuzzHit(_FuzzEdge[(c)*40503u%" << EDGE_MAP_SIZE << "]);}while(0)\n");
+	else
+		res += "#define _FuzzProgress(c) _FuzzHit(_FuzzCov[c])\n";
+	res +=
+		"#define _FuzzSplit(c,n,a,op,b) ({__auto_type _FuzzA=0?0:(a);__auto_type _FuzzB=0?0:(b);"
+		"if(__builtin_classify_type(_FuzzA)<=4&&__builtin_classify_type(_FuzzB)<=4){"
+		"unsigned long long _FuzzX=(unsigned long long)_FuzzA^(unsigned long long)_FuzzB;"
+		"for(unsigned _FuzzI=0;_FuzzI<(n)&&!(_FuzzX&255);++_FuzzI,_FuzzX>>=8)_FuzzProgress((c)+_FuzzI);}"
+		"_FuzzA op _FuzzB;})\n";
+	return res;
+}
+
+/// <summary>
+/// Declarations of the calling context (InstrumentOptions::context): the context of the running function, per thread, and the cleanup that gives the caller its context back
+/// </summary>
+std::string contextMacro(const InstrumentOptions& options)
+{
+	if (!options.context)
+		return {};
+	return "extern __thread unsigned _FuzzCtx;static inline void _FuzzCtxLeave(unsigned*caller){_FuzzCtx=*caller;}\n";
+}
 
+/// <summary>
+/// Parts of a comparison rewritten into _FuzzCmp(id,(left),op,(right)) or _FuzzSplit(counter,counters,(left),op,(right)), or of a call rewritten into _Fuzz_strcmp(id,...) or _FuzzSplit_strcmp(counter,counters,...),
+/// in the low bits of FileInstrument::comparisons
+/// </summary>
+enum CMPLOG_PART : uint32_t
+{
+	CMPLOG_OPEN, // Start of the left operand
+	CMPLOG_BEFORE_OPERATOR,
+	CMPLOG_AFTER_OPERATOR,
+	CMPLOG_CLOSE, // End of the right operand
+	CMPLOG_CALL, // Start of the name of the function
+	CMPLOG_CALL_ARGUMENTS, // After the opening parenthesis of the arguments
+	SPLIT_OPEN, // Start of the left operand of a split comparison, the index is of FileInstrument::splits
+	SPLIT_CALL,
+	SPLIT_CALL_ARGUMENTS,
+	CMPLOG_PARTS = 16
+};
+
+/// <summary>
+/// Entry point of an in-process harness
+/// </summary>
+constexpr std::string_view IN_PROCESS_ENTRY = "LLVMFuzzerTestOneInput";
+
+/// <summary>
+/// Call that marks the end of expensive setup of the program. The fork server is started there instead of at the beginning of main.
+/// </summary>
+constexpr std::string_view DEFERRED_INIT_MARKER = "__fuzz_init_done";
 
 class FileInstrument {
 public:
-	FileInstrument(std::string sourcecode, std::string filename, int fileId) : sourcecode(std::move(sourcecode)), filename(std::move(filename)), fileId(std::move(fileId))
+	FileInstrument(std::string sourcecode, std::string filename, int fileId, InstrumentOptions options = {}) : sourcecode(std::move(sourcecode)), filename(std::move(filename)), fileId(std::move(fileId)), options(std::move(options))
 	{
 		parseSource();
 	}
+
+	/// <summary>
+	/// Without parsing, from the probes found in the same source by an earlier run (InstrumentCache)
+	/// </summary>
+	FileInstrument(std::string sourcecode, std::string filename, int fileId, InstrumentOptions options, std::vector<std::pair<uint32_t, uint32_t>> instrumentations, std::vector<std::pair<uint32_t, std::string>> instrumentationsStr, std::vector<std::pair<uint32_t, uint32_t>> comparisons, std::vector<std::pair<uint32_t, uint32_t>> splits, bool thisIsMainFile, bool hasDeferredInit)
+		: sourcecode(std::move(sourcecode)), filename(std::move(filename)), fileId(fileId), options(std::move(options)), thisIsMainFile(thisIsMainFile), hasDeferredInit(hasDeferredInit), instrumentations(std::move(instrumentations)), instrumentationsStr(std::move(instrumentationsStr)), comparisons(std::move(comparisons)), splits(std::move(splits))
+	{
+	}
 //private:
 	uint32_t lastInstrumentedLine = -1;
 
@@ -109,6 +359,12 @@ public:
 			instrumentRecursive(node.getChild(2));
 			break;
 		}
+		case ts_symbol_identifiers::sym_expression_statement:
+		{
+			if (isDeferredInitMarker(node))
+				hasDeferredInit = true;
+			break;
+		}
 		case ts_symbol_identifiers::sym_case_statement:
 		{
 			uint32_t child = 0;
@@ -163,6 +419,325 @@ public:
 
 	//}
 
+	std::string_view nodeText(const ts::Node& node) const
+	{
+		auto range = node.getByteRange();
+		return std::string_view(sourcecode).substr(range.start, range.end - range.start);
+	}
+
+	/// <summary>
+	/// Checks whether the statement is a call of the deferred initialization marker
+	/// </summary>
+	bool isDeferredInitMarker(const ts::Node& statement) const
+	{
+		if (statement.getNumChildren() == 0)
+			return false;
+
+		auto call = statement.getChild(0);
+		if (call.getSymbol() != ts_symbol_identifiers::sym_call_expression || call.getNumChildren() == 0)
+			return false;
+
+		auto function = call.getChild(0);
+		return function.getSymbol() == ts_symbol_identifiers::sym_identifier && nodeText(function) == DEFERRED_INIT_MARKER;
+	}
+
+	/// <summary>
+	/// Whether an expression has no variable in it (a literal, a constant expression of literals)
+	/// </summary>
+	static bool isConstant(const ts::Node& node)
+	{
+		if (node.getSymbol() == ts_symbol_identifiers::sym_identifier || node.getSymbol() == ts_symbol_identifiers::sym_call_expression)
+			return false;
+		for (const auto& child : ts::Children(node))
+			if (!isConstant(child))
+				return false;
+		return true;
+	}
+
+	/// <summary>
+	/// Whether an operand is a null pointer constant. Compared as an int in _FuzzCmp, it would no longer be one, and a comparison with zero is not worth logging anyway.
+	/// </summary>
+	bool isZero(const ts::Node& node) const
+	{
+		auto text = nodeText(node);
+		return node.getSymbol() == ts_symbol_identifiers::sym_null || text == "0" || text == "NULL" || text == "'\\0'";
+	}
+
+	/// <summary>
+	/// Bytes of the value of an integer literal, 0 if the node is not one (a floating point literal, a character)
+	/// </summary>
+	size_t integerLiteralBytes(const ts::Node& node) const
+	{
+		if (node.getSymbol() != ts_symbol_identifiers::sym_number_literal)
+			return 0;
+		std::string text(nodeText(node));
+		while (!text.empty() && (text.back() == 'u' || text.back() == 'U' || text.back() == 'l' || text.back() == 'L'))
+			text.pop_back();
+		const bool hex = text.starts_with("0x") || text.starts_with("0X");
+		if (text.empty() || text.find_first_of(hex ? ".pP'" : ".eE'") != std::string::npos)
+			return 0;
+
+		char* end = nullptr;
+		errno = 0;
+		unsigned long long value = std::strtoull(text.c_str(), &end, 0);
+		if (errno != 0 || end != text.c_str() + text.size())
+			return 0;
+		size_t bytes = 1;
+		while (bytes < sizeof(value) && (value >> (8 * bytes)) != 0)
+			bytes++;
+		return bytes;
+	}
+
+	/// <summary>
+	/// Characters of a string literal (an escape sequence is one), 0 if the node is not one
+	/// </summary>
+	size_t stringLiteralBytes(const ts::Node& node) const
+	{
+		if (node.getSymbol() != ts_symbol_identifiers::sym_string_literal)
+			return 0;
+		auto text = nodeText(node);
+		text = text.substr(text.find('"') + 1);
+		text = text.substr(0, text.rfind('"'));
+		size_t bytes = 0;
+		for (size_t i = 0; i < text.size(); i++, bytes++)
+		{
+			if (text[i] != '\\' || ++i >= text.size())
+				continue;
+			// Digits of an octal or a hexadecimal escape belong to it
+			const bool hex = text[i] == 'x';
+			while (i + 1 < text.size() && (hex ? std::isxdigit(static_cast<unsigned char>(text[i + 1])) : text[i] >= '0' && text[i] <= '7' && text[i + 1] >= '0' && text[i + 1] <= '7'))
+				i++;
+		}
+		return bytes;
+	}
+
+	/// <summary>
+	/// Reserve the counters of a split comparison on the line of the node (InstrumentOptions::splitCompares)
+	/// </summary>
+	/// <returns>Index of the split comparison</returns>
+	uint32_t addSplit(const ts::Node& node, size_t counters)
+	{
+		splits.emplace_back(node.getPointRange().start.row + 1, static_cast<uint32_t>(counters));
+		return static_cast<uint32_t>(splits.size() - 1);
+	}
+
+	/// <summary>
+	/// Rewrite the comparisons in a function body for CmpLog (InstrumentOptions::cmpLog) and comparison splitting (InstrumentOptions::splitCompares), a comparison that is split is not logged.
+	/// Parts are added in the order of the source, the outer comparison opens before and closes after the inner ones.
+	/// Constant expressions are left alone (static initializers, case labels, sizeof, conditions of the preprocessor).
+	/// </summary>
+	void rewriteComparisons(const ts::Node& node)
+	{
+		uint32_t first = 0;
+		switch (node.getSymbol())
+		{
+		case ts_symbol_identifiers::sym_sizeof_expression:
+		case ts_symbol_identifiers::sym_alignof_expression:
+		case ts_symbol_identifiers::sym_offsetof_expression:
+			return;
+		case ts_symbol_identifiers::sym_declaration:
+			for (const auto& child : ts::Children(node))
+				if (child.getSymbol() == ts_symbol_identifiers::sym_storage_class_specifier && nodeText(child) == "static")
+					return;
+			break;
+		case ts_symbol_identifiers::sym_case_statement:
+			while (first < node.getNumChildren() && node.getChild(first++).getSymbol() != ts_symbol_identifiers::anon_sym_COLON);
+			break;
+		case ts_symbol_identifiers::sym_preproc_if:
+		case ts_symbol_identifiers::sym_preproc_elif:
+			first = 2;
+			break;
+		case ts_symbol_identifiers::sym_binary_expression:
+		{
+			const uint32_t count = node.getNumChildren();
+			uint32_t op = 1;
+			while (op + 1 < count && node.getChild(op).getSymbol() == ts_symbol_identifiers::sym_comment)
+				op++;
+			auto left = node.getChild(0), right = node.getChild(count - 1), oper = node.getChild(op);
+			switch (oper.getSymbol())
+			{
+			case ts_symbol_identifiers::anon_sym_EQ_EQ:
+			case ts_symbol_identifiers::anon_sym_BANG_EQ:
+			case ts_symbol_identifiers::anon_sym_LT:
+			case ts_symbol_identifiers::anon_sym_GT:
+			case ts_symbol_identifiers::anon_sym_LT_EQ:
+			case ts_symbol_identifiers::anon_sym_GT_EQ:
+				if (count < 3 || (isConstant(left) && isConstant(right)) || isZero(left) || isZero(right))
+					break;
+				{
+					// Only equality is split, the first byte of a wide literal is compared by the comparison itself
+					const size_t literal = std::max(integerLiteralBytes(left), integerLiteralBytes(right));
+					const bool split = options.splitCompares && literal > 1 && (oper.getSymbol() == ts_symbol_identifiers::anon_sym_EQ_EQ || oper.getSymbol() == ts_symbol_identifiers::anon_sym_BANG_EQ);
+					if (!split && !options.cmpLog)
+						break;
+					const uint32_t site = (split ? addSplit(node, literal - 1) : comparisonSites++) * CMPLOG_PARTS;
+					comparisons.emplace_back(left.getByteRange().start, site + (split ? SPLIT_OPEN : CMPLOG_OPEN));
+					rewriteComparisons(left);
+					comparisons.emplace_back(oper.getByteRange().start, site + CMPLOG_BEFORE_OPERATOR);
+					comparisons.emplace_back(oper.getByteRange().end, site + CMPLOG_AFTER_OPERATOR);
+					rewriteComparisons(right);
+					comparisons.emplace_back(right.getByteRange().end, site + CMPLOG_CLOSE);
+				}
+				return;
+			default:
+				break;
+			}
+			break;
+		}
+		case ts_symbol_identifiers::sym_call_expression:
+		{
+			if (node.getNumChildren() < 2)
+				break;
+			auto function = node.getChild(0), arguments = node.getChild(1);
+			if (function.getSymbol() != ts_symbol_identifiers::sym_identifier || arguments.getSymbol() != ts_symbol_identifiers::sym_argument_list || arguments.getNumChildren() == 0
+				|| std::find(CMPLOG_FUNCTIONS.begin(), CMPLOG_FUNCTIONS.end(), nodeText(function)) == CMPLOG_FUNCTIONS.end())
+				break;
+
+			// String literal among the two compared arguments
+			size_t literal = 0, argument = 0;
+			for (const auto& child : ts::Children(arguments))
+			{
+				auto text = nodeText(child);
+				if (text != "(" && text != "," && text != ")" && child.getSymbol() != ts_symbol_identifiers::sym_comment && argument++ < 2)
+					literal = std::max(literal, stringLiteralBytes(child));
+			}
+			literal = std::min(literal, SPLIT_STRING_BYTES);
+			const bool split = options.splitCompares && literal > 1;
+			if (!split && !options.cmpLog)
+				break;
+
+			// Counter of the whole literal too, as strcmp still needs the end of the other string
+			const uint32_t site = (split ? addSplit(node, literal) : comparisonSites++) * CMPLOG_PARTS;
+			comparisons.emplace_back(function.getByteRange().start, site + (split ? SPLIT_CALL : CMPLOG_CALL));
+			comparisons.emplace_back(arguments.getChild(0).getByteRange().end, site + (split ? SPLIT_CALL_ARGUMENTS : CMPLOG_CALL_ARGUMENTS));
+			rewriteComparisons(arguments);
+			return;
+		}
+		default:
+			break;
+		}
+
+		for (uint32_t i = first; i < node.getNumChildren(); i++)
+			rewriteComparisons(node.getChild(i));
+	}
+
+	static constexpr uint32_t NO_PROBE = std::numeric_limits<uint32_t>::max();
+
+	/// <summary>
+	/// Probe of a statement: the one at its start, or the one before it on the same line. NO_PROBE if the function has none before it.
+	/// </summary>
+	uint32_t probeAt(uint32_t bytePos, uint32_t bodyStart) const
+	{
+		auto it = std::upper_bound(instrumentations.begin(), instrumentations.end(), bytePos, [](uint32_t pos, const auto& probe) { return pos < probe.first; });
+		if (it == instrumentations.begin() || std::prev(it)->first < bodyStart)
+			return NO_PROBE;
+		return static_cast<uint32_t>(std::prev(it) - instrumentations.begin());
+	}
+
+	/// <summary>
+	/// Control can go from any of the probes to the given one
+	/// </summary>
+	/// <returns>Probes control goes on from</returns>
+	std::vector<uint32_t> flowTo(std::vector<uint32_t> from, uint32_t probe)
+	{
+		if (probe == NO_PROBE)
+			return from;
+		for (auto i : from)
+			if (i != probe)
+				flowEdges.emplace_back(i, probe);
+		return { probe };
+	}
+
+	/// <summary>
+	/// Remember the calls of functions by name in an expression, as made at a probe
+	/// </summary>
+	void recordCalls(const ts::Node& node, uint32_t probe)
+	{
+		if (probe == NO_PROBE)
+			return;
+		if (node.getSymbol() == ts_symbol_identifiers::sym_call_expression && node.getNumChildren() > 0 && node.getChild(0).getSymbol() == ts_symbol_identifiers::sym_identifier)
+			calls.emplace_back(probe, nodeText(node.getChild(0)));
+		for (const auto& child : ts::Children(node))
+			recordCalls(child, probe);
+	}
+
+	/// <summary>
+	/// Record the control flow of a statement between the probes (InstrumentOptions::controlFlow), the same statements as instrumentRecursive walks.
+	/// The flow is approximate: a break or a continue ends its path, a loop goes back to its condition and on after it.
+	/// </summary>
+	/// <param name="from">Probes control comes from</param>
+	/// <param name="bodyStart">Start of the function, probes before it belong to other functions</param>
+	/// <returns>Probes control goes on from after the statement</returns>
+	std::vector<uint32_t> recordFlow(const ts::Node& node, std::vector<uint32_t> from, uint32_t bodyStart)
+	{
+		const uint32_t count = node.getNumChildren();
+		const uint32_t probe = probeAt(node.getByteRange().start, bodyStart);
+		switch (node.getSymbol())
+		{
+		case ts_symbol_identifiers::sym_compound_statement:
+			for (const auto& child : ts::Children(node))
+				from = recordFlow(child, std::move(from), bodyStart);
+			return from;
+		case ts_symbol_identifiers::sym_declaration:
+		case ts_symbol_identifiers::sym_expression_statement:
+			recordCalls(node, probe);
+			return flowTo(std::move(from), probe);
+		case ts_symbol_identifiers::sym_return_statement:
+		case ts_symbol_identifiers::sym_break_statement:
+		case ts_symbol_identifiers::sym_continue_statement:
+			recordCalls(node, probe);
+			flowTo(std::move(from), probe);
+			return {};
+		case ts_symbol_identifiers::sym_if_statement:
+		{
+			auto at = flowTo(std::move(from), probe);
+			if (count < 3)
+				return at;
+			recordCalls(node.getChild(1), probe);
+			uint32_t child = 1;
+			while (++child < count && node.getChild(child).getSymbol() == ts_symbol_identifiers::sym_comment);
+			auto exits = recordFlow(node.getChild(child), at, bodyStart);
+			auto possibleElse = node.getChild(count - 1);
+			auto otherwise = possibleElse.getSymbol() == ts_symbol_identifiers::sym_else_clause && possibleElse.getNumChildren() > 1 ? recordFlow(possibleElse.getChild(1), at, bodyStart) : at;
+			exits.insert(exits.end(), otherwise.begin(), otherwise.end());
+			return exits;
+		}
+		case ts_symbol_identifiers::sym_for_statement:
+		case ts_symbol_identifiers::sym_while_statement:
+		{
+			auto at = flowTo(std::move(from), probe);
+			for (uint32_t i = 0; i + 1 < count; i++)
+				recordCalls(node.getChild(i), probe);
+			if (count > 0)
+				flowTo(recordFlow(node.getChild(count - 1), at, bodyStart), probe);
+			return at;
+		}
+		case ts_symbol_identifiers::sym_switch_statement:
+		{
+			auto at = flowTo(std::move(from), probe);
+			if (count < 3)
+				return at;
+			recordCalls(node.getChild(1), probe);
+			// Every case is entered from the condition, or falls through from the one before
+			std::vector<uint32_t> cases = at;
+			for (const auto& child : ts::Children(node.getChild(2)))
+			{
+				if (child.getSymbol() != ts_symbol_identifiers::sym_case_statement)
+					continue;
+				cases.insert(cases.end(), at.begin(), at.end());
+				uint32_t i = 0;
+				while (i < child.getNumChildren() && child.getChild(i++).getSymbol() != ts_symbol_identifiers::anon_sym_COLON);
+				for (; i < child.getNumChildren(); i++)
+					cases = recordFlow(child.getChild(i), std::move(cases), bodyStart);
+			}
+			cases.insert(cases.end(), at.begin(), at.end());
+			return cases;
+		}
+		default:
+			return from;
+		}
+	}
+
 	std::optional<ts::Node> findChild(const ts::Node& node, ts::Symbol sym)
 	{
 		for (const auto& child : ts::Children(node))
@@ -198,10 +773,22 @@ public:
 				if (!found.has_value())
 					continue;
 
-				auto tmp = found->getByteRange();
-				std::string_view functionName(&sourcecode[tmp.start], tmp.end - tmp.start);
-				if (functionName == "main") [[unlikely]]
+				std::string_view functionName = nodeText(*found);
+				if (options.inProcess) [[unlikely]]
+				{
+					if (functionName == IN_PROCESS_ENTRY)
+						thisIsMainFile = true;
+				}
+				else if (functionName == "main") [[unlikely]]
 					{
+						if (options.persistent)
+						{
+							// Generated main (instrumentFooterMain) takes care of the runtime and calls the original one
+							instrumentationsStr.emplace_back(found->getByteRange().start, PERSISTENT_TARGET_PREFIX);
+							thisIsMainFile = true;
+							goto found;
+						}
+
 						for (const auto& child : ts::Children(topLevelExpr))
 						{
 							if (child.getSymbol() == ts_symbol_identifiers::sym_compound_statement)
@@ -211,6 +798,11 @@ public:
 									if (child2.getSymbol() == ts_symbol_identifiers::anon_sym_LBRACE)
 									{
 										instrumentationsStr.emplace_back(child2.getByteRange().end, "atexit(_GenerateLcov);");
+										// Fork server maps the counters in every child it forks
+										if (options.forkServer)
+											instrumentationsStr.emplace_back(child2.getByteRange().end, "_ForkServer();");
+										else
+											instrumentationsStr.emplace_back(child2.getByteRange().end, "_MapCoverage();");
 										thisIsMainFile = true;
 										goto found;
 									}
@@ -226,7 +818,20 @@ public:
 					{
 						if (child.getSymbol() == ts_symbol_identifiers::sym_compound_statement)
 						{
+							if (options.context && child.getNumChildren() > 0 && child.getChild(0).getSymbol() == ts_symbol_identifiers::anon_sym_LBRACE)
+							{
+								// Caller's context is kept in a variable that gives it back when the function leaves
+								instrumentationsStr.emplace_back(child.getChild(0).getByteRange().end, STR("__attribute__((cleanup(_FuzzCtxLeave)))unsigned _FuzzCtxCaller=_FuzzCtx;_FuzzCtx=(_FuzzCtxCaller>>1)^" << contextId(functionName) << ';'));
+							}
+							const auto firstProbe = instrumentations.size();
 							instrumentRecursive(child);
+							if (options.cmpLog || options.splitCompares)
+								rewriteComparisons(child);
+							if (options.controlFlow && firstProbe < instrumentations.size())
+							{
+								functionEntries.emplace_back(functionName, static_cast<uint32_t>(firstProbe));
+								recordFlow(child, {}, child.getByteRange().start);
+							}
 							break;
 						}
 					}
@@ -239,108 +844,695 @@ public:
 	{
 		size_t sourcePos = 0;
 		size_t strPos = 0;
+		size_t cmpPos = 0;
+		constexpr uint32_t NONE = std::numeric_limits<uint32_t>::max();
+
+		auto copyUntil = [&](uint32_t pos) {
+			os << std::string_view(sourcecode.begin() + sourcePos, sourcecode.begin() + pos);
+			sourcePos = pos;
+		};
 
-		for (size_t i = 0; i < instrumentations.size(); )
+		// Counters of the split comparisons follow the ones of the lines of all files
+		std::vector<size_t> splitCounters;
+		splitCounters.reserve(splits.size());
+		for (size_t next = splitOffset; const auto& i : splits)
 		{
-			if (instrumentationsStr.size() - strPos > 0 && instrumentationsStr[strPos].first <= instrumentations[i].first)
-			{
-				os << std::string_view(sourcecode.begin() + sourcePos, sourcecode.begin() + instrumentationsStr[strPos].first);
-				sourcePos = instrumentationsStr[strPos].first;
+			splitCounters.push_back(next);
+			next += i.second;
+		}
 
+		// At the same position the inserted strings (braces of one-liners) go first, then the probe of the statement, then the comparisons starting with it
+		for (size_t i = 0; ; )
+		{
+			const uint32_t str = strPos < instrumentationsStr.size() ? instrumentationsStr[strPos].first : NONE;
+			const uint32_t probe = i < instrumentations.size() ? instrumentations[i].first : NONE;
+			const uint32_t cmp = cmpPos < comparisons.size() ? comparisons[cmpPos].first : NONE;
+
+			if (str == NONE && probe == NONE && cmp == NONE)
+				break;
+			if (str <= probe && str <= cmp)
+			{
+				copyUntil(str);
 				os << instrumentationsStr[strPos++].second;
 			}
-			else
+			else if (probe <= cmp)
 			{
-				os << std::string_view(sourcecode.begin() + sourcePos, sourcecode.begin() + instrumentations[i].first);
-				sourcePos = instrumentations[i].first;
+				copyUntil(probe);
 
-				os << "++" << "_F" << fileId << '[' << i << ']' << ';';
+				os << "_FuzzHit(_FuzzCov[" << counterOffset + i << "]);";
+				if (options.edges)
+				{
+					// Edge from the previous probe to this one. Previous is shifted, so that A->B differs from B->A and A->A is not zero.
+					auto id = edgeBlockId(i);
+					os << "_FuzzHit(_FuzzEdge[" << id << "^_FuzzPrev" << (options.context ? "^_FuzzCtx" : "") << "]);_FuzzPrev=" << (id >> 1) << ';';
+				}
 				++i;
 			}
+			else
+			{
+				copyUntil(cmp);
+				writeComparisonPart(os, comparisons[cmpPos++].second, splitCounters);
+			}
 		}
 
-		if (instrumentationsStr.size() - strPos > 0)
-		{
-			os << std::string_view(sourcecode.begin() + sourcePos, sourcecode.begin() + instrumentationsStr[strPos].first);
-			sourcePos = instrumentationsStr[strPos].first;
+		os << std::string_view(sourcecode.begin() + sourcePos, sourcecode.end());
+	}
 
-			os << instrumentationsStr[strPos++].second;
+	/// <summary>
+	/// Emit a part of a rewritten comparison (CMPLOG_PART)
+	/// </summary>
+	/// <param name="splitCounters">First counter of every split comparison</param>
+	void writeComparisonPart(std::ostream& os, uint32_t part, const std::vector<size_t>& splitCounters) const
+	{
+		const uint32_t site = part / CMPLOG_PARTS, id = cmpLogId(site);
+		switch (part % CMPLOG_PARTS)
+		{
+		case CMPLOG_OPEN:
+			os << "_FuzzCmp(" << id << ",(";
+			break;
+		case CMPLOG_BEFORE_OPERATOR:
+			os << "),";
+			break;
+		case CMPLOG_AFTER_OPERATOR:
+			os << ",(";
+			break;
+		case CMPLOG_CLOSE:
+			os << "))";
+			break;
+		case CMPLOG_CALL:
+			os << "_Fuzz_";
+			break;
+		case CMPLOG_CALL_ARGUMENTS:
+			os << id << ',';
+			break;
+		case SPLIT_OPEN:
+			os << "_FuzzSplit(" << splitCounters[site] << ',' << splits[site].second << ",(";
+			break;
+		case SPLIT_CALL:
+			os << "_FuzzSplit_";
+			break;
+		case SPLIT_CALL_ARGUMENTS:
+			os << splitCounters[site] << ',' << splits[site].second << ',';
+			break;
 		}
+	}
 
-		os << std::string_view(sourcecode.begin() + sourcePos, sourcecode.end());
+	/// <summary>
+	/// Id of a comparison in the log, unique in the program. Computed when written, so that the comparisons kept by InstrumentCache do not depend on the id of the file.
+	/// </summary>
+	uint32_t cmpLogId(uint32_t site) const
+	{
+		return static_cast<uint32_t>(fileId) << 20 | (site & 0xFFFFF);
+	}
+
+	/// <summary>
+	/// Random id of a function in the calling context (InstrumentOptions::context), below EDGE_MAP_SIZE. Derived from the names of the file and the function (FNV-1a),
+	/// so that it does not change with the id of the file, which the probes kept by InstrumentCache do not depend on.
+	/// </summary>
+	uint32_t contextId(std::string_view functionName) const
+	{
+		uint64_t hash = 0xcbf29ce484222325ull;
+		for (std::string_view part : { std::string_view(filename), std::string_view(":"), functionName })
+			for (unsigned char c : part)
+				hash = (hash ^ c) * 0x100000001b3ull;
+		return static_cast<uint32_t>((hash ^ hash >> 16 ^ hash >> 32 ^ hash >> 48) & (EDGE_MAP_SIZE - 1));
+	}
+
+	/// <summary>
+	/// Random id of a probe in the edge map, fixed at instrumentation time. Derived from the file and the probe, so that instrumenting the same sources again gives the same ids.
+	/// </summary>
+	uint32_t edgeBlockId(size_t probe) const
+	{
+		// splitmix64 finalizer
+		uint64_t x = (static_cast<uint64_t>(fileId) << 32) + probe + 0x9E3779B97F4A7C15ull;
+		x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+		x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+		x ^= x >> 31;
+		return static_cast<uint32_t>(x & (EDGE_MAP_SIZE - 1));
 	}
 
 	const std::string sourcecode;
 	const std::string filename;
 	const int fileId;
+	const InstrumentOptions options;
+
+	/// <summary>
+	/// Index of the first line counter of this file in the region shared by all files (assignCounterOffsets)
+	/// </summary>
+	size_t counterOffset = 0;
+
+	/// <summary>
+	/// Index of the first counter of the split comparisons of this file, they follow the line counters of all files
+	/// </summary>
+	size_t splitOffset = 0;
+
 	bool thisIsMainFile = false;
+	bool hasDeferredInit = false;
 
 	std::vector<std::pair<uint32_t, uint32_t>> instrumentations;
 	std::vector<std::pair<uint32_t, std::string>> instrumentationsStr;
+
+	/// <summary>
+	/// Parts of the rewritten comparisons (InstrumentOptions::cmpLog): position and the index of the comparison times CMPLOG_PARTS plus the part (CMPLOG_PART)
+	/// </summary>
+	std::vector<std::pair<uint32_t, uint32_t>> comparisons;
+	uint32_t comparisonSites = 0;
+
+	/// <summary>
+	/// Control flow of the probes (InstrumentOptions::controlFlow), by their index in instrumentations: pairs of probes control goes between,
+	/// the first probe of every function, and functions called at a probe. Not kept by InstrumentCache.
+	/// </summary>
+	std::vector<std::pair<uint32_t, uint32_t>> flowEdges;
+	std::vector<std::pair<std::string, uint32_t>> functionEntries;
+	std::vector<std::pair<uint32_t, std::string>> calls;
+
+	/// <summary>
+	/// Split comparisons (InstrumentOptions::splitCompares): line and the number of counters of the matching prefixes
+	/// </summary>
+	std::vector<std::pair<uint32_t, uint32_t>> splits;
+
+	/// <summary>
+	/// Counters of the lines of the file
+	/// </summary>
+	size_t counters() const
+	{
+		return instrumentations.size();
+	}
+
+	/// <summary>
+	/// Counters of the split comparisons of the file
+	/// </summary>
+	size_t splitCounters() const
+	{
+		size_t res = 0;
+		for (const auto& i : splits)
+			res += i.second;
+		return res;
+	}
 };
 
-void instrumentHeaderExtern(std::ostream& os, const FileInstrument& file)
+/// <summary>
+/// Quote a string as a C string literal
+/// </summary>
+std::string cStringLiteral(std::string_view str)
 {
-	os << "extern unsigned long long " << "_F" << file.fileId << "[];\n";
+	std::string res = "\"";
+	for (char c : str)
+	{
+		if (c == '"' || c == '\\')
+			res += '\\';
+		if (c == '\n')
+		{
+			res += "\\n";
+			continue;
+		}
+		res += c;
+	}
+	res += '"';
+	return res;
+}
+
+/// <summary>
+/// Place the counters of all files one after another into one region: the line counters of all files, then the counters of their split comparisons.
+/// The fuzzer takes only the line counters for the LCOV report and the coverage percentage.
+/// </summary>
+/// <returns>Number of counters of all files</returns>
+size_t assignCounterOffsets(std::vector<FileInstrument>& allFiles)
+{
+	size_t total = 0;
+	for (auto& i : allFiles)
+	{
+		i.counterOffset = total;
+		total += i.counters();
+	}
+	for (auto& i : allFiles)
+	{
+		i.splitOffset = total;
+		total += i.splitCounters();
+	}
+	return total;
 }
 
-void instrumentHeaderMain(std::ostream& os, const std::vector<FileInstrument>& allFiles)
+/// <summary>
+/// Number of line counters of all files
+/// </summary>
+size_t lineCounters(const std::vector<FileInstrument>& allFiles)
 {
+	size_t total = 0;
 	for (const auto& i : allFiles)
-		os << "unsigned long long " << "_F" << i.fileId << "[" << i.instrumentations.size() << "];";
+		total = std::max(total, i.counterOffset + i.counters());
+	return total;
+}
 
-	os << '\n';
+/// <summary>
+/// Number of counters of all files, of the lines and of the split comparisons
+/// </summary>
+size_t totalCounters(const std::vector<FileInstrument>& allFiles)
+{
+	size_t total = lineCounters(allFiles);
+	for (const auto& i : allFiles)
+		total = std::max(total, i.splitOffset + i.splitCounters());
+	return total;
+}
 
-	os <<
-		"#include <stdio.h>\n"
-		"#include <stdlib.h>\n"
-		"void _GenerateLcov(){"
-		"FILE *f = fopen(\"coverage.lcov\", \"w\");"
-		;
+/// <summary>
+/// Line of a source file to fuzz toward, given as file:line
+/// </summary>
+struct DistanceTarget
+{
+	std::string filename;
+	uint32_t line;
+
+	/// <summary>
+	/// Parse file:line
+	/// </summary>
+	static DistanceTarget parse(std::string_view str)
+	{
+		auto colon = str.rfind(':');
+		if (colon == std::string_view::npos || colon == 0)
+			throw std::runtime_error("Target must be file:line");
+		char* end = nullptr;
+		std::string line(str.substr(colon + 1));
+		auto number = std::strtoul(line.c_str(), &end, 10);
+		if (line.empty() || end != line.c_str() + line.size() || number == 0)
+			throw std::runtime_error("Target must be file:line");
+		return { std::string(str.substr(0, colon)), static_cast<uint32_t>(number) };
+	}
 
+	/// <summary>
+	/// Whether the target is in the file, given by the same path or by its end
+	/// </summary>
+	bool isIn(std::string_view path) const
+	{
+		return path == filename || (path.ends_with(filename) && path[path.size() - filename.size() - 1] == '/');
+	}
+};
+
+/// <summary>
+/// Distance of every counter from the nearest target line (directed fuzzing), in probes along the control flow and the calls recorded by InstrumentOptions::controlFlow.
+/// A target is reached at the last probe of its file at or before its line. Counters that do not lead to a target (and the ones of split comparisons) are -1.
+/// Breadth-first search from the targets, backwards along the flow and from the first probe of a function to the probes calling it.
+/// </summary>
+/// <returns>Distances in the order of the counters (assignCounterOffsets)</returns>
+std::vector<int> computeDistances(const std::vector<FileInstrument>& allFiles, const std::vector<DistanceTarget>& targets)
+{
+	const size_t total = totalCounters(allFiles);
+
+	std::unordered_map<std::string_view, std::vector<size_t>> entries;
+	for (const auto& i : allFiles)
+		for (const auto& [name, probe] : i.functionEntries)
+			entries[name].push_back(i.counterOffset + probe);
+
+	// Probes control can come to every probe from
+	std::vector<std::vector<size_t>> before(total);
 	for (const auto& i : allFiles)
+	{
+		for (const auto& [from, to] : i.flowEdges)
+			before[i.counterOffset + to].push_back(i.counterOffset + from);
+		for (const auto& [probe, name] : i.calls)
+			if (auto it = entries.find(name); it != entries.end())
+				for (auto entry : it->second)
+					before[entry].push_back(i.counterOffset + probe);
+	}
+
+	std::vector<int> distances(total, -1);
+	std::vector<size_t> next;
+	for (const auto& target : targets)
+	{
+		bool found = false;
+		for (const auto& i : allFiles)
+		{
+			if (!target.isIn(i.filename))
+				continue;
+			found = true;
+			auto it = std::upper_bound(i.instrumentations.begin(), i.instrumentations.end(), target.line, [](uint32_t line, const auto& probe) { return line < probe.second; });
+			if (it == i.instrumentations.begin())
+				continue;
+			size_t probe = i.counterOffset + (std::prev(it) - i.instrumentations.begin());
+			if (distances[probe] != 0)
+				next.push_back(probe);
+			distances[probe] = 0;
+		}
+		if (!found)
+			throw std::runtime_error("Target " + target.filename + ":" + std::to_string(target.line) + " is not in the instrumented files");
+	}
+
+	for (size_t i = 0; i < next.size(); i++)
+	{
+		for (auto previous : before[next[i]])
+		{
+			if (distances[previous] >= 0)
+				continue;
+			distances[previous] = distances[next[i]] + 1;
+			next.push_back(previous);
+		}
+	}
+	return distances;
+}
+
+/// <summary>
+/// Write the distances of the counters for the fuzzer (FUZZ_DISTANCES), one number per line in the order of the counters
+/// </summary>
+void writeDistances(std::ostream& os, const std::vector<int>& distances)
+{
+	for (auto i : distances)
+		os << i << '\n';
+}
+
+void instrumentHeaderExtern(std::ostream& os, const FileInstrument& file)
+{
+	os << "extern " << counterType(file.options) << "*_FuzzCov;\n" << probeMacro(file.options) << cmpLogMacro(file.options);
+	if (file.options.edges)
+		os << "extern unsigned char*_FuzzEdge;extern unsigned _FuzzPrev;\n";
+	os << splitComparesMacro(file.options) << contextMacro(file.options);
+
+	if (file.hasDeferredInit)
 	{
 		os <<
-			"unsigned long long LH" << i.fileId << "=0;"
-			"for(unsigned long long i=0;i<" << i.instrumentations.size() << ";++i)"
-				"if(" << "_F" << i.fileId << "[i]" ">" "0" ")"
-					"++LH" << i.fileId << ";"
+			"#define __FUZZ_INSTRUMENTED 1\n"
+			"void " << DEFERRED_INIT_MARKER << "(void);\n"
+			"#line 2\n"
 			;
+	}
+}
+
+/// <summary>
+/// Emit the fork server. It announces itself to the fuzzer, then for every request forks a child that continues running main, and reports the child's pid and wait status back.
+/// Without a fuzzer on the other end (the first write fails), the program just runs normally.
+/// </summary>
+/// <param name="deferred">Server is started from the marker. _ForkServer at the beginning of main only remembers when main started, to report the time the deferral saves.</param>
+/// <param name="persistent">Children stop themselves after every input (instrumentFooterMain). A stopped child is continued on the next request instead of forking a new one.</param>
+void instrumentForkServer(std::ostream& os, bool deferred, bool persistent)
+{
+	if (persistent)
+		os << "static int _FuzzPersistent=0;";
 
+	if (deferred)
+	{
+		os <<
+			"#include <time.h>\n"
+			"static struct timespec _MainStart;"
+			"void _ForkServer(){clock_gettime(CLOCK_MONOTONIC,&_MainStart);}"
+			"void " << DEFERRED_INIT_MARKER << "(void){"
+			;
 	}
+	else
+		os << "void _ForkServer(){";
 
 	os <<
-		"fprintf(f,\""
-		"TN:test\\n"
+		"static int started=0;"
+		"if(started)return;"
+		"started=1;"
+		"int msg=" << ((deferred ? FORKSRV_OPT_DEFERRED : 0) | (persistent ? FORKSRV_OPT_PERSISTENT : 0)) << ";"
+		"if(write(" << FORKSRV_FD + 1 << ",&msg,4)!=4){_MapCoverage();return;}"
 		;
 
-	for (const auto& i : allFiles)
+	if (deferred)
 	{
 		os <<
-			"SF:" << i.filename << "\\n";
+			"struct timespec now;"
+			"clock_gettime(CLOCK_MONOTONIC,&now);"
+			"msg=(now.tv_sec-_MainStart.tv_sec)*1000000+(now.tv_nsec-_MainStart.tv_nsec)/1000;"
+			"if(write(" << FORKSRV_FD + 1 << ",&msg,4)!=4)_exit(1);"
+			;
+	}
 
-		for (const auto& j : i.instrumentations)
-			os << "DA:" << j.second << ",%llu\\n";
+	os <<
+		"fflush(NULL);"
+		"int pid=-1,stopped=0;"
+		"while(1){"
+			"if(read(" << FORKSRV_FD << ",&msg,4)!=4){if(stopped)kill(pid,SIGKILL);_exit(0);}"
+			"if(stopped){if(kill(pid,SIGCONT)<0)_exit(1);}"
+			"else{"
+				"pid=fork();"
+				"if(pid<0)_exit(1);"
+				"if(pid==0){close(" << FORKSRV_FD << ");close(" << FORKSRV_FD + 1 << ");" << (persistent ? "_FuzzPersistent=1;" : "") << "_MapCoverage();return;}"
+			"}"
+			"if(write(" << FORKSRV_FD + 1 << ",&pid,4)!=4)_exit(1);"
+			"int status;"
+			"if(waitpid(pid,&status," << (persistent ? "WUNTRACED" : "0") << ")<0)_exit(1);"
+			"stopped=WIFSTOPPED(status);"
+			"if(write(" << FORKSRV_FD + 1 << ",&status,4)!=4)_exit(1);"
+		"}"
+		"}\n"
+		;
+}
+
+/// <summary>
+/// Emit the table of the operands of comparisons (InstrumentOptions::cmpLog), the hooks that log into it and _MapCmpLog that maps it from the shared memory of the fuzzer.
+/// _MapCmpLog marks the table as mapped, the fuzzer runs its input-to-state stage only for programs that did. Without the fuzzer the table is never mapped and the hooks only compare.
+/// </summary>
+void instrumentCmpLog(std::ostream& os)
+{
+	os <<
+		"#include <strings.h>\n"
+		"struct _FuzzCmpEntry{unsigned id;unsigned char kind,sizeA,sizeB,unused;unsigned char a[" << CMPLOG_BYTES << "],b[" << CMPLOG_BYTES << "];};"
+		"struct _FuzzCmpTable{unsigned enabled,count,mapped;struct _FuzzCmpEntry entries[" << CMPLOG_ENTRIES << "];};"
+		"unsigned*_FuzzCmpLog;"
+		"void _MapCmpLog(){"
+		"const char*id=getenv(\"" << CMPLOG_SHM_ENV << "\");"
+		"struct shmid_ds ds;"
+		"if(!id||_FuzzCmpLog||shmctl(atoi(id),IPC_STAT,&ds)!=0||ds.shm_segsz<sizeof(struct _FuzzCmpTable))return;"
+		"void*table=shmat(atoi(id),0,0);"
+		"if(table==(void*)-1)return;"
+		"_FuzzCmpLog=(unsigned*)table;"
+		"((struct _FuzzCmpTable*)table)->mapped=1;"
+		"}"
+		"static struct _FuzzCmpEntry*_FuzzCmpNext(unsigned id,unsigned char kind){"
+		"struct _FuzzCmpTable*t=(struct _FuzzCmpTable*)_FuzzCmpLog;"
+		"if(!t||!t->enabled||t->count>=" << CMPLOG_ENTRIES << ")return 0;"
+		"struct _FuzzCmpEntry*e=&t->entries[t->count++];"
+		"e->id=id;e->kind=kind;"
+		"return e;"
+		"}"
+		"void _FuzzCmpInt(unsigned id,unsigned long long a,unsigned long long b,unsigned size){"
+		"if(a==b)return;"
+		"struct _FuzzCmpEntry*e=_FuzzCmpNext(id,0);"
+		"if(!e)return;"
+		"e->sizeA=e->sizeB=size;memcpy(e->a,&a,8);memcpy(e->b,&b,8);"
+		"}"
+		"static void _FuzzCmpMem(unsigned id,const void*a,unsigned long sizeA,const void*b,unsigned long sizeB){"
+		"struct _FuzzCmpEntry*e=_FuzzCmpNext(id,1);"
+		"if(!e)return;"
+		"e->sizeA=sizeA<" << CMPLOG_BYTES << "?sizeA:" << CMPLOG_BYTES << ";e->sizeB=sizeB<" << CMPLOG_BYTES << "?sizeB:" << CMPLOG_BYTES << ";"
+		"memcpy(e->a,a,e->sizeA);memcpy(e->b,b,e->sizeB);"
+		"}"
+		"int _Fuzz_strcmp(unsigned id,const char*a,const char*b){if(_FuzzCmpLog&&*_FuzzCmpLog)_FuzzCmpMem(id,a,strnlen(a," << CMPLOG_BYTES << "),b,strnlen(b," << CMPLOG_BYTES << "));return strcmp(a,b);}"
+		"int _Fuzz_strncmp(unsigned id,const char*a,const char*b,unsigned long n){if(_FuzzCmpLog&&*_FuzzCmpLog)_FuzzCmpMem(id,a,strnlen(a,n),b,strnlen(b,n));return strncmp(a,b,n);}"
+		"int _Fuzz_strcasecmp(unsigned id,const char*a,const char*b){if(_FuzzCmpLog&&*_FuzzCmpLog)_FuzzCmpMem(id,a,strnlen(a," << CMPLOG_BYTES << "),b,strnlen(b," << CMPLOG_BYTES << "));return strcasecmp(a,b);}"
+		"int _Fuzz_strncasecmp(unsigned id,const char*a,const char*b,unsigned long n){if(_FuzzCmpLog&&*_FuzzCmpLog)_FuzzCmpMem(id,a,strnlen(a,n),b,strnlen(b,n));return strncasecmp(a,b,n);}"
+		"int _Fuzz_memcmp(unsigned id,const void*a,const void*b,unsigned long n){if(_FuzzCmpLog&&*_FuzzCmpLog)_FuzzCmpMem(id,a,n,b,n);return memcmp(a,b,n);}"
+		"\n";
+}
+
+/// <summary>
+/// Emit the split string comparisons (InstrumentOptions::splitCompares). Each one hits the counters of the prefix the strings share, up to the number of counters, then compares the usual way.
+/// </summary>
+void instrumentSplitCompares(std::ostream& os)
+{
+	os <<
+		"#include <ctype.h>\n"
+		"#include <strings.h>\n"
+		"int _FuzzSplit_strcmp(unsigned c,unsigned n,const char*a,const char*b){for(unsigned i=0;i<n&&a[i]&&a[i]==b[i];++i)_FuzzProgress(c+i);return strcmp(a,b);}"
+		"int _FuzzSplit_strncmp(unsigned c,unsigned n,const char*a,const char*b,unsigned long size){for(unsigned i=0;i<n&&i<size&&a[i]&&a[i]==b[i];++i)_FuzzProgress(c+i);return strncmp(a,b,size);}"
+		"int _FuzzSplit_strcasecmp(unsigned c,unsigned n,const char*a,const char*b){for(unsigned i=0;i<n&&a[i]&&tolower((unsigned char)a[i])==tolower((unsigned char)b[i]);++i)_FuzzProgress(c+i);return strcasecmp(a,b);}"
+		"int _FuzzSplit_strncasecmp(unsigned c,unsigned n,const char*a,const char*b,unsigned long size){for(unsigned i=0;i<n&&i<size&&a[i]&&tolower((unsigned char)a[i])==tolower((unsigned char)b[i]);++i)_FuzzProgress(c+i);return strncasecmp(a,b,size);}"
+		"int _FuzzSplit_memcmp(unsigned c,unsigned n,const void*a,const void*b,unsigned long size){for(unsigned i=0;i<n&&i<size&&((const unsigned char*)a)[i]==((const unsigned char*)b)[i];++i)_FuzzProgress(c+i);return memcmp(a,b,size);}"
+		"\n";
+}
+
+/// <summary>
+/// Emit the counters and the runtime that maps them from the shared memory of the fuzzer (_MapCoverage) and writes them as LCOV or a binary dump (_GenerateLcov)
+/// </summary>
+void instrumentHeaderMain(std::ostream& os, const std::vector<FileInstrument>& allFiles, const InstrumentOptions& options = {})
+{
+	const size_t lines = lineCounters(allFiles);
+	const size_t total = totalCounters(allFiles);
+
+	const size_t edges = options.edges ? EDGE_MAP_SIZE : 0;
 
+	const size_t counterSize = total * options.counterBytes;
+
+	os <<
+		counterType(options) << " _FuzzCovLocal[" << std::max<size_t>(total, 1) << "];"
+		<< counterType(options) << "*_FuzzCov=_FuzzCovLocal;"
+		;
+
+	if (options.edges)
+	{
 		os <<
-			"LH:%llu\\n"
-			"LF:" << i.instrumentations.size() << "\\n"
-			<< "end_of_record" "\\n"
+			"unsigned char _FuzzEdgeLocal[" << edges << "];"
+			"unsigned char*_FuzzEdge=_FuzzEdgeLocal;"
+			"unsigned _FuzzPrev;"
 			;
 	}
+	if (options.context)
+		os << "__thread unsigned _FuzzCtx;";
+
+	os << '\n';
+
+	os <<
+		"#include <stdio.h>\n"
+		"#include <stdlib.h>\n"
+		"#include <string.h>\n"
+		"#include <sys/shm.h>\n"
+		;
+	if (options.cmpLog)
+		instrumentCmpLog(os);
+	// Hits before the mapping (e.g. before the fork point of a fork server) stay in the local counters and are added to the shared memory,
+	// saturating so that the counters the fuzzer marked as known by 255 stay at it
+	os << "static void _FuzzMergeHits(unsigned char*to,const unsigned char*from,unsigned long n){for(unsigned long i=0;i<n;++i){unsigned sum=to[i]+from[i];to[i]=sum>255?255:sum;}}";
+	os << "static void _FuzzAddLocalHits(){";
+	if (options.counterBytes == 1)
+		os << "_FuzzMergeHits(_FuzzCov,_FuzzCovLocal," << counterSize << ");";
+	else
+		os << "for(unsigned long i=0;i<" << total << ";++i)_FuzzCov[i]+=_FuzzCovLocal[i];";
+	if (options.edges)
+		os << "_FuzzMergeHits(_FuzzEdge,_FuzzEdgeLocal," << edges << ");";
+	os << "}";
+	os <<
+		"void _MapCoverage(){"
+		<< (options.cmpLog ? "_MapCmpLog();" : "") <<
+		"const char*id=getenv(\"" << COVERAGE_SHM_ENV << "\");"
+		"if(!id||_FuzzCov!=_FuzzCovLocal)return;"
+		"struct shmid_ds ds;"
+		"if(shmctl(atoi(id),IPC_STAT,&ds)!=0||ds.shm_segsz<" << 4 * sizeof(unsigned long long) + counterSize + edges << ")return;"
+		"unsigned long long*shm=(unsigned long long*)shmat(atoi(id),0,0);"
+		"if(shm==(void*)-1)return;"
+		"unsigned char*counters=(unsigned char*)(shm+4);"
+		;
+	if (options.edges)
+		os << "_FuzzEdge=counters+" << counterSize << ";";
+	os <<
+		"shm[3]=" << lines << ";"
+		"shm[2]=" << options.counterBytes << ";"
+		"shm[1]=" << edges << ";"
+		"shm[0]=" << total << ";"
+		"_FuzzCov=(" << counterType(options) << "*)counters;"
+		"_FuzzAddLocalHits();"
+		"}\n"
+		;
 
-	os << "\"";
+	// Tables of the lines and files of the line counters, walked by one loop instead of a format string with an argument per line. Split comparisons are not lines of the report.
+	os << "static const unsigned _FuzzLine[" << std::max<size_t>(lines, 1) << "]={";
+	for (const auto& i : allFiles)
+		for (const auto& j : i.instrumentations)
+			os << j.second << ',';
+	if (lines == 0)
+		os << '0';
+	os << "};";
+
+	os << "static const unsigned long long _FuzzFileRange[" << std::max<size_t>(allFiles.size(), 1) << "][2]={";
+	for (const auto& i : allFiles)
+		os << '{' << i.counterOffset << ',' << i.counterOffset + i.counters() << "},";
+	if (allFiles.empty())
+		os << "{0,0}";
+	os << "};";
 
+	os << "static const char*const _FuzzFileName[" << std::max<size_t>(allFiles.size(), 1) << "]={";
 	for (const auto& i : allFiles)
+		os << cStringLiteral(i.filename) << ',';
+	if (allFiles.empty())
+		os << '0';
+	os << "};\n";
+
+	os <<
+		"#include <fcntl.h>\n"
+		"#include <unistd.h>\n"
+		"#include <sys/uio.h>\n"
+		"void _GenerateLcov(){"
+		"if(_FuzzCov!=_FuzzCovLocal)return;"
+		"const char*path=getenv(\"" << COVERAGE_FILE_ENV << "\");"
+		"if(!path)path=\"coverage.lcov\";"
+		"const char*format=getenv(\"" << COVERAGE_FORMAT_ENV << "\");"
+		"if(format&&strcmp(format,\"" << COVERAGE_FORMAT_BINARY << "\")==0){"
+			"int fd=open(path,O_WRONLY|O_CREAT|O_TRUNC,0644);"
+			"if(fd<0)return;"
+			"unsigned long long header[5]={" << COVERAGE_BINARY_MAGIC << "ull," << total << "," << edges << "," << options.counterBytes << "," << lines << "};"
+			"struct iovec parts[3]={{header,sizeof(header)},{_FuzzCov," << counterSize << "},{" << (options.edges ? "_FuzzEdge" : "0") << "," << edges << "}};"
+			"if(writev(fd,parts,3)<0){}"
+			"close(fd);"
+			"return;"
+		"}"
+		"FILE*f=fopen(path,\"w\");"
+		"if(!f)return;"
+		"fputs(\"TN:test\\n\",f);"
+		"for(unsigned i=0;i<" << allFiles.size() << ";++i){"
+			"unsigned long long LH=0,k=_FuzzFileRange[i][0];"
+			"fprintf(f,\"SF:%s\\n\",_FuzzFileName[i]);"
+			"for(;k<_FuzzFileRange[i][1];++k){"
+				"fprintf(f,\"DA:%u,%llu\\n\",_FuzzLine[k],(unsigned long long)_FuzzCov[k]);"
+				"if(_FuzzCov[k]>0)++LH;"
+			"}"
+			"fprintf(f,\"LH:%llu\\nLF:%llu\\nend_of_record\\n\",LH,_FuzzFileRange[i][1]-_FuzzFileRange[i][0]);"
+		"}"
+		"fclose(f);"
+		"}\n";
+
+	bool deferred = std::any_of(allFiles.begin(), allFiles.end(), [](const FileInstrument& i) { return i.hasDeferredInit; });
+
+	if (options.forkServer || options.persistent)
 	{
-		os << ",";
-		for (size_t j = 0; j < i.instrumentations.size(); j++)
-		{
-			os <<
-				"_F" << i.fileId << "[" << j << "]" ",";
-		}
-		os << "LH" << i.fileId;
+		os <<
+			"#include <unistd.h>\n"
+			"#include <signal.h>\n"
+			"#include <sys/wait.h>\n"
+			;
+		instrumentForkServer(os, deferred, options.persistent);
 	}
+	else if (deferred)
+		os << "void " << DEFERRED_INIT_MARKER << "(void){}\n";
 
-	os << ");}\n";
+	if (options.inProcess)
+	{
+		// Counters mapped into the shared memory of the fuzzer (_MapCoverage) are read and reset by the fuzzer
+		os << "void _ResetCoverage(){if(_FuzzCov==_FuzzCovLocal){memset(_FuzzCov,0,sizeof(_FuzzCovLocal));" << (options.edges ? "memset(_FuzzEdge,0,sizeof(_FuzzEdgeLocal));}_FuzzPrev=0;" : "}") << (options.context ? "_FuzzCtx=0;" : "") << "}\n";
+	}
+
+	os << probeMacro(options) << cmpLogMacro(options) << splitComparesMacro(options) << contextMacro(options);
+	if (options.splitCompares)
+		instrumentSplitCompares(os);
+	os << "#define __FUZZ_INSTRUMENTED 1\n";
+
+	// The original source always starts at line 5, no matter how much runtime was emitted (fuzzer_greybox::asanOffset relies on it)
+	os << "#line 5\n";
+}
+
+/// <summary>
+/// Emit the main of a persistent program, after the original source of the main file.
+/// It runs the original main once per input: after each one it writes the coverage and stops itself until the fork server sends the next input, then resets the counters to what they were at the fork point.
+/// Without a fuzzer, or when the original main fails, it behaves like the original main.
+/// Every iteration starts main from the beginning, so it cannot be combined with a deferred initialization marker (rejected by the tool).
+/// </summary>
+void instrumentFooterMain(std::ostream& os, const std::vector<FileInstrument>& allFiles, const InstrumentOptions& options = {})
+{
+	if (!options.persistent)
+		return;
+
+	os <<
+		"\n"
+		"static " << counterType(options) << " _FuzzCovBase[sizeof(_FuzzCovLocal)/sizeof(*_FuzzCovLocal)];"
+		<< (options.edges ? "static unsigned char _FuzzEdgeBase[sizeof(_FuzzEdgeLocal)];static unsigned _FuzzPrevBase;" : "") <<
+		"int main(int argc,char**argv){"
+		"atexit(_GenerateLcov);"
+		"_ForkServer();"
+		"memcpy(_FuzzCovBase,_FuzzCov,sizeof(_FuzzCovBase));"
+		<< (options.edges ? "memcpy(_FuzzEdgeBase,_FuzzEdge,sizeof(_FuzzEdgeBase));_FuzzPrevBase=_FuzzPrev;" : "") <<
+		"const char*n=getenv(\"" << PERSISTENT_ITERATIONS_ENV << "\");"
+		"unsigned long long iterations=n?strtoull(n,0,10):" << PERSISTENT_ITERATIONS_DEFAULT << ";"
+		"for(unsigned long long i=1;;++i){"
+			"int ret=((int(*)(int,char**))" << PERSISTENT_TARGET_PREFIX << "main)(argc,argv);"
+			"if(ret!=0||!_FuzzPersistent||i>=iterations)return ret;"
+			"_GenerateLcov();"
+			"fflush(NULL);"
+			"raise(SIGSTOP);"
+			// Counters in shared memory are read and reset by the fuzzer while stopped, only the hits before the fork point are added back when continued
+			"if(_FuzzCov!=_FuzzCovLocal)_FuzzAddLocalHits();"
+			"else{memcpy(_FuzzCov,_FuzzCovBase,sizeof(_FuzzCovBase));" << (options.edges ? "memcpy(_FuzzEdge,_FuzzEdgeBase,sizeof(_FuzzEdgeBase));" : "") << "}"
+			<< (options.edges ? "_FuzzPrev=_FuzzPrevBase;" : "") << (options.context ? "_FuzzCtx=0;" : "") <<
+			"fseek(stdin,0,SEEK_SET);"
+			"clearerr(stdin);"
+		"}"
+		"}\n"
+		;
 }
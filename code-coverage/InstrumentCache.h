@@ -0,0 +1,179 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <fstream>
+#include <filesystem>
+#include <unordered_map>
+#include "FileInstrument.h"
+
+/// <summary>
+/// Hash of the content of a source file, FNV-1a. The same on every platform, as it is stored in the cache.
+/// </summary>
+inline uint64_t contentHash(std::string_view str)
+{
+	uint64_t hash = 0xcbf29ce484222325ull;
+	for (unsigned char c : str)
+		hash = (hash ^ c) * 0x100000001b3ull;
+	return hash;
+}
+
+/// <summary>
+/// Probes of the files instrumented by the previous run. A file with the same content and options is not parsed again,
+/// and its instrumented output is not rewritten if its id and counters did not move either, so that the build recompiles only the changed files.
+/// </summary>
+class InstrumentCache
+{
+public:
+	/// <summary>
+	/// Default path of the cache, next to the instrumented files
+	/// </summary>
+	static constexpr std::string_view DEFAULT_PATH = ".code-coverage-cache";
+
+	/// <summary>
+	/// Read the cache written by the previous run. A missing or unreadable cache is empty.
+	/// </summary>
+	void load(const std::filesystem::path& path)
+	{
+		entries.clear();
+		std::ifstream in(path, std::ios::binary);
+		std::string magic;
+		if (!(in >> magic) || magic != MAGIC)
+			return;
+
+		std::string filename;
+		Entry entry;
+		size_t instrumentations, instrumentationsStr, comparisons, splits;
+		while (readString(in, filename) && in >> entry.hash >> entry.options >> entry.fileId >> entry.counterOffset >> entry.splitOffset >> entry.thisIsMainFile >> entry.hasDeferredInit >> instrumentations >> instrumentationsStr >> comparisons >> splits)
+		{
+			entry.instrumentations.resize(instrumentations);
+			for (auto& i : entry.instrumentations)
+				in >> i.first >> i.second;
+			entry.instrumentationsStr.resize(instrumentationsStr);
+			for (auto& i : entry.instrumentationsStr)
+			{
+				in >> i.first;
+				readString(in, i.second);
+			}
+			entry.comparisons.resize(comparisons);
+			for (auto& i : entry.comparisons)
+				in >> i.first >> i.second;
+			entry.splits.resize(splits);
+			for (auto& i : entry.splits)
+				in >> i.first >> i.second;
+			if (!in)
+			{
+				entries.clear();
+				return;
+			}
+			entries[filename] = std::move(entry);
+		}
+	}
+
+	void save(const std::filesystem::path& path) const
+	{
+		std::ofstream out(path, std::ios::binary);
+		out << MAGIC << '\n';
+		for (const auto& [filename, entry] : entries)
+		{
+			writeString(out, filename);
+			out << ' ' << entry.hash << ' ' << entry.options << ' ' << entry.fileId << ' ' << entry.counterOffset << ' ' << entry.splitOffset << ' ' << entry.thisIsMainFile << ' ' << entry.hasDeferredInit << ' ' << entry.instrumentations.size() << ' ' << entry.instrumentationsStr.size() << ' ' << entry.comparisons.size() << ' ' << entry.splits.size() << '\n';
+			for (const auto& i : entry.instrumentations)
+				out << i.first << ' ' << i.second << ' ';
+			for (const auto& i : entry.instrumentationsStr)
+			{
+				out << i.first << ' ';
+				writeString(out, i.second);
+			}
+			for (const auto& i : entry.comparisons)
+				out << i.first << ' ' << i.second << ' ';
+			for (const auto& i : entry.splits)
+				out << i.first << ' ' << i.second << ' ';
+			out << '\n';
+		}
+	}
+
+	/// <summary>
+	/// Parse a file, unless the previous run parsed the same content with the same options. Can be called by several threads at once.
+	/// </summary>
+	FileInstrument instrument(std::string sourcecode, std::string filename, int fileId, const InstrumentOptions& options) const
+	{
+		auto it = entries.find(filename);
+		// The control flow (directed fuzzing) is not cached
+		if (options.controlFlow || it == entries.end() || it->second.hash != contentHash(sourcecode) || it->second.options != optionsKey(options))
+			return FileInstrument(std::move(sourcecode), std::move(filename), fileId, options);
+
+		const auto& entry = it->second;
+		return FileInstrument(std::move(sourcecode), std::move(filename), fileId, options, entry.instrumentations, entry.instrumentationsStr, entry.comparisons, entry.splits, entry.thisIsMainFile, entry.hasDeferredInit);
+	}
+
+	/// <summary>
+	/// Whether the previous run wrote the same instrumented output of the file. The file with main also holds the tables of all files, so it is always written.
+	/// </summary>
+	bool unchanged(const FileInstrument& file) const
+	{
+		auto it = entries.find(file.filename);
+		return it != entries.end() && !file.thisIsMainFile && it->second.hash == contentHash(file.sourcecode) && it->second.options == optionsKey(file.options)
+			&& it->second.fileId == file.fileId && it->second.counterOffset == file.counterOffset && it->second.splitOffset == file.splitOffset;
+	}
+
+	/// <summary>
+	/// Remember a file for the next run, after its counters were placed (assignCounterOffsets)
+	/// </summary>
+	void store(const FileInstrument& file)
+	{
+		entries[file.filename] = Entry{ contentHash(file.sourcecode), optionsKey(file.options), file.fileId, file.counterOffset, file.splitOffset, file.thisIsMainFile, file.hasDeferredInit, file.instrumentations, file.instrumentationsStr, file.comparisons, file.splits };
+	}
+
+	size_t size() const
+	{
+		return entries.size();
+	}
+
+private:
+	static constexpr std::string_view MAGIC = "code-coverage-cache-5";
+
+	struct Entry
+	{
+		uint64_t hash = 0;
+		unsigned options = 0;
+		int fileId = 0;
+		size_t counterOffset = 0;
+		size_t splitOffset = 0;
+		bool thisIsMainFile = false;
+		bool hasDeferredInit = false;
+		std::vector<std::pair<uint32_t, uint32_t>> instrumentations;
+		std::vector<std::pair<uint32_t, std::string>> instrumentationsStr;
+		std::vector<std::pair<uint32_t, uint32_t>> comparisons;
+		std::vector<std::pair<uint32_t, uint32_t>> splits;
+	};
+
+	/// <summary>
+	/// Options that change the probes or the output, one bit each
+	/// </summary>
+	static unsigned optionsKey(const InstrumentOptions& options)
+	{
+		return options.forkServer | options.persistent << 1 | options.inProcess << 2 | options.edges << 3 | options.counterBytes << 4 | options.prune << 8 | options.cmpLog << 9 | options.splitCompares << 10 | options.context << 11;
+	}
+
+	/// <summary>
+	/// Strings are written with their length, as file names and injected code may contain spaces
+	/// </summary>
+	static void writeString(std::ostream& out, std::string_view str)
+	{
+		out << str.size() << ':' << str;
+	}
+
+	static bool readString(std::istream& in, std::string& str)
+	{
+		size_t size;
+		char colon;
+		if (!(in >> size) || !in.get(colon) || colon != ':')
+			return false;
+		str.resize(size);
+		return static_cast<bool>(in.read(str.data(), size));
+	}
+
+	std::unordered_map<std::string, Entry> entries;
+};
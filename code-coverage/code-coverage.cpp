@@ -2,7 +2,10 @@
 #include <fstream>
 #include <iostream>
 #include <vector>
+#include <thread>
+#include <atomic>
 #include "FileInstrument.h"
+#include "InstrumentCache.h"
 #define STR(...) static_cast<std::stringstream &&>(std::stringstream() << __VA_ARGS__).str()
 
 /// <summary>
@@ -38,33 +41,144 @@ int main(int argc, char* argv[]) {
 
 	try
 	{
-		std::vector<FileInstrument> fileInstruments;
+		InstrumentOptions options;
+		std::vector<const char*> files;
+		size_t jobs = std::max(1u, std::thread::hardware_concurrency());
+		std::filesystem::path cachePath = InstrumentCache::DEFAULT_PATH;
+		std::optional<unsigned> counterBits;
+		std::vector<DistanceTarget> targets;
 
-		for (int fileId = 1; fileId < argc; ++fileId)
+		for (int i = 1; i < argc; ++i)
 		{
-			try
+			std::string_view arg = argv[i];
+			if (arg == "--forkserver")
+				options.forkServer = true;
+			else if (arg == "--persistent")
+				options.forkServer = options.persistent = true;
+			else if (arg == "--inprocess")
+				options.inProcess = true;
+			else if (arg == "--edges")
+				options.edges = true;
+			else if (arg == "--prune")
+				options.prune = true;
+			else if (arg == "--cmplog")
+				options.cmpLog = true;
+			else if (arg == "--split-compares")
+				options.splitCompares = true;
+			else if (arg == "--context")
+				options.edges = options.context = true;
+			else if (arg == "--target" && i + 1 < argc)
+			{
+				targets.push_back(DistanceTarget::parse(argv[++i]));
+				options.controlFlow = true;
+			}
+			else if (arg == "--jobs" && i + 1 < argc)
+				jobs = std::max(1, std::atoi(argv[++i]));
+			else if (arg == "--counter-bits" && i + 1 < argc)
 			{
-				fileInstruments.emplace_back(loadFile(argv[fileId]), argv[fileId], fileId-1);
-				std::cerr << "Loaded file " << argv[fileId] << std::endl;
+				counterBits = std::atoi(argv[++i]);
+				if (counterBits != 8u && counterBits != 64u)
+					throw std::runtime_error("Counters have 8 or 64 bits");
 			}
-			catch (const std::exception& e)
+			else if (arg == "--no-cache")
+				cachePath.clear();
+			else
+				files.push_back(argv[i]);
+		}
+
+		// Fuzzer only needs the buckets of the counts, plain coverage runs count exactly
+		if (!counterBits)
+			counterBits = options.forkServer || options.inProcess || options.prune ? 8 : 64;
+		options.counterBytes = *counterBits / 8;
+		if (options.prune && options.counterBytes != 1)
+			throw std::runtime_error("Only 8-bit counters can be pruned");
+
+		InstrumentCache cache;
+		if (!cachePath.empty())
+			cache.load(cachePath);
+
+		// Files are parsed by several threads, the id of a file is still its position in the arguments
+		std::vector<std::optional<FileInstrument>> parsed(files.size());
+		std::vector<std::string> errors(files.size());
+		std::atomic<size_t> nextFile = 0;
+		auto parse = [&]() {
+			for (size_t fileId; (fileId = nextFile++) < files.size(); )
+			{
+				try
+				{
+					parsed[fileId].emplace(cache.instrument(loadFile(files[fileId]), files[fileId], (int)fileId, options));
+				}
+				catch (const std::exception& e)
+				{
+					errors[fileId] = e.what();
+				}
+			}
+		};
+		{
+			std::vector<std::jthread> threads;
+			for (size_t i = 1; i < std::min(jobs, files.size()); i++)
+				threads.emplace_back(parse);
+			parse();
+		}
+
+		std::vector<FileInstrument> fileInstruments;
+
+		for (size_t fileId = 0; fileId < files.size(); ++fileId)
+		{
+			if (parsed[fileId])
 			{
-				std::cerr << "Error parsing file " << argv[fileId] << ": " << e.what() << std::endl;
+				fileInstruments.push_back(std::move(*parsed[fileId]));
+				std::cerr << "Loaded file " << files[fileId] << std::endl;
 			}
+			else
+				std::cerr << "Error parsing file " << files[fileId] << ": " << errors[fileId] << std::endl;
 		}
 
 		std::cerr << "Loaded " << fileInstruments.size() << " files." << std::endl;
 
+		// Persistent loop calls main from the start, the initialization before the marker would run for every input
+		if (options.persistent && std::any_of(fileInstruments.begin(), fileInstruments.end(), [](const FileInstrument& i) { return i.hasDeferredInit; }))
+			throw std::runtime_error(STR("--persistent cannot be used with a " << DEFERRED_INIT_MARKER << "() marker"));
+
+		assignCounterOffsets(fileInstruments);
+
+		if (!targets.empty())
+		{
+			std::ofstream distancesFile("distances.txt");
+			writeDistances(distancesFile, computeDistances(fileInstruments, targets));
+		}
+
+		size_t skipped = 0;
 		for (const auto& i : fileInstruments)
 		{
-			std::ofstream outFile(STR(i.fileId << "_instrumented_main.c"));
+			std::string outPath = STR(i.fileId << "_instrumented_main.c");
+			if (cache.unchanged(i) && std::filesystem::exists(outPath))
+			{
+				skipped++;
+				continue;
+			}
+
+			std::ofstream outFile(outPath);
 
 			if (i.thisIsMainFile)
-				instrumentHeaderMain(outFile, fileInstruments);
+				instrumentHeaderMain(outFile, fileInstruments, options);
 			else
 				instrumentHeaderExtern(outFile, i);
 
 			i.instrument(outFile);
+
+			if (i.thisIsMainFile)
+				instrumentFooterMain(outFile, fileInstruments, options);
+		}
+
+		if (!cachePath.empty())
+		{
+			// Files not given this time are left out
+			InstrumentCache next;
+			for (const auto& i : fileInstruments)
+				next.store(i);
+			next.save(cachePath);
+			std::cerr << "Kept " << skipped << " unchanged files." << std::endl;
 		}
 	}
 	catch (const std::exception& e)
@@ -1,6 +1,10 @@
 #include <gtest/gtest.h>
 #include "FileInstrument.h"
+#include "InstrumentCache.h"
 #include <optional>
+#ifndef _MSC_VER
+#include <sys/shm.h>
+#endif
 
 
 // Test Fixture for FileInstrument tests
@@ -103,7 +107,143 @@ TEST_F(FileInstrumentTest, Instrument) {
     std::stringstream output;
     fileInstrument->instrument(output);
 
-    EXPECT_EQ(output.str(), "int main() {atexit(_GenerateLcov); ++_F1[0];return 0; }");
+    EXPECT_EQ(output.str(), "int main() {atexit(_GenerateLcov);_MapCoverage(); _FuzzHit(_FuzzCov[0]);return 0; }");
+}
+
+// Test that fork server is started at the beginning of main
+TEST(InstrumentForkServer, Instrument) {
+    InstrumentOptions options;
+    options.forkServer = true;
+    FileInstrument file("int main() { return 0; }", "test.cpp", 1, options);
+    std::stringstream output;
+    file.instrument(output);
+
+    EXPECT_EQ(output.str(), "int main() {atexit(_GenerateLcov);_ForkServer(); _FuzzHit(_FuzzCov[0]);return 0; }");
+}
+
+// Test that the fork server is part of the runtime and line numbers of the original file are kept
+TEST(InstrumentForkServer, InstrumentHeaderMain) {
+    InstrumentOptions options;
+    options.forkServer = true;
+    std::vector<FileInstrument> allFiles = {
+        FileInstrument("int main() { return 0; }", "file0.cpp", 0, options)
+    };
+
+    std::stringstream output;
+    instrumentHeaderMain(output, allFiles, options);
+
+    EXPECT_NE(output.str().find("void _ForkServer(){"), std::string::npos);
+    EXPECT_TRUE(output.str().ends_with("#line 5\n"));
+}
+
+// Test that the deferred initialization marker is recognized and declared in other files
+TEST(InstrumentForkServer, DeferredInitMarker) {
+    InstrumentOptions options;
+    options.forkServer = true;
+    FileInstrument file("void setup() { prepare(); __fuzz_init_done(); }", "test.cpp", 1, options);
+
+    EXPECT_TRUE(file.hasDeferredInit);
+
+    std::stringstream output;
+    instrumentHeaderExtern(output, file);
+
+    EXPECT_EQ(output.str(), STR("extern unsigned char*_FuzzCov;\n" << probeMacro(options) << "#define __FUZZ_INSTRUMENTED 1\nvoid __fuzz_init_done(void);\n#line 2\n"));
+
+    FileInstrument other("void setup() { __fuzz_init_done; }", "test.cpp", 1, options);
+    EXPECT_FALSE(other.hasDeferredInit);
+}
+
+#ifndef _MSC_VER
+// Test that hits before the fork point are added to the shared memory of the fuzzer, and a counter it marked as known by 255 stays at it
+TEST(InstrumentForkServer, KnownCounterStays) {
+    InstrumentOptions options;
+    options.forkServer = true;
+    options.prune = true;
+    std::vector<FileInstrument> allFiles = {
+        FileInstrument("int main() { int a = 0;\nreturn a; }", "main.c", 0, options)
+    };
+    assignCounterOffsets(allFiles);
+
+    auto path = (std::filesystem::temp_directory_path() / "code-coverage-known").string();
+    {
+        std::ofstream program(path + ".c");
+        instrumentHeaderMain(program, allFiles, options);
+        program << "int main() { _FuzzHit(_FuzzCov[0]); _FuzzHit(_FuzzCov[1]); _ForkServer(); _FuzzHit(_FuzzCov[1]); return 0; }\n";
+    }
+    ASSERT_EQ(std::system(("cc -x c " + path + ".c -o " + path).c_str()), 0);
+
+    int id = shmget(IPC_PRIVATE, 4 * sizeof(unsigned long long) + 2, IPC_CREAT | 0600);
+    ASSERT_GE(id, 0);
+    auto shm = static_cast<unsigned long long*>(shmat(id, nullptr, 0));
+    auto counters = reinterpret_cast<unsigned char*>(shm + 4);
+    counters[0] = 255;
+    counters[1] = 0;
+
+    // Without a fuzzer on the other end of the fork server, the program maps the counters just like a forked child
+    EXPECT_EQ(std::system(("FUZZ_COVERAGE_SHM=" + std::to_string(id) + " " + path).c_str()), 0);
+    EXPECT_EQ(shm[0], 2);
+    EXPECT_EQ(counters[0], 255);
+    EXPECT_EQ(counters[1], 2);
+
+    shmdt(shm);
+    shmctl(id, IPC_RMID, nullptr);
+}
+#endif
+
+// Test that main of a persistent program is renamed and the runtime is left to the generated main
+TEST(InstrumentPersistent, Instrument) {
+    InstrumentOptions options;
+    options.forkServer = options.persistent = true;
+    FileInstrument file("int main() { return 0; }", "test.cpp", 1, options);
+    std::stringstream output;
+    file.instrument(output);
+
+    EXPECT_TRUE(file.thisIsMainFile);
+    EXPECT_EQ(output.str(), "int _FuzzTarget_main() { _FuzzHit(_FuzzCov[0]);return 0; }");
+}
+
+// Test that the generated main loops over the inputs and resets coverage between them
+TEST(InstrumentPersistent, InstrumentFooterMain) {
+    InstrumentOptions options;
+    options.forkServer = options.persistent = true;
+    std::vector<FileInstrument> allFiles = {
+        FileInstrument("int main() { return 0; }", "file0.cpp", 0, options)
+    };
+
+    std::stringstream header;
+    instrumentHeaderMain(header, allFiles, options);
+    EXPECT_NE(header.str().find("waitpid(pid,&status,WUNTRACED)"), std::string::npos);
+
+    std::stringstream footer;
+    instrumentFooterMain(footer, allFiles, options);
+    EXPECT_NE(footer.str().find("int main(int argc,char**argv){"), std::string::npos);
+    EXPECT_NE(footer.str().find("memcpy(_FuzzCov,_FuzzCovBase,sizeof(_FuzzCovBase));"), std::string::npos);
+    EXPECT_NE(footer.str().find("raise(SIGSTOP);"), std::string::npos);
+
+    std::stringstream none;
+    instrumentFooterMain(none, allFiles);
+    EXPECT_TRUE(none.str().empty());
+}
+
+// Test that the runtime of an in-process harness goes next to LLVMFuzzerTestOneInput and can reset the counters
+TEST(InstrumentInProcess, InstrumentHeaderMain) {
+    InstrumentOptions options;
+    options.inProcess = true;
+    std::vector<FileInstrument> allFiles = {
+        FileInstrument("int LLVMFuzzerTestOneInput(const char* data, unsigned long size) { return 0; }", "file0.c", 0, options),
+        FileInstrument("int main() { return 0; }", "file1.c", 1, options)
+    };
+
+    EXPECT_TRUE(allFiles[0].thisIsMainFile);
+    EXPECT_FALSE(allFiles[1].thisIsMainFile);
+
+    std::stringstream harness;
+    allFiles[0].instrument(harness);
+    EXPECT_EQ(harness.str(), "int LLVMFuzzerTestOneInput(const char* data, unsigned long size) { _FuzzHit(_FuzzCov[0]);return 0; }");
+
+    std::stringstream header;
+    instrumentHeaderMain(header, allFiles, options);
+    EXPECT_NE(header.str().find("void _ResetCoverage(){if(_FuzzCov==_FuzzCovLocal){memset(_FuzzCov,0,sizeof(_FuzzCovLocal));}}"), std::string::npos);
 }
 
 // Test instrumentHeaderExtern function
@@ -113,7 +253,7 @@ TEST(InstrumentHeaderTest, InstrumentHeaderExtern) {
 
     instrumentHeaderExtern(output, file);
 
-    EXPECT_EQ(output.str(), "extern unsigned long long _F1[];\n");
+    EXPECT_EQ(output.str(), STR("extern unsigned char*_FuzzCov;\n" << probeMacro({})));
 }
 
 // Test instrumentHeaderMain function
@@ -127,4 +267,259 @@ TEST(InstrumentHeaderTest, InstrumentHeaderMain) {
     instrumentHeaderMain(output, allFiles);
 
     EXPECT_FALSE(output.str().empty());
-}
\ No newline at end of file
+}
+
+// Test that the counters of all files are in one region, mapped from the shared memory of the fuzzer
+TEST(InstrumentSharedCoverage, CounterOffsets) {
+    std::vector<FileInstrument> allFiles = {
+        FileInstrument("int main() { int a = 0;\nreturn a; }", "file0.c", 0),
+        FileInstrument("void foo() { }\nvoid bar() { bar(); }", "file1.c", 1)
+    };
+
+    EXPECT_EQ(assignCounterOffsets(allFiles), 3);
+    EXPECT_EQ(allFiles[1].counterOffset, 2);
+
+    std::stringstream file;
+    allFiles[1].instrument(file);
+    EXPECT_EQ(file.str(), "void foo() { }\nvoid bar() { _FuzzHit(_FuzzCov[2]);bar(); }");
+
+    std::stringstream header;
+    instrumentHeaderMain(header, allFiles);
+    EXPECT_TRUE(header.str().starts_with("unsigned char _FuzzCovLocal[3];unsigned char*_FuzzCov=_FuzzCovLocal;"));
+    EXPECT_NE(header.str().find("getenv(\"FUZZ_COVERAGE_SHM\")"), std::string::npos);
+    EXPECT_NE(header.str().find("shm[3]=3;shm[2]=1;shm[1]=0;shm[0]=3;_FuzzCov=(unsigned char*)counters;"), std::string::npos);
+    EXPECT_TRUE(header.str().ends_with("#line 5\n"));
+}
+
+// Test that every probe also records the edge from the previous probe, with ids fixed at instrumentation time
+TEST(InstrumentEdges, Instrument) {
+    InstrumentOptions options;
+    options.edges = true;
+    std::vector<FileInstrument> allFiles = {
+        FileInstrument("int main() { int a = 0;\nreturn a; }", "file0.c", 0, options)
+    };
+    assignCounterOffsets(allFiles);
+
+    auto first = allFiles[0].edgeBlockId(0), second = allFiles[0].edgeBlockId(1);
+    EXPECT_LT(first, EDGE_MAP_SIZE);
+    EXPECT_NE(first, second);
+    EXPECT_EQ(first, FileInstrument("int main() { return 0; }", "file0.c", 0, options).edgeBlockId(0));
+
+    std::stringstream file;
+    allFiles[0].instrument(file);
+    EXPECT_NE(file.str().find(STR("_FuzzHit(_FuzzCov[1]);_FuzzHit(_FuzzEdge[" << second << "^_FuzzPrev]);_FuzzPrev=" << (second >> 1) << ';')), std::string::npos);
+
+    std::stringstream header;
+    instrumentHeaderMain(header, allFiles, options);
+    EXPECT_NE(header.str().find("unsigned char _FuzzEdgeLocal[65536];"), std::string::npos);
+    EXPECT_NE(header.str().find("shm[1]=65536;"), std::string::npos);
+    EXPECT_TRUE(header.str().ends_with("#line 5\n"));
+
+    std::stringstream externHeader;
+    instrumentHeaderExtern(externHeader, FileInstrument("void foo() { }", "file1.c", 1, options));
+    EXPECT_EQ(externHeader.str(), STR("extern unsigned char*_FuzzCov;\n" << probeMacro(options) << "extern unsigned char*_FuzzEdge;extern unsigned _FuzzPrev;\n"));
+}
+
+// Test that every function sets its calling context on entry and that the edges mix it in
+TEST(InstrumentContext, Instrument) {
+    InstrumentOptions options;
+    options.edges = options.context = true;
+    std::vector<FileInstrument> allFiles = {
+        FileInstrument("int f() { return 1; }\nint main() { return f(); }", "file0.c", 0, options)
+    };
+    assignCounterOffsets(allFiles);
+
+    auto& file = allFiles[0];
+    EXPECT_LT(file.contextId("f"), EDGE_MAP_SIZE);
+    EXPECT_NE(file.contextId("f"), file.contextId("main"));
+    EXPECT_EQ(file.contextId("f"), FileInstrument("int f() { return 2; }", "file0.c", 1, options).contextId("f"));
+
+    std::stringstream out;
+    file.instrument(out);
+    auto first = file.edgeBlockId(0);
+    EXPECT_TRUE(out.str().starts_with(STR("int f() {__attribute__((cleanup(_FuzzCtxLeave)))unsigned _FuzzCtxCaller=_FuzzCtx;_FuzzCtx=(_FuzzCtxCaller>>1)^" << file.contextId("f") << "; "
+        "_FuzzHit(_FuzzCov[0]);_FuzzHit(_FuzzEdge[" << first << "^_FuzzPrev^_FuzzCtx]);_FuzzPrev=" << (first >> 1) << ";return 1; }")));
+    EXPECT_NE(out.str().find(STR("_FuzzCtx=(_FuzzCtxCaller>>1)^" << file.contextId("main") << ';')), std::string::npos);
+
+    std::stringstream header;
+    instrumentHeaderMain(header, allFiles, options);
+    EXPECT_NE(header.str().find("__thread unsigned _FuzzCtx;"), std::string::npos);
+    EXPECT_NE(header.str().find("static inline void _FuzzCtxLeave(unsigned*caller){_FuzzCtx=*caller;}"), std::string::npos);
+    EXPECT_TRUE(header.str().ends_with("#line 5\n"));
+
+    // Every input starts from the empty context, like from the empty previous block
+    options.inProcess = true;
+    std::stringstream inProcessHeader;
+    instrumentHeaderMain(inProcessHeader, allFiles, options);
+    EXPECT_NE(inProcessHeader.str().find("memset(_FuzzEdge,0,sizeof(_FuzzEdgeLocal));}_FuzzPrev=0;_FuzzCtx=0;}"), std::string::npos);
+
+    options.inProcess = false;
+    options.persistent = true;
+    std::stringstream footer;
+    instrumentFooterMain(footer, allFiles, options);
+    EXPECT_NE(footer.str().find("_FuzzPrev=_FuzzPrevBase;_FuzzCtx=0;fseek(stdin,0,SEEK_SET);"), std::string::npos);
+}
+
+// Test that the coverage is written by a loop over tables of lines and files, or dumped in one write
+TEST(InstrumentHeaderTest, CoverageTables) {
+    std::vector<FileInstrument> allFiles = {
+        FileInstrument("int main() { int a = 0;\nreturn a; }", "dir\\\"file0\".c", 0),
+        FileInstrument("void foo() { }\nvoid bar() { bar(); }", "file1.c", 1)
+    };
+    assignCounterOffsets(allFiles);
+
+    std::stringstream header;
+    instrumentHeaderMain(header, allFiles);
+    auto str = header.str();
+    EXPECT_NE(str.find("static const unsigned _FuzzLine[3]={1,2,2,};"), std::string::npos);
+    EXPECT_NE(str.find("_FuzzFileRange[2][2]={{0,2},{2,3},};"), std::string::npos);
+    EXPECT_NE(str.find("_FuzzFileName[2]={\"dir\\\\\\\"file0\\\".c\",\"file1.c\",};"), std::string::npos);
+    EXPECT_NE(str.find("getenv(\"FUZZ_COVERAGE_FORMAT\")"), std::string::npos);
+    EXPECT_NE(str.find("writev(fd,parts,3)"), std::string::npos);
+    EXPECT_EQ(str.find("%llu\\nDA:"), std::string::npos);
+    EXPECT_TRUE(str.ends_with("#line 5\n"));
+}
+
+// Test that unchanged files reuse the probes of the previous run, and their output is kept if their counters did not move
+TEST(InstrumentCacheTest, Reuse) {
+    auto path = std::filesystem::temp_directory_path() / "code-coverage-cache-test";
+    std::string source = "int main() { int a = 0;\nif (a) a++;\nreturn a; }";
+    InstrumentCache cache;
+    std::vector<FileInstrument> allFiles = {
+        cache.instrument(source, "file 0.c", 0, {}),
+        cache.instrument("void foo() { foo(); }", "file1.c", 1, {})
+    };
+    assignCounterOffsets(allFiles);
+    for (const auto& i : allFiles)
+        cache.store(i);
+    cache.save(path);
+
+    InstrumentCache loaded;
+    loaded.load(path);
+    std::filesystem::remove(path);
+    EXPECT_EQ(loaded.size(), 2);
+
+    auto reused = loaded.instrument(source, "file 0.c", 0, {});
+    EXPECT_EQ(reused.instrumentations, allFiles[0].instrumentations);
+    EXPECT_EQ(reused.instrumentationsStr, allFiles[0].instrumentationsStr);
+    EXPECT_TRUE(reused.thisIsMainFile);
+    std::stringstream expected, actual;
+    allFiles[0].instrument(expected);
+    reused.instrument(actual);
+    EXPECT_EQ(actual.str(), expected.str());
+
+    // File with main is always written, others only if they or their counters changed
+    EXPECT_FALSE(loaded.unchanged(allFiles[0]));
+    EXPECT_TRUE(loaded.unchanged(allFiles[1]));
+    std::vector<FileInstrument> changed = {
+        loaded.instrument("int main() { return 0; }", "file 0.c", 0, {}),
+        loaded.instrument("void foo() { foo(); }", "file1.c", 1, {})
+    };
+    assignCounterOffsets(changed);
+    EXPECT_EQ(changed[0].instrumentations.size(), 1);
+    EXPECT_FALSE(loaded.unchanged(changed[1]));
+
+    InstrumentOptions edges;
+    edges.edges = true;
+    EXPECT_FALSE(loaded.unchanged(loaded.instrument("void foo() { foo(); }", "file1.c", 1, edges)));
+}
+
+// Test that counters are bytes that stop at 255 unless exact counts are asked for
+TEST(InstrumentCounters, Width) {
+    InstrumentOptions wide;
+    wide.counterBytes = 8;
+    std::vector<FileInstrument> allFiles = {
+        FileInstrument("int main() { int a = 0;\nreturn a; }", "file0.c", 0, wide)
+    };
+    assignCounterOffsets(allFiles);
+
+    std::stringstream header;
+    instrumentHeaderMain(header, allFiles, wide);
+    EXPECT_TRUE(header.str().starts_with("unsigned long long _FuzzCovLocal[2];unsigned long long*_FuzzCov=_FuzzCovLocal;"));
+    EXPECT_NE(header.str().find("static void _FuzzAddLocalHits(){for(unsigned long i=0;i<2;++i)_FuzzCov[i]+=_FuzzCovLocal[i];}"), std::string::npos);
+    EXPECT_NE(header.str().find("unsigned long long header[5]={"), std::string::npos);
+    EXPECT_NE(probeMacro(wide).find("++(c);"), std::string::npos);
+
+    EXPECT_EQ(InstrumentOptions().counterBytes, 1);
+    EXPECT_NE(probeMacro({}).find("(c)+=(c)!=255;"), std::string::npos);
+}
+
+TEST(InstrumentCounters, Prune) {
+    InstrumentOptions options;
+    options.prune = true;
+    EXPECT_NE(probeMacro(options).find("if(__builtin_expect((c)!=255,0)){++(c);"), std::string::npos);
+
+    // Wide counters cannot be marked as known
+    options.counterBytes = 8;
+    EXPECT_EQ(probeMacro(options).find("if("), std::string::npos);
+}
+
+// Test that comparisons and calls of string comparisons are rewritten into hooks logging their operands, but not comparisons with zero
+TEST(InstrumentCmpLog, Rewrite) {
+    InstrumentOptions options;
+    options.cmpLog = true;
+    std::vector<FileInstrument> allFiles = {
+        FileInstrument("int main() { return 0; }", "file0.c", 0, options),
+        FileInstrument("int f(const char* s, int n) { if (n == 0x1234 && strcmp(s, \"key\") == 0) return 1;\nreturn n < 5; }", "file1.c", 1, options)
+    };
+    assignCounterOffsets(allFiles);
+
+    std::stringstream file;
+    allFiles[1].instrument(file);
+    EXPECT_EQ(file.str(), "int f(const char* s, int n) { _FuzzHit(_FuzzCov[1]);if (_FuzzCmp(1048576,(n ),==,( 0x1234)) && _Fuzz_strcmp(1048577,s, \"key\") == 0) {return 1;}\n"
+        "_FuzzHit(_FuzzCov[2]);return _FuzzCmp(1048578,(n ),<,( 5)); }");
+
+    std::stringstream header;
+    instrumentHeaderExtern(header, allFiles[1]);
+    EXPECT_NE(header.str().find("#define _FuzzCmp(id,a,op,b)"), std::string::npos);
+
+    header.str("");
+    instrumentHeaderMain(header, allFiles, options);
+    EXPECT_NE(header.str().find("void _MapCoverage(){_MapCmpLog();"), std::string::npos);
+    EXPECT_NE(header.str().find("int _Fuzz_memcmp(unsigned id,"), std::string::npos);
+    EXPECT_TRUE(header.str().ends_with("#line 5\n"));
+}
+
+// Test that equality with a wide literal and string comparisons with a literal get a counter for every matching byte, after the counters of the lines of all files
+TEST(InstrumentSplitCompares, Rewrite) {
+    InstrumentOptions options;
+    options.splitCompares = true;
+    options.cmpLog = true;
+    std::vector<FileInstrument> allFiles = {
+        FileInstrument("int main() { return 0; }", "file0.c", 0, options),
+        FileInstrument("int f(const char* s, unsigned n) { if (n == 0xDEADBEEF && !strcmp(s, \"se\\x63ret\")) return 1;\nreturn n != 'a'; }", "file1.c", 1, options)
+    };
+    EXPECT_EQ(assignCounterOffsets(allFiles), 12);
+
+    // Comparison with a character is not split, only logged
+    std::stringstream file;
+    allFiles[1].instrument(file);
+    EXPECT_EQ(file.str(), "int f(const char* s, unsigned n) { _FuzzHit(_FuzzCov[1]);if (_FuzzSplit(3,3,(n ),==,( 0xDEADBEEF)) && !_FuzzSplit_strcmp(6,6,s, \"se\\x63ret\")) {return 1;}\n"
+        "_FuzzHit(_FuzzCov[2]);return _FuzzCmp(1048576,(n ),!=,( 'a')); }");
+
+    std::stringstream header;
+    instrumentHeaderMain(header, allFiles, options);
+    // Split counters are counted, but are not lines of the report
+    EXPECT_TRUE(header.str().starts_with("unsigned char _FuzzCovLocal[12];"));
+    EXPECT_NE(header.str().find("shm[3]=3;"), std::string::npos);
+    EXPECT_NE(header.str().find("static const unsigned _FuzzLine[3]={1,1,2,};"), std::string::npos);
+    EXPECT_NE(header.str().find("{{0,1},{1,3},}"), std::string::npos);
+    EXPECT_NE(header.str().find("#define _FuzzSplit(c,n,a,op,b)"), std::string::npos);
+    EXPECT_NE(header.str().find("int _FuzzSplit_memcmp(unsigned c,"), std::string::npos);
+    EXPECT_TRUE(header.str().ends_with("#line 5\n"));
+}
+
+// Test that the distances to a target line go back along the flow of a function and from a function to its callers
+TEST(InstrumentDistances, ControlFlow) {
+    InstrumentOptions options;
+    options.controlFlow = true;
+    std::vector<FileInstrument> allFiles = {
+        FileInstrument("int g() { return 1; }\nint f(int x) {\nif (x > 1)\nreturn g();\nwhile (x) x--;\nreturn 0;\n}\nint main() { return f(2); }", "src/file0.c", 0, options)
+    };
+    EXPECT_EQ(assignCounterOffsets(allFiles), 6);
+
+    EXPECT_EQ(computeDistances(allFiles, { DistanceTarget::parse("file0.c:1") }), std::vector<int>({ 0, 2, 1, -1, -1, 3 }));
+    EXPECT_EQ(computeDistances(allFiles, { DistanceTarget::parse("src/file0.c:6") }), std::vector<int>({ -1, 2, -1, 1, 0, 3 }));
+    EXPECT_THROW(computeDistances(allFiles, { DistanceTarget::parse("file1.c:1") }), std::runtime_error);
+    EXPECT_THROW(DistanceTarget::parse("file0.c"), std::runtime_error);
+}
@@ -0,0 +1,46 @@
+#include "fuzzer.h"
+
+// Measures the overhead of starting a new process for every execution, boost::process against posix_spawn (SpawnExecutor)
+// Usage: benchmark-executors [program] [executions]
+
+template<typename F>
+static double measure(size_t executions, F&& execute)
+{
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < executions; i++)
+    {
+        auto result = execute();
+        if (result.timed_out || result.return_code != 0) [[unlikely]]
+            throw std::runtime_error("Program did not exit cleanly");
+    }
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / executions;
+}
+
+int main(int argc, char* argv[])
+{
+    std::filesystem::path program = argc > 1 ? argv[1] : "/bin/cat";
+    size_t executions = argc > 2 ? std::stoull(argv[2]) : 2000;
+
+    fuzzer::CinInput input(program, std::chrono::seconds(10));
+    input.setInput("benchmark");
+
+    try
+    {
+        fuzzer::SpawnExecutor spawnExecutor(input); // Also ignores SIGPIPE for the whole benchmark
+        double boost = measure(executions, [&] { return fuzzer::execute_in_new_process(input); });
+        double spawn = measure(executions, [&] { return spawnExecutor.run(input); });
+        fuzzer::SpawnExecutor memoryExecutor(input, true);
+        double memory = measure(executions, [&] { return memoryExecutor.run(input); });
+
+        std::cout << "Program: " << program << ", executions: " << executions << std::endl;
+        std::cout << "boost::process: " << boost << " ms per execution" << std::endl;
+        std::cout << "posix_spawn: " << spawn << " ms per execution" << std::endl;
+        std::cout << "posix_spawn, stdin in memory: " << memory << " ms per execution" << std::endl;
+        std::cout << "Speed-up: " << boost / spawn << "x" << std::endl;
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+}
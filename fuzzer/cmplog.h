@@ -0,0 +1,161 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <unordered_set>
+#include <algorithm>
+
+/// <summary>
+/// Operands of the comparisons of a program instrumented by `code-coverage --cmplog`, logged into a table in shared memory, and the input-to-state replacement (Redqueen) that uses them
+/// </summary>
+namespace cmpLog
+{
+    constexpr const char* SHM_ENV = "FUZZ_CMPLOG_SHM"; // Must be the same as in the coverage tool
+    constexpr size_t ENTRIES = 1024; // Must be the same as in the coverage tool
+    constexpr size_t BYTES = 32; // Must be the same as in the coverage tool
+
+    enum class Kind : uint8_t
+    {
+        integer, // Operands are little endian integers of sizeA bytes
+        memory, // Operands are the first bytes compared by strcmp, memcmp etc.
+    };
+
+    /// <summary>
+    /// One logged comparison, the same layout as in the instrumented program
+    /// </summary>
+    struct Entry
+    {
+        uint32_t id;
+        Kind kind;
+        uint8_t sizeA;
+        uint8_t sizeB;
+        uint8_t unused;
+        uint8_t a[BYTES];
+        uint8_t b[BYTES];
+    };
+    static_assert(sizeof(Entry) == 8 + 2 * BYTES);
+
+    /// <summary>
+    /// Shared memory segment: the fuzzer turns the logging on only for the executions it wants the operands of, the program appends the comparisons that did not match.
+    /// The program sets mapped when it maps the table, a program not instrumented with --cmplog never does.
+    /// </summary>
+    struct Table
+    {
+        uint32_t enabled;
+        uint32_t count;
+        uint32_t mapped;
+        Entry entries[ENTRIES];
+    };
+
+    /// <summary>
+    /// Mutants of an input with one operand of a logged comparison replaced by the other, where the input contains it.
+    /// Integers are looked for as little and big endian bytes of the width of the larger operand and as decimal numbers (also the other operand plus and minus one, for < and >),
+    /// memory as the compared bytes. Every occurrence gives a mutant of its own.
+    /// </summary>
+    class InputToState
+    {
+    public:
+        /// <param name="input">Input the comparisons were logged with</param>
+        /// <param name="limit">Most mutants to make</param>
+        /// <param name="allowed">Characters a mutant may contain, nullptr for all</param>
+        InputToState(std::string_view input, size_t limit, bool (*allowed)(char) = nullptr) : input(input), limit(limit), allowed(allowed)
+        {
+        }
+
+        void add(const Entry& entry)
+        {
+            if (entry.kind == Kind::memory)
+            {
+                std::string_view a(reinterpret_cast<const char*>(entry.a), std::min<size_t>(entry.sizeA, BYTES));
+                std::string_view b(reinterpret_cast<const char*>(entry.b), std::min<size_t>(entry.sizeB, BYTES));
+                replace(a, b, false);
+                replace(b, a, false);
+                return;
+            }
+
+            const size_t size = std::clamp<size_t>(entry.sizeA, 1, sizeof(uint64_t));
+            uint64_t a = 0, b = 0;
+            std::memcpy(&a, entry.a, size);
+            std::memcpy(&b, entry.b, size);
+            if (a == b)
+                return;
+
+            // Bytes of the larger operand, e.g. one for a character compared as an int
+            const size_t width = std::max(significantBytes(a, size), significantBytes(b, size));
+            std::string littleA(reinterpret_cast<const char*>(&a), width), littleB(reinterpret_cast<const char*>(&b), width);
+            replace(littleA, littleB, false);
+            replace(littleB, littleA, false);
+            if (width > 1)
+            {
+                std::string bigA(littleA.rbegin(), littleA.rend()), bigB(littleB.rbegin(), littleB.rend());
+                replace(bigA, bigB, false);
+                replace(bigB, bigA, false);
+            }
+
+            const int64_t signedA = signExtend(a, size), signedB = signExtend(b, size);
+            for (int64_t delta : { 0, 1, -1 })
+            {
+                replace(std::to_string(signedA), std::to_string(signedB + delta), true);
+                replace(std::to_string(signedB), std::to_string(signedA + delta), true);
+            }
+        }
+
+        size_t size() const
+        {
+            return mutants.size();
+        }
+
+        std::vector<std::string> mutants;
+
+    private:
+        /// <summary>
+        /// Add a mutant for every occurrence of the pattern in the input
+        /// </summary>
+        /// <param name="number">Occurrence must not be a part of a longer number</param>
+        void replace(std::string_view pattern, std::string_view replacement, bool number)
+        {
+            if (pattern.empty() || pattern == replacement)
+                return;
+            if (allowed != nullptr && std::find_if_not(replacement.begin(), replacement.end(), allowed) != replacement.end())
+                return;
+
+            for (size_t pos = input.find(pattern); pos != std::string_view::npos && mutants.size() < limit; pos = input.find(pattern, pos + 1))
+            {
+                if (number && ((pos > 0 && isDigit(input[pos - 1])) || (pos + pattern.size() < input.size() && isDigit(input[pos + pattern.size()]))))
+                    continue;
+
+                std::string mutant;
+                mutant.reserve(input.size() - pattern.size() + replacement.size());
+                mutant.append(input.substr(0, pos)).append(replacement).append(input.substr(pos + pattern.size()));
+                if (seen.insert(mutant).second)
+                    mutants.push_back(std::move(mutant));
+            }
+        }
+
+        static bool isDigit(char c)
+        {
+            return c >= '0' && c <= '9';
+        }
+
+        static size_t significantBytes(uint64_t value, size_t size)
+        {
+            size_t bytes = 1;
+            while (bytes < size && (value >> (8 * bytes)) != 0)
+                bytes++;
+            return bytes;
+        }
+
+        static int64_t signExtend(uint64_t value, size_t size)
+        {
+            const unsigned shift = 64 - 8 * static_cast<unsigned>(size);
+            return static_cast<int64_t>(value << shift) >> shift;
+        }
+
+        std::string_view input;
+        const size_t limit;
+        bool (*allowed)(char);
+        std::unordered_set<std::string> seen;
+    };
+}
@@ -0,0 +1,278 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <array>
+#include <span>
+#include <vector>
+#include <algorithm>
+
+#if defined(__AVX2__) || defined(__SSSE3__)
+#include <immintrin.h>
+#endif
+
+/// <summary>
+/// AFL-style buckets of hit counts. A counter is reduced to one bit telling roughly how many times it was hit (1, 2, 3, 4-7, 8-15, 16-31, 32-127, 128+),
+/// so that a loop running a few more times is noticed, but not every single iteration.
+/// </summary>
+namespace hitBuckets
+{
+    /// <summary>
+    /// Bucket of a hit count, 0 if not hit at all
+    /// </summary>
+    constexpr uint8_t bucket(uint64_t hits)
+    {
+        if (hits < 3)
+            return static_cast<uint8_t>(hits);
+        if (hits == 3)
+            return 4;
+        if (hits < 8)
+            return 8;
+        if (hits < 16)
+            return 16;
+        if (hits < 32)
+            return 32;
+        if (hits < 128)
+            return 64;
+        return 128;
+    }
+
+    constexpr std::array<uint8_t, 256> lookup = []() {
+        std::array<uint8_t, 256> res{};
+        for (size_t i = 0; i < res.size(); i++)
+            res[i] = bucket(i);
+        return res;
+    }();
+
+    /// <summary>
+    /// Classify byte counters (e.g. the edge map) into buckets
+    /// </summary>
+    /// <param name="counters">Counters of the program</param>
+    /// <param name="out">Buckets, same size as counters</param>
+    inline void classify(std::span<const uint8_t> counters, std::span<uint8_t> out)
+    {
+        size_t i = 0;
+
+#if defined(__AVX2__) || defined(__SSSE3__)
+        // Bucket of a byte is the bucket of its high nibble if it is not zero (32, 64 or 128), otherwise of its low nibble (at most 16), so it is the larger of them
+        const auto lowTable = _mm_setr_epi8(0, 1, 2, 4, 8, 8, 8, 8, 16, 16, 16, 16, 16, 16, 16, 16);
+        const auto highTable = _mm_setr_epi8(0, 32, 64, 64, 64, 64, 64, 64, (char)128, (char)128, (char)128, (char)128, (char)128, (char)128, (char)128, (char)128);
+#endif
+
+#if defined(__AVX2__)
+        const auto low = _mm256_broadcastsi128_si256(lowTable);
+        const auto high = _mm256_broadcastsi128_si256(highTable);
+        const auto nibble = _mm256_set1_epi8(0x0F);
+        for (; i + sizeof(__m256i) <= counters.size(); i += sizeof(__m256i))
+        {
+            auto v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(counters.data() + i));
+            if (_mm256_testz_si256(v, v)) [[likely]] // The map is sparse
+            {
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(out.data() + i), v);
+                continue;
+            }
+            auto lo = _mm256_shuffle_epi8(low, _mm256_and_si256(v, nibble));
+            auto hi = _mm256_shuffle_epi8(high, _mm256_and_si256(_mm256_srli_epi16(v, 4), nibble));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(out.data() + i), _mm256_max_epu8(lo, hi));
+        }
+#elif defined(__SSSE3__)
+        const auto nibble = _mm_set1_epi8(0x0F);
+        for (; i + sizeof(__m128i) <= counters.size(); i += sizeof(__m128i))
+        {
+            auto v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(counters.data() + i));
+            auto lo = _mm_shuffle_epi8(lowTable, _mm_and_si128(v, nibble));
+            auto hi = _mm_shuffle_epi8(highTable, _mm_and_si128(_mm_srli_epi16(v, 4), nibble));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out.data() + i), _mm_max_epu8(lo, hi));
+        }
+#endif
+
+        for (; i < counters.size(); i++)
+            out[i] = lookup[counters[i]];
+    }
+
+    /// <summary>
+    /// Classify wide counters (lines) into buckets
+    /// </summary>
+    /// <param name="counters">Counters of the program</param>
+    /// <param name="out">Buckets, same size as counters</param>
+    inline void classify(std::span<const uint64_t> counters, std::span<uint8_t> out)
+    {
+        for (size_t i = 0; i < counters.size(); i++)
+            out[i] = lookup[std::min<uint64_t>(counters[i], 255)];
+    }
+}
+
+/// <summary>
+/// 64-bit identifier of a path, the hash of its classified map (hitBuckets::classify).
+/// Mixing of wyhash, applied only to the words that are not zero together with their position, as the maps are mostly empty.
+/// </summary>
+namespace pathId
+{
+    constexpr uint64_t SECRET[] = { 0xa0761d6478bd642full, 0xe7037ed1a0b428dbull, 0x8ebc6af09c88c6e3ull, 0x589965cc75374cc3ull };
+
+    /// <summary>
+    /// Multiply to 128 bits and fold the halves
+    /// </summary>
+    inline uint64_t mix(uint64_t a, uint64_t b)
+    {
+#if defined(__SIZEOF_INT128__)
+        __uint128_t r = static_cast<__uint128_t>(a) * b;
+        return static_cast<uint64_t>(r) ^ static_cast<uint64_t>(r >> 64);
+#else
+        uint64_t ha = a >> 32, hb = b >> 32, la = static_cast<uint32_t>(a), lb = static_cast<uint32_t>(b);
+        uint64_t rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+        uint64_t t = rl + (rm0 << 32);
+        uint64_t lo = t + (rm1 << 32);
+        uint64_t hi = rh + (rm0 >> 32) + (rm1 >> 32) + (t < rl) + (lo < t);
+        return lo ^ hi;
+#endif
+    }
+
+    inline uint64_t hash(std::span<const uint8_t> classified)
+    {
+        uint64_t h = SECRET[0] ^ classified.size();
+        auto word = [&h](uint64_t value, size_t position) {
+            h = mix(value ^ SECRET[1] ^ h, position ^ SECRET[2]);
+        };
+
+        size_t i = 0;
+#if defined(__AVX2__)
+        for (; i + sizeof(__m256i) <= classified.size(); i += sizeof(__m256i))
+        {
+            auto v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(classified.data() + i));
+            if (_mm256_testz_si256(v, v)) [[likely]]
+                continue;
+            for (size_t j = i; j < i + sizeof(__m256i); j += sizeof(uint64_t))
+            {
+                uint64_t value;
+                std::memcpy(&value, classified.data() + j, sizeof(value));
+                if (value != 0)
+                    word(value, j);
+            }
+        }
+#endif
+        for (; i + sizeof(uint64_t) <= classified.size(); i += sizeof(uint64_t))
+        {
+            uint64_t value;
+            std::memcpy(&value, classified.data() + i, sizeof(value));
+            if (value != 0)
+                word(value, i);
+        }
+        if (i < classified.size())
+        {
+            uint64_t value = 0;
+            std::memcpy(&value, classified.data() + i, classified.size() - i);
+            if (value != 0)
+                word(value, i);
+        }
+
+        return mix(h, SECRET[3]);
+    }
+}
+
+/// <summary>
+/// Buckets of all counters seen so far in the campaign. A bit is cleared once its bucket is seen, as in AFL.
+/// </summary>
+class VirginMap
+{
+public:
+    enum class Novelty : uint8_t
+    {
+        none,
+        hitCount, // Known counter reached a new bucket
+        counter, // Counter never hit before
+    };
+
+    /// <summary>
+    /// Merge buckets of an execution into the map
+    /// </summary>
+    /// <param name="classified">Buckets of an execution (hitBuckets::classify)</param>
+    /// <returns>Whether the execution reached anything new</returns>
+    Novelty update(std::span<const uint8_t> classified)
+    {
+        if (bits.size() < classified.size())
+            bits.resize(classified.size(), 0xFF);
+
+        Novelty res = Novelty::none;
+        size_t i = 0;
+
+#if defined(__AVX2__)
+        for (; i + sizeof(__m256i) <= classified.size(); i += sizeof(__m256i))
+        {
+            auto current = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(classified.data() + i));
+            auto virgin = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(bits.data() + i));
+            if (_mm256_testz_si256(current, virgin)) [[likely]]
+                continue;
+
+            res = std::max(res, slowPath(classified, i, sizeof(__m256i)));
+        }
+#elif defined(__SSE4_1__)
+        for (; i + sizeof(__m128i) <= classified.size(); i += sizeof(__m128i))
+        {
+            auto current = _mm_loadu_si128(reinterpret_cast<const __m128i*>(classified.data() + i));
+            auto virgin = _mm_loadu_si128(reinterpret_cast<const __m128i*>(bits.data() + i));
+            if (_mm_testz_si128(current, virgin)) [[likely]]
+                continue;
+
+            res = std::max(res, slowPath(classified, i, sizeof(__m128i)));
+        }
+#else
+        for (; i + sizeof(uint64_t) <= classified.size(); i += sizeof(uint64_t))
+        {
+            uint64_t current, virgin;
+            std::memcpy(&current, classified.data() + i, sizeof(current));
+            std::memcpy(&virgin, bits.data() + i, sizeof(virgin));
+            if ((current & virgin) == 0) [[likely]]
+                continue;
+
+            res = std::max(res, slowPath(classified, i, sizeof(uint64_t)));
+        }
+#endif
+
+        if (i < classified.size())
+            res = std::max(res, slowPath(classified, i, classified.size() - i));
+
+        return res;
+    }
+
+    /// <summary>
+    /// Number of counters that were ever hit
+    /// </summary>
+    size_t countHit() const
+    {
+        return hit;
+    }
+
+    /// <summary>
+    /// Most counters that can become known, 0 for all of them. A counter hit for the first time after that is ignored, neither new nor remembered,
+    /// so that a map that keeps growing (calling contexts) cannot flood the queue.
+    /// </summary>
+    size_t limit = 0;
+
+private:
+    /// <summary>
+    /// Tell what is new in a block that has something new, and merge it into the map
+    /// </summary>
+    Novelty slowPath(std::span<const uint8_t> classified, size_t from, size_t count)
+    {
+        Novelty res = Novelty::none;
+        for (size_t i = from; i < from + count; i++)
+        {
+            if ((classified[i] & bits[i]) == 0)
+                continue;
+            if (bits[i] == 0xFF)
+            {
+                if (limit != 0 && hit >= limit)
+                    continue;
+                hit++;
+                res = Novelty::counter;
+            }
+            else
+                res = std::max(res, Novelty::hitCount);
+            bits[i] &= ~classified[i];
+        }
+        return res;
+    }
+
+    std::vector<uint8_t> bits;
+    size_t hit = 0; // Counters that are not virgin any more
+};
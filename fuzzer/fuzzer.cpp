@@ -3,6 +3,99 @@
 
 fuzzer* myFuzzer;
 
+#ifdef FUZZ_IN_PROCESS
+// Built as an engine to be linked with a libFuzzer-style harness, instead of running a separate program
+extern "C" {
+    int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size);
+    __attribute__((weak)) int LLVMFuzzerInitialize(int* argc, char*** argv);
+
+    // Runtime of a harness instrumented by code-coverage --inprocess
+    __attribute__((weak)) void _GenerateLcov();
+    __attribute__((weak)) void _ResetCoverage();
+    __attribute__((weak)) void _MapCoverage();
+}
+
+/// <summary>
+/// Write the coverage of the last input and start counting from zero for the next one. Both do nothing for counters in shared memory, which the fuzzer reads and resets itself.
+/// </summary>
+void afterInput()
+{
+    if (_GenerateLcov)
+        _GenerateLcov();
+    if (_ResetCoverage)
+        _ResetCoverage();
+}
+#endif
+
+/// <summary>
+/// Read optional settings of the fuzzer from environment variables
+/// </summary>
+/// <param name="greybox">Whether the fuzzed program was instrumented by our coverage tool</param>
+FuzzerSettings loadSettings(bool greybox)
+{
+    FuzzerSettings settings;
+
+    auto flag = [](const char* name, bool defaultValue) {
+        const char* value = std::getenv(name);
+        if (value == nullptr || *value == '\0')
+            return defaultValue;
+        return std::atoi(value) != 0;
+        };
+
+    auto number = [](const char* name, size_t defaultValue) {
+        const char* value = std::getenv(name);
+        if (value == nullptr || *value == '\0')
+            return defaultValue;
+        return (size_t)std::stoull(value);
+        };
+
+    auto percent = [](const char* name, double defaultValue) {
+        const char* value = std::getenv(name);
+        if (value == nullptr || *value == '\0')
+            return defaultValue;
+        char* end;
+        double parsed = std::strtod(value, &end) / 100;
+        if (*end != '\0' || !(parsed >= 0 && parsed <= 1))
+            throw std::invalid_argument(std::string(name) + " must be a percentage between 0 and 100");
+        return parsed;
+        };
+
+    settings.forkServer = flag("FUZZ_FORKSERVER", greybox);
+    settings.persistentIterations = number("FUZZ_PERSISTENT_ITERATIONS", settings.persistentIterations);
+    settings.workers = number("FUZZ_WORKERS", settings.workers);
+    settings.spawn = flag("FUZZ_SPAWN", settings.spawn);
+    settings.memoryInput = flag("FUZZ_MEMORY_INPUT", settings.memoryInput);
+    settings.memoryStdin = flag("FUZZ_MEMORY_STDIN", settings.memoryStdin);
+    settings.timeout = std::chrono::milliseconds(number("FUZZ_TIMEOUT_MS", settings.timeout.count()));
+    settings.minTimeout = std::chrono::milliseconds(number("FUZZ_TIMEOUT_MIN_MS", settings.minTimeout.count()));
+    settings.adaptiveTimeout = flag("FUZZ_ADAPTIVE_TIMEOUT", settings.adaptiveTimeout);
+    settings.sharedCoverage = flag("FUZZ_SHARED_COVERAGE", settings.sharedCoverage);
+    settings.lcovExport = flag("FUZZ_EXPORT_LCOV", settings.lcovExport);
+    settings.pathCollisionCheck = flag("FUZZ_PATH_COLLISION_CHECK", settings.pathCollisionCheck);
+    settings.binaryCoverage = flag("FUZZ_BINARY_COVERAGE", settings.binaryCoverage);
+    settings.pruneProbes = flag("FUZZ_PRUNE_PROBES", settings.pruneProbes);
+    settings.cmpLog = flag("FUZZ_CMPLOG", settings.cmpLog);
+    settings.cmpLogMutants = number("FUZZ_CMPLOG_MUTANTS", settings.cmpLogMutants);
+    settings.mapLimit = number("FUZZ_MAP_LIMIT", settings.mapLimit);
+    if (const char* distances = std::getenv("FUZZ_DISTANCES"))
+        settings.distances = distances;
+    settings.directedExploitation = percent("FUZZ_DIRECTED_EXPLOITATION", settings.directedExploitation);
+    settings.sanitizerCoverage = flag("FUZZ_SANCOV", settings.sanitizerCoverage);
+
+#ifdef FUZZ_IN_PROCESS
+    settings.testOneInput = LLVMFuzzerTestOneInput;
+    settings.afterInput = afterInput;
+    settings.mapCoverage = _MapCoverage;
+    // Harness reads the environment of this process
+    if (settings.binaryCoverage)
+        setenv(fuzzer_greybox::COVERAGE_FORMAT_ENV, fuzzer_greybox::COVERAGE_FORMAT_BINARY, 0);
+#endif
+
+    std::cerr << "forkserver=" << settings.forkServer << ", persistent_iterations=" << settings.persistentIterations << ", workers=" << settings.workers << ", spawn=" << settings.spawn << ", memory_input=" << settings.memoryInput << ", memory_stdin=" << settings.memoryStdin << ", execution_timeout=" << settings.timeout.count() << ", adaptive_timeout=" << settings.adaptiveTimeout << ", shared_coverage=" << settings.sharedCoverage << std::endl;
+
+    return settings;
+}
+
 
 #ifndef _MSC_VER
 
@@ -79,6 +172,12 @@ int main(int argc, char* argv[])
         return 1;
     }
 #endif
+
+#ifdef FUZZ_IN_PROCESS
+    if (LLVMFuzzerInitialize)
+        LLVMFuzzerInitialize(&argc, &argv);
+#endif
+
     size_t currentArg = 1;
 
     std::filesystem::path FUZZED_PROG = argv[currentArg++];
@@ -102,7 +201,7 @@ int main(int argc, char* argv[])
 
             std::cerr << "Blackbox" << std::endl;
 
-            fuzzer_blackbox blackbox(std::move(FUZZED_PROG), std::move(RESULT_FUZZ), std::move(MINIMIZE), std::move(fuzzInputType), std::move(TIMEOUT), std::move(NB_KNOWN_BUGS));
+            fuzzer_blackbox blackbox(std::move(FUZZED_PROG), std::move(RESULT_FUZZ), std::move(MINIMIZE), std::move(fuzzInputType), std::move(TIMEOUT), std::move(NB_KNOWN_BUGS), loadSettings(false));
             myFuzzer = &blackbox;
             blackbox.run();
         }
@@ -112,7 +211,8 @@ int main(int argc, char* argv[])
             std::cerr << "Greybox" << std::endl;
 
             std::string_view POWER_SCHEDULE = argv[currentArg++];
-            fuzzer_greybox::POWER_SCHEDULE_T schedule = POWER_SCHEDULE == "simple" ? fuzzer_greybox::POWER_SCHEDULE_T::simple : fuzzer_greybox::POWER_SCHEDULE_T::boosted;
+            fuzzer_greybox::POWER_SCHEDULE_T schedule = POWER_SCHEDULE == "simple" ? fuzzer_greybox::POWER_SCHEDULE_T::simple
+                : POWER_SCHEDULE == "directed" ? fuzzer_greybox::POWER_SCHEDULE_T::directed : fuzzer_greybox::POWER_SCHEDULE_T::boosted;
             std::cerr << "schedule=" << POWER_SCHEDULE << "=" << (int)schedule << ", ";
 
             std::filesystem::path COVERAGE_FILE = argv[currentArg++];
@@ -127,7 +227,7 @@ int main(int argc, char* argv[])
             if (argc <= currentArg)
             {
                 std::cerr << "Seed directory not provided" << std::endl;
-                fuzzer_greybox greybox(std::move(FUZZED_PROG), std::move(RESULT_FUZZ), std::move(MINIMIZE), std::move(fuzzInputType), std::move(TIMEOUT), std::move(NB_KNOWN_BUGS), schedule, std::move(COVERAGE_FILE), GREYNESS, CONCATENATEDNESS);
+                fuzzer_greybox greybox(std::move(FUZZED_PROG), std::move(RESULT_FUZZ), std::move(MINIMIZE), std::move(fuzzInputType), std::move(TIMEOUT), std::move(NB_KNOWN_BUGS), schedule, std::move(COVERAGE_FILE), GREYNESS, CONCATENATEDNESS, loadSettings(true));
                 myFuzzer = &greybox;
                 greybox.run();
             }
@@ -135,7 +235,7 @@ int main(int argc, char* argv[])
             {
                 std::filesystem::path INPUT_SEEDS = argv[currentArg++];
                 std::cerr << "Seed directory provided: " << INPUT_SEEDS << std::endl;
-                fuzzer_greybox greybox(std::move(FUZZED_PROG), std::move(RESULT_FUZZ), std::move(MINIMIZE), std::move(fuzzInputType), std::move(TIMEOUT), std::move(NB_KNOWN_BUGS), schedule, std::move(COVERAGE_FILE), GREYNESS, CONCATENATEDNESS, std::move(INPUT_SEEDS));
+                fuzzer_greybox greybox(std::move(FUZZED_PROG), std::move(RESULT_FUZZ), std::move(MINIMIZE), std::move(fuzzInputType), std::move(TIMEOUT), std::move(NB_KNOWN_BUGS), schedule, std::move(COVERAGE_FILE), GREYNESS, CONCATENATEDNESS, std::move(INPUT_SEEDS), loadSettings(true));
                 myFuzzer = &greybox;
                 greybox.run();
             }
@@ -16,10 +16,38 @@
 #include <regex>
 #include <csignal>
 #include "median.h"
+#include "coverage-map.h"
+#include "lcov.h"
+#include "cmplog.h"
 #include <utility>
 #include <set>
+#include <map>
+#include <deque>
+#include <mutex>
 #include <charconv>
 #include <iterator>
+#include <span>
+
+#ifndef _MSC_VER
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <sys/syscall.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <sys/shm.h>
+#include <spawn.h>
+#include <setjmp.h>
+#include <time.h>
+
+// Hooks of the sanitizer runtime, null when the program is not built with AddressSanitizer
+extern "C" {
+    __attribute__((weak)) void __sanitizer_set_death_callback(void (*callback)(void));
+    __attribute__((weak)) void __asan_set_error_report_callback(void (*callback)(const char*));
+}
+#endif
 
 // Undefine to capture stdout from running progarm
 //#define CAPTURE_STDOUT
@@ -30,8 +58,8 @@
 #define UNREACHABLE __builtin_unreachable()
 #endif
 
-//thread_local std::random_device rd;  // Seed for the random number engine
-/*thread_local */std::mt19937 gen/*(rd())*/; // Mersenne Twister engine seeded with `rd`
+static std::atomic<std::mt19937::result_type> genSeed = std::mt19937::default_seed;
+thread_local std::mt19937 gen(genSeed++); // Mersenne Twister engine, every thread gets its own sequence
 
 
 /// <summary>
@@ -400,6 +428,130 @@ namespace mutators {
 }
 
 static size_t currentAsanOffset = 0; // Workaround for coverage tool skewing the line numbers
+
+/// <summary>
+/// Optional features of the fuzzer, that are not part of the command line interface
+/// </summary>
+struct FuzzerSettings
+{
+    /// <summary>
+    /// Try to talk to a fork server injected by the coverage tool (code-coverage --forkserver). Falls back to a new process per execution if the program does not have one.
+    /// </summary>
+    bool forkServer = false;
+
+    /// <summary>
+    /// How many inputs a persistent program (code-coverage --persistent) runs in one process, before it exits and the fork server forks a fresh one.
+    /// Limits the damage of state leaking between the iterations.
+    /// </summary>
+    size_t persistentIterations = 1000;
+
+    /// <summary>
+    /// libFuzzer-style entry point (LLVMFuzzerTestOneInput) linked into the fuzzer. When set, inputs are passed to it directly in this process and no program is started at all.
+    /// </summary>
+    int (*testOneInput)(const uint8_t* data, size_t size) = nullptr;
+
+    /// <summary>
+    /// Called after every in-process input, e.g. to write the coverage of an instrumented harness and reset its counters
+    /// </summary>
+    void (*afterInput)() = nullptr;
+
+    /// <summary>
+    /// Runtime of an in-process harness instrumented by `code-coverage --inprocess` that moves its counters into the shared memory named by the environment of this process (_MapCoverage).
+    /// The fuzzer then reads them directly, instead of a coverage file written after every input.
+    /// </summary>
+    void (*mapCoverage)() = nullptr;
+
+    /// <summary>
+    /// Number of fuzzing threads, each running its own copy of the program. Zero to use all cores. In-process harnesses always use one.
+    /// </summary>
+    size_t workers = 1;
+
+    /// <summary>
+    /// Start new processes with posix_spawn (SpawnExecutor) instead of boost::process, when there is no fork server
+    /// </summary>
+    bool spawn = true;
+
+    /// <summary>
+    /// Keep the input file in memory (MemoryFileInput) instead of writing it to the current directory, when the input is a file
+    /// </summary>
+    bool memoryInput = true;
+
+    /// <summary>
+    /// Give the program its standard input in a file in memory instead of a pipe, when it is started with posix_spawn (the fork server always does it)
+    /// </summary>
+    bool memoryStdin = true;
+
+    /// <summary>
+    /// Longest time one execution may take, before it is reported as a hang
+    /// </summary>
+    std::chrono::milliseconds timeout = std::chrono::seconds(5);
+
+    /// <summary>
+    /// Derive a shorter timeout from the execution times of the seeds (their 99th percentile times timeoutMultiplier, at least minTimeout).
+    /// An execution exceeding it is repeated with the full timeout before it is reported as a hang.
+    /// </summary>
+    bool adaptiveTimeout = true;
+    double timeoutMultiplier = 5;
+    std::chrono::milliseconds minTimeout = std::chrono::milliseconds(50);
+
+    /// <summary>
+    /// Read the coverage counters of an instrumented program from shared memory, instead of the LCOV file it writes after every execution
+    /// </summary>
+    bool sharedCoverage = true;
+
+    /// <summary>
+    /// Most counters the shared memory of one worker can hold
+    /// </summary>
+    size_t coverageMapSize = 1 << 20;
+
+    /// <summary>
+    /// At the end, write the coverage of the whole campaign as LCOV (coverage.lcov in the results), when it was read from shared memory
+    /// </summary>
+    bool lcovExport = true;
+
+    /// <summary>
+    /// Keep the classified map of every path and compare it with the maps of later executions with the same identifier, counting hash collisions (costs the memory the identifiers save)
+    /// </summary>
+    bool pathCollisionCheck = false;
+
+    /// <summary>
+    /// Ask the program for a binary dump of its counters instead of LCOV, when it writes them into the coverage file (not mapping the shared memory, in-process harness)
+    /// </summary>
+    bool binaryCoverage = true;
+
+    /// <summary>
+    /// Once a line (edge) was hit, start the next executions with its 8-bit counter at 255, where the probe stops counting (with `code-coverage --prune` it only compares),
+    /// and do not look at it any more. Only never hit lines (edges) then make an input interesting, their hit counts are not told apart.
+    /// All workers share the known ones. Ignored while lcovExport writes the coverage of the campaign, which needs every hit.
+    /// </summary>
+    bool pruneProbes = false;
+
+    /// <summary>
+    /// Run every seed once with the comparisons of the program logged (`code-coverage --cmplog`), then try it with an operand of a comparison found in it replaced by the other one (input-to-state replacement).
+    /// At most cmpLogMutants such mutants per seed.
+    /// </summary>
+    bool cmpLog = true;
+    size_t cmpLogMutants = 256;
+
+    /// <summary>
+    /// Most lines (edges) that can become known, 0 for no limit. After that only new hit counts of the known ones make an input interesting.
+    /// Caps the queue of a program whose edges grow with the calling contexts (`code-coverage --context`).
+    /// </summary>
+    size_t mapLimit = 0;
+
+    /// <summary>
+    /// Distances of the line counters from the target lines, written by `code-coverage --target` (distances.txt), for the directed power schedule.
+    /// Its exploration gives way to exploiting the seeds closest to the targets over directedExploitation of the campaign (simulated annealing).
+    /// </summary>
+    std::filesystem::path distances;
+    double directedExploitation = 0.5;
+
+    /// <summary>
+    /// Program was built by clang with -fsanitize-coverage=trace-pc-guard and linked with sancov-runtime.c instead of instrumented by the coverage tool.
+    /// Its guards are the line counters, its source lines are not shifted, and it has neither comparison logging nor lines for the LCOV export.
+    /// </summary>
+    bool sanitizerCoverage = false;
+};
 static const std::regex errorTypeRegex("ERROR: AddressSanitizer: (.*) on address");
 static const std::regex locationRegex("(main.c):(\\d+)");
 
@@ -410,6 +562,8 @@ struct fuzzer {
     std::atomic<size_t> nb_before_min = 0;
     std::atomic<size_t> nb_failed_runs = 0;
     std::atomic<size_t> nb_hanged_runs = 0;
+    std::atomic<size_t> nb_suspected_hangs = 0;
+    std::atomic<std::chrono::milliseconds> calibratedTimeout = std::chrono::milliseconds::zero();
 
     StatisticsMemory<double> statisticsExecution;
     StatisticsMemory<double> statisticsMinimization;
@@ -435,6 +589,21 @@ struct fuzzer {
         bool operator==(const ExecutionResult&) const = default;
     };
 
+    struct ExecutionInput;
+
+    /// <summary>
+    /// Way of running the program, other than starting a new process for every execution
+    /// </summary>
+    struct Executor
+    {
+        /// <summary>
+        /// Run the program once on the current input
+        /// </summary>
+        virtual ExecutionResult run(const ExecutionInput& executionInput) = 0;
+
+        virtual ~Executor() = default;
+    };
+
     /// <summary>
     /// Base class for execution inputs
     /// </summary>
@@ -448,7 +617,35 @@ struct fuzzer {
         virtual void setInput(const std::string_view& input) = 0;
 
         const std::filesystem::path executablePath;
-        const std::chrono::milliseconds timeout;
+
+        /// <summary>
+        /// How long one execution may take
+        /// </summary>
+        std::chrono::milliseconds timeout;
+
+        /// <summary>
+        /// Timeout before calibration, used to confirm a suspected hang. Zero if the timeout was not calibrated.
+        /// </summary>
+        std::chrono::milliseconds fullTimeout = std::chrono::milliseconds::zero();
+
+        /// <summary>
+        /// Shorten the timeout to what the program usually needs, keeping the original one for confirming hangs
+        /// </summary>
+        void calibrateTimeout(std::chrono::milliseconds calibrated)
+        {
+            fullTimeout = std::max(fullTimeout, timeout);
+            timeout = std::min(calibrated, fullTimeout);
+        }
+
+        /// <summary>
+        /// Environment variables set for the program, in addition to the ones of the fuzzer
+        /// </summary>
+        std::map<std::string, std::string> environment;
+
+        /// <summary>
+        /// How to run the program. Nullptr if a new process should be started for every execution.
+        /// </summary>
+        std::unique_ptr<Executor> executor;
 
         virtual ~ExecutionInput() = default;
     };
@@ -480,6 +677,61 @@ struct fuzzer {
         const std::string path;
     };
 
+#ifndef _MSC_VER
+    /// <summary>
+    /// Execution input in form of a file content, kept in memory (memfd, or a file on /dev/shm if the kernel does not have it).
+    /// The descriptor stays open, so every input is only written over the previous one, without opening or truncating a file on a disk.
+    /// The program gets the path to the descriptor of the fuzzer in /proc, which does not have to be inherited.
+    /// </summary>
+    struct MemoryFileInput final : public ExecutionInput
+    {
+        /// <param name="name">Name of the file, for debugging (and for the file on /dev/shm)</param>
+        MemoryFileInput(std::filesystem::path executablePath, std::chrono::milliseconds timeout, const std::string& name) : ExecutionInput(std::move(executablePath), std::move(timeout))
+        {
+            fd = memfd_create(name.c_str(), MFD_CLOEXEC);
+            if (fd >= 0)
+                path = "/proc/" + std::to_string(getpid()) + "/fd/" + std::to_string(fd);
+            else
+            {
+                shmPath = "/dev/shm/" + std::filesystem::path(name).filename().string() + '.' + std::to_string(getpid());
+                fd = open(shmPath.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+                if (fd < 0) [[unlikely]]
+                    throw std::runtime_error("Cannot create input file in memory");
+                path = shmPath;
+            }
+        }
+
+        MemoryFileInput(const MemoryFileInput&) = delete;
+        MemoryFileInput& operator=(const MemoryFileInput&) = delete;
+
+        virtual std::vector<std::string> getArguments() const final
+        {
+            return { path };
+        }
+        virtual std::string_view getCin() const final
+        {
+            return "";
+        }
+
+        virtual void setInput(const std::string_view& input) final
+        {
+            if (pwrite(fd, input.data(), input.size(), 0) != (ssize_t)input.size() || ftruncate(fd, input.size()) != 0) [[unlikely]]
+                throw std::runtime_error("Cannot write input file in memory");
+        }
+
+        virtual ~MemoryFileInput()
+        {
+            close(fd);
+            if (!shmPath.empty())
+                unlink(shmPath.c_str());
+        }
+    private:
+        int fd = -1;
+        std::string path;
+        std::string shmPath; // Empty when in memfd
+    };
+#endif
+
     /// <summary>
     /// Execution input in form of a standard input
     /// </summary>
@@ -511,1259 +763,2947 @@ struct fuzzer {
         std::string_view cinInput;
     };
 
+#ifndef _MSC_VER
     /// <summary>
-    /// Execute program in the system with a timeout and return its results
+    /// Converts status from waitpid to a return code, the same way boost::process does it
     /// </summary>
-    /// <param name="executionInput">What to execute and how</param>
-    /// <returns>Result of the executions</returns>
-    ExecutionResult execute_with_timeout(const ExecutionInput& executionInput) {
-        using namespace boost::process;
+    static int statusToReturnCode(int status)
+    {
+        if (WIFEXITED(status))
+            return WEXITSTATUS(status);
+        else if (WIFSIGNALED(status))
+            return WTERMSIG(status);
+        else
+            return status;
+    }
 
-#ifdef CAPTURE_STDOUT
-        ipstream stdout_stream;  // To capture standard output
-#endif
-        ipstream stderr_stream;  // To capture standard error
-        opstream stdin_stream;   // To provide input
+    /// <summary>
+    /// Read everything that is currently available in a non-blocking descriptor
+    /// </summary>
+    /// <returns>False if the other end was closed</returns>
+    static bool drainNonBlocking(int fd, std::string& output)
+    {
+        char buffer[4096];
+        while (true)
+        {
+            auto len = read(fd, buffer, sizeof(buffer));
+            if (len > 0)
+                output.append(buffer, len);
+            else if (len == 0)
+                return false;
+            else
+                return errno == EAGAIN || errno == EINTR;
+        }
+    }
 
-        auto start = std::chrono::high_resolution_clock::now();
-        child process(
-            executionInput.executablePath.c_str(),
-            executionInput.getArguments(),
-#ifdef CAPTURE_STDOUT
-            std_out > stdout_stream,
-#else
-            std_out > boost::process::null,
-#endif
-            std_err > stderr_stream,
-            std_in < stdin_stream
-        );
+    /// <summary>
+    /// Waits for a started child on one epoll set: feeds its standard input, collects its outputs and wakes up as soon as it exits (pidfd) or the time runs out (timerfd).
+    /// Doing everything at once means that the child cannot get stuck on a full pipe (e.g. a long sanitizer report) and no time is lost by polling.
+    /// Descriptors of the set are created once and reused for all children.
+    /// </summary>
+    struct ProcessEvents
+    {
+        ProcessEvents() : epollFd(epoll_create1(EPOLL_CLOEXEC)), timerFd(timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK))
+        {
+            if (epollFd < 0 || timerFd < 0) [[unlikely]]
+                throw std::runtime_error("Cannot create events for waiting on the program");
+            add(timerFd, EPOLLIN, TIMER);
+        }
 
-        // Feed the process's standard input.
-        stdin_stream << executionInput.getCin();
-        stdin_stream.flush();
-        stdin_stream.close();
-        stdin_stream.pipe().close();  // Close stdin to signal end of input
+        ProcessEvents(const ProcessEvents&) = delete;
+        ProcessEvents& operator=(const ProcessEvents&) = delete;
 
-        // Read all content from ipstream after the process finishes
-        auto read_stream = [](ipstream& stream) {
-            std::ostringstream oss;
-            oss << stream.rdbuf(); // Efficiently reads the entire stream buffer
-            return oss.str();
-        };
-        
-        // Wait for process completion with a timeout.
-        bool finished_in_time = process.wait_for(executionInput.timeout);
-        if (!finished_in_time) {
-            process.terminate();  // Kill the process if it times out
-            auto duration = std::chrono::duration_cast<std::chrono::duration<double, std::milli>>(std::chrono::high_resolution_clock::now() - start);
-            statisticsExecution.addNumber(duration.count());
-            nb_hanged_runs.fetch_add(1, std::memory_order_relaxed);
-            return {
-                -1,
-#ifdef CAPTURE_STDOUT
-                read_stream(stdout_stream),
-#endif
-                read_stream(stderr_stream),
-                true,
-                duration 
-           };  // Indicate a timeout occurred
+        /// <summary>
+        /// Wait until the child exits, at most for the given time
+        /// </summary>
+        /// <param name="stdinFd">Write end of the standard input of the child, closed once the input is written. -1 if there is nothing to write</param>
+        /// <param name="stderrFd">Non-blocking read end of standard error</param>
+        /// <param name="stdoutFd">Non-blocking read end of standard output, -1 if it is not captured</param>
+        /// <param name="status">Wait status of the exited child</param>
+        /// <returns>False on timeout, the child is then still running</returns>
+        bool wait(pid_t pid, std::chrono::milliseconds timeout, int stdinFd, std::string_view input, int stderrFd, std::string& errOutput, int stdoutFd, std::string& outOutput, int& status)
+        {
+            int pidFd = (int)syscall(SYS_pidfd_open, pid, 0);
+            if (pidFd >= 0)
+                add(pidFd, EPOLLIN, CHILD);
+            // Kernel without pidfd, the timer ticks regularly to check the child
+            auto deadline = std::chrono::steady_clock::now() + timeout;
+            arm(timeout, pidFd >= 0 ? std::chrono::milliseconds::zero() : std::chrono::milliseconds(1));
+
+            size_t written = 0;
+            if (input.empty())
+            {
+                if (stdinFd >= 0)
+                    close(stdinFd);
+                stdinFd = -1;
+            }
+            else
+                add(stdinFd, EPOLLOUT, STDIN);
+            add(stderrFd, EPOLLIN, STDERR);
+            if (stdoutFd >= 0)
+                add(stdoutFd, EPOLLIN, STDOUT);
+
+            bool exited = false, timedOut = false;
+            epoll_event events[5];
+            while (!exited && !timedOut)
+            {
+                int count = epoll_wait(epollFd, events, 5, -1);
+                if (count < 0 && errno != EINTR) [[unlikely]]
+                    throw std::runtime_error("Cannot wait for the program");
+
+                for (int i = 0; i < count; i++)
+                {
+                    switch (events[i].data.u32)
+                    {
+                    case CHILD:
+                        exited = waitpid(pid, &status, WNOHANG) == pid;
+                        break;
+                    case TIMER:
+                    {
+                        uint64_t expirations;
+                        [[maybe_unused]] auto len = read(timerFd, &expirations, sizeof(expirations));
+                        exited = waitpid(pid, &status, WNOHANG) == pid;
+                        timedOut = !exited && (pidFd >= 0 || std::chrono::steady_clock::now() >= deadline);
+                        break;
+                    }
+                    case STDIN:
+                    {
+                        auto len = write(stdinFd, input.data() + written, input.size() - written);
+                        if (len > 0)
+                            written += len;
+                        if ((len < 0 && errno != EAGAIN && errno != EINTR) || written == input.size())
+                        {
+                            // Everything written (or the child closed its input), signal the end
+                            remove(stdinFd);
+                            close(stdinFd);
+                            stdinFd = -1;
+                        }
+                        break;
+                    }
+                    case STDERR:
+                        if (!drainNonBlocking(stderrFd, errOutput))
+                            remove(stderrFd); // Closed, would be reported as readable forever
+                        break;
+                    case STDOUT:
+                        if (!drainNonBlocking(stdoutFd, outOutput))
+                            remove(stdoutFd);
+                        break;
+                    }
+                }
+            }
+
+            disarm();
+            if (pidFd >= 0)
+            {
+                remove(pidFd); // Closing is not enough while a child of another worker still holds a copy
+                close(pidFd);
+            }
+            if (stdinFd >= 0)
+            {
+                remove(stdinFd);
+                close(stdinFd);
+            }
+            remove(stderrFd);
+            if (stdoutFd >= 0)
+                remove(stdoutFd);
+            return exited;
         }
 
-        auto duration = std::chrono::duration_cast<std::chrono::duration<double, std::milli>>(std::chrono::high_resolution_clock::now() - start);
-        statisticsExecution.addNumber(duration.count());
-        if (process.exit_code() != 0)
-            nb_failed_runs.fetch_add(1, std::memory_order_relaxed);
+        ~ProcessEvents()
+        {
+            close(epollFd);
+            close(timerFd);
+        }
 
-        // Retrieve the outputs and return code
-        return { 
-            std::move(process.exit_code()),
-#ifdef CAPTURE_STDOUT
-            read_stream(stdout_stream),
-#endif
-            read_stream(stderr_stream),
-            false,
-            duration
-        };
-    }
+    private:
+        enum Source : uint32_t { CHILD, TIMER, STDIN, STDERR, STDOUT };
+
+        int epollFd;
+        int timerFd;
+
+        void add(int fd, uint32_t events, Source source)
+        {
+            epoll_event event{};
+            event.events = events;
+            event.data.u32 = source;
+            epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event);
+        }
+
+        void remove(int fd)
+        {
+            epoll_ctl(epollFd, EPOLL_CTL_DEL, fd, nullptr); // Fails harmlessly if it was already removed
+        }
+
+        static timespec toTimespec(std::chrono::milliseconds time)
+        {
+            return { (time_t)(time.count() / 1000), (long)(time.count() % 1000) * 1000000 };
+        }
+
+        /// <summary>
+        /// Set the timer to expire after given time, or every interval if it is not zero
+        /// </summary>
+        void arm(std::chrono::milliseconds after, std::chrono::milliseconds interval)
+        {
+            itimerspec spec{ toTimespec(interval), toTimespec(interval.count() > 0 ? std::min(after, interval) : after) };
+            if (spec.it_value.tv_sec == 0 && spec.it_value.tv_nsec <= 0) [[unlikely]]
+                spec.it_value = { 0, 1 }; // Zero would disarm it
+            timerfd_settime(timerFd, 0, &spec, nullptr);
+        }
+
+        void disarm()
+        {
+            itimerspec spec{};
+            timerfd_settime(timerFd, 0, &spec, nullptr);
+            uint64_t expirations;
+            [[maybe_unused]] auto len = read(timerFd, &expirations, sizeof(expirations)); // Forget an expiration that was not handled
+        }
+    };
 
     /// <summary>
-    /// Base class for various errors that the oracle catches
+    /// Runs the program through the fork server injected by the coverage tool (code-coverage --forkserver).
+    /// The program is executed only once, stops at the start of main and forks itself for every execution, which saves the execve, dynamic linking and sanitizer start-up.
     /// </summary>
-    struct DetectedError
+    struct ForkServerExecutor final : public Executor
     {
+        static constexpr int FORKSRV_FD = 198; // Must be the same as in the coverage tool
+
         /// <summary>
-        /// Checks whether this error was present in the output
+        /// Bits of the hello message, must be the same as in the coverage tool
         /// </summary>
-        virtual bool isErrorEncountered(const ExecutionResult& executionResult) const = 0;
+        enum FORKSRV_OPT : uint32_t
+        {
+            FORKSRV_OPT_DEFERRED = 1, // Fork point was deferred, followed by 4 bytes of microseconds spent in main before it
+            FORKSRV_OPT_PERSISTENT = 2, // Child runs main in a loop and stops itself after every input, instead of exiting
+        };
 
         /// <summary>
-        /// Name of the oracle, as it should be in JSON export
+        /// Environment variable telling a persistent program how many inputs to run before exiting, must be the same as in the coverage tool
         /// </summary>
-        virtual const char* errorName() const = 0;
+        static constexpr std::string_view PERSISTENT_ITERATIONS_ENV = "FUZZ_PERSISTENT_ITERATIONS";
 
         /// <summary>
-        /// Folder that the oracle should export to
+        /// How many times the server is started again for one input, before giving up
         /// </summary>
-        virtual const char* folder() const = 0;
+        static constexpr size_t MAX_RESTARTS = 3;
 
         /// <summary>
-        /// Export info about this bug to a stream
+        /// Start the fork server for given program
         /// </summary>
-        virtual std::ostream& bugInfo(std::ostream& os) const = 0;
+        /// <returns>False if the program did not announce a fork server (e.g. is not instrumented)</returns>
+        bool start(const ExecutionInput& executionInput)
+        {
+            stop();
+            signal(SIGPIPE, SIG_IGN); // Writing to a dead server must not kill the fuzzer
 
-        /// <summary>
-        /// Compares if two errors are the same for deduplication purposes
-        /// </summary>
-        virtual bool operator == (const DetectedError& Other) const = 0;
+            // Standard input is a file in memory, so that it can be rewritten for every child without a new pipe
+            stdinFd = memfd_create("fuzz_stdin", 0);
+            int ctlPipe[2], stPipe[2], errPipe[2];
+            if (stdinFd < 0 || pipe(ctlPipe) != 0 || pipe(stPipe) != 0 || pipe(errPipe) != 0 || fcntl(errPipe[0], F_SETFL, O_NONBLOCK) != 0) [[unlikely]]
+                throw std::runtime_error("Cannot create pipes for the fork server");
+#ifdef CAPTURE_STDOUT
+            int outPipe[2];
+            if (pipe(outPipe) != 0 || fcntl(outPipe[0], F_SETFL, O_NONBLOCK) != 0) [[unlikely]]
+                throw std::runtime_error("Cannot create pipes for the fork server");
+#endif
 
-        virtual ~DetectedError() = default;
-    };
+            // Prepare everything before forking, the child may only call async-signal-safe functions
+            auto arguments = executionInput.getArguments();
+            std::string path = executionInput.executablePath.string();
+            std::vector<char*> argv;
+            argv.push_back(path.data());
+            for (auto& i : arguments)
+                argv.push_back(i.data());
+            argv.push_back(nullptr);
+
+            std::vector<std::string> environment;
+            for (char** i = environ; *i != nullptr; ++i)
+            {
+                std::string_view variable(*i);
+                if (!executionInput.environment.contains(std::string(variable.substr(0, variable.find('=')))))
+                    environment.emplace_back(variable);
+            }
+            for (const auto& [name, value] : executionInput.environment)
+                environment.push_back(name + '=' + value);
+            std::vector<char*> envp;
+            for (auto& i : environment)
+                envp.push_back(i.data());
+            envp.push_back(nullptr);
+
+            auto startTime = std::chrono::high_resolution_clock::now();
+            serverPid = fork();
+            if (serverPid < 0) [[unlikely]]
+                throw std::runtime_error("Cannot fork the fork server");
+
+            if (serverPid == 0)
+            {
+                dup2(stdinFd, STDIN_FILENO);
+#ifdef CAPTURE_STDOUT
+                dup2(outPipe[1], STDOUT_FILENO);
+#else
+                int devNull = open("/dev/null", O_WRONLY);
+                dup2(devNull, STDOUT_FILENO);
+#endif
+                dup2(errPipe[1], STDERR_FILENO);
+                dup2(ctlPipe[0], FORKSRV_FD);
+                dup2(stPipe[1], FORKSRV_FD + 1);
+                // Everything else is closed on exec
+                for (int fd = STDERR_FILENO + 1; fd < FORKSRV_FD; fd++)
+                    fcntl(fd, F_SETFD, FD_CLOEXEC);
+                execve(argv[0], argv.data(), envp.data());
+                _exit(127);
+            }
 
-    /// <summary>
-    /// Oracle that catches a non-zero return code
-    /// </summary>
-    struct ReturnCodeError : public DetectedError
-    {
-        ReturnCodeError(int returnCode) : returnCode(std::move(returnCode)) {}
+            close(ctlPipe[0]);
+            close(stPipe[1]);
+            close(errPipe[1]);
+            ctlFd = ctlPipe[1];
+            stFd = stPipe[0];
+            stderrFd = errPipe[0];
+#ifdef CAPTURE_STDOUT
+            close(outPipe[1]);
+            stdoutFd = outPipe[0];
+#endif
 
-        bool operator==(const ReturnCodeError& other) const
-        {
-            return returnCode == other.returnCode;
-        }
-        virtual bool operator == (const DetectedError& Other) const override {
-            if (typeid(Other) == typeid(*this))
+            // Wait for the hello message, with the timeout before calibration since starting takes longer than one execution
+            int hello;
+            std::string ignored;
+            auto deadline = std::chrono::high_resolution_clock::now() + std::max(executionInput.timeout, executionInput.fullTimeout);
+            if (!readStatus(&hello, deadline, ignored, ignored))
             {
-                const ReturnCodeError& other = static_cast<const ReturnCodeError&>(Other);
+                stop();
+                return false;
+            }
+            startupTime = std::chrono::duration_cast<std::chrono::duration<double, std::milli>>(std::chrono::high_resolution_clock::now() - startTime);
 
-                return *this == other;
+            persistent = hello & FORKSRV_OPT_PERSISTENT;
+            deferredInitTime = {};
+            if (hello & FORKSRV_OPT_DEFERRED)
+            {
+                int microseconds;
+                if (!readStatus(&microseconds, deadline, ignored, ignored)) [[unlikely]]
+                {
+                    stop();
+                    return false;
+                }
+                deferredInitTime = std::chrono::microseconds(microseconds);
             }
-            else
-                return false;
+            return true;
         }
 
-        ReturnCodeError(ReturnCodeError&&) = default;
-        ReturnCodeError(const ReturnCodeError&) = default;
-
-        static std::optional<ReturnCodeError> tryDetectError(const ExecutionResult& executionResult)
+        virtual ExecutionResult run(const ExecutionInput& executionInput) override
         {
-            std::optional<ReturnCodeError> res;
+            ExecutionResult result{};
+            std::chrono::high_resolution_clock::time_point runStart, deadline;
+            int pid, status;
+            for (size_t restarts = 0; ; restarts++)
+            {
+                // Rewrite standard input for the next child, it shares the file offset with us
+                auto cin = executionInput.getCin();
+                if (ftruncate(stdinFd, 0) != 0 || pwrite(stdinFd, cin.data(), cin.size(), 0) != (ssize_t)cin.size() || lseek(stdinFd, 0, SEEK_SET) != 0) [[unlikely]]
+                    throw std::runtime_error("Cannot write input for the fork server");
+
+                result = {};
+                runStart = std::chrono::high_resolution_clock::now();
+                deadline = runStart + executionInput.timeout;
+
+                int msg = 0;
+                if (write(ctlFd, &msg, 4) == 4 && readStatus(&pid, deadline, result.stderr_output, stdoutOf(result))) [[likely]]
+                    break;
+
+                // Server died (it could have crashed before the fork point), start it again
+                if (restarts == MAX_RESTARTS) [[unlikely]]
+                    throw std::runtime_error("Fork server keeps dying, it was restarted " + std::to_string(MAX_RESTARTS) + " times for one input");
+                std::cerr << "Fork server is not responding, restarting it" << std::endl;
+                if (!start(executionInput)) [[unlikely]]
+                    throw std::runtime_error("Fork server could not be restarted");
+            }
 
-            if (executionResult.return_code != EXIT_SUCCESS)
-                res.emplace(executionResult.return_code);
+            result.timed_out = !readStatus(&status, deadline, result.stderr_output, stdoutOf(result));
+            if (result.timed_out)
+            {
+                stoppedChild = -1;
+                kill(pid, SIGKILL);
+                if (!readStatus(&status, std::chrono::high_resolution_clock::time_point::max(), result.stderr_output, stdoutOf(result))) [[unlikely]]
+                    throw std::runtime_error("Fork server did not report killed child");
+                result.return_code = -1;
+            }
+            else if (WIFSTOPPED(status))
+            {
+                // Persistent child finished the input and waits for the next one
+                stoppedChild = pid;
+                result.return_code = 0;
+            }
+            else
+            {
+                stoppedChild = -1;
+                result.return_code = statusToReturnCode(status);
+            }
 
-            return res;
+            result.execution_time = std::chrono::duration_cast<std::chrono::duration<double, std::milli>>(std::chrono::high_resolution_clock::now() - runStart);
+
+            // The child is dead, so everything it wrote is already in the pipes
+            drainNonBlocking(stderrFd, result.stderr_output);
+#ifdef CAPTURE_STDOUT
+            drainNonBlocking(stdoutFd, result.stdout_output);
+#endif
+            return result;
         }
 
-        virtual bool isErrorEncountered(const ExecutionResult& executionResult) const override
-        {
-            auto tmp = tryDetectError(executionResult);
-            if (tmp.has_value() && ((*tmp) == (*this)))
-                return true;
+        /// <summary>
+        /// Time from starting the program to it being ready to fork, which is saved on every execution
+        /// </summary>
+        std::chrono::duration<double, std::milli> startupTime{};
 
-            return false;
-        }
+        /// <summary>
+        /// Part of the startup time spent in main before the deferred fork point (__fuzz_init_done), zero if the fork point was not deferred
+        /// </summary>
+        std::chrono::duration<double, std::milli> deferredInitTime{};
 
-        virtual const char* errorName() const override
+        /// <summary>
+        /// Program runs many inputs in one process (code-coverage --persistent)
+        /// </summary>
+        bool persistent = false;
+
+        virtual ~ForkServerExecutor()
         {
-            return "return_code";
+            stop();
         }
 
-        virtual const char* folder() const override
+    private:
+        pid_t serverPid = -1;
+        pid_t stoppedChild = -1; // Persistent child waiting for the next input
+        int ctlFd = -1;
+        int stFd = -1;
+        int stdinFd = -1;
+        int stderrFd = -1;
+#ifdef CAPTURE_STDOUT
+        int stdoutFd = -1;
+        static std::string& stdoutOf(ExecutionResult& result) { return result.stdout_output; }
+#else
+        std::string discardedStdout;
+        std::string& stdoutOf(ExecutionResult&) { discardedStdout.clear(); return discardedStdout; }
+#endif
+
+        /// <summary>
+        /// Read one 4-byte message from the server, while collecting the output of the child so that it cannot get stuck on a full pipe
+        /// </summary>
+        /// <returns>False on timeout or if the server is gone</returns>
+        bool readStatus(int* value, std::chrono::high_resolution_clock::time_point deadline, std::string& errOutput, std::string& outOutput)
         {
-            return "crashes";
+            size_t received = 0;
+            pollfd fds[3] = { { stFd, POLLIN, 0 }, { stderrFd, POLLIN, 0 }, { -1, POLLIN, 0 } };
+#ifdef CAPTURE_STDOUT
+            fds[2].fd = stdoutFd;
+#endif
+            while (received < 4)
+            {
+                int waitMs = -1;
+                if (deadline != std::chrono::high_resolution_clock::time_point::max())
+                {
+                    auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::high_resolution_clock::now()).count();
+                    if (remaining <= 0)
+                        return false;
+                    waitMs = (int)remaining;
+                }
+
+                int ready = poll(fds, 3, waitMs);
+                if (ready < 0 && errno == EINTR)
+                    continue;
+                if (ready < 0) [[unlikely]]
+                    return false;
+
+                // Stop watching outputs that were closed
+                if ((fds[1].revents & (POLLIN | POLLHUP)) && !drainNonBlocking(fds[1].fd, errOutput))
+                    fds[1].fd = -1;
+                if ((fds[2].revents & (POLLIN | POLLHUP)) && !drainNonBlocking(fds[2].fd, outOutput))
+                    fds[2].fd = -1;
+                if (fds[0].revents & (POLLIN | POLLHUP))
+                {
+                    auto len = read(stFd, reinterpret_cast<char*>(value) + received, 4 - received);
+                    if (len < 0 && errno == EINTR)
+                        continue;
+                    if (len <= 0)
+                        return false;
+                    received += len;
+                }
+            }
+            return true;
         }
 
-        virtual std::ostream& bugInfo(std::ostream& os) const override
+        void stop()
         {
-            os << returnCode;
-            return os;
+            for (int* fd : { &ctlFd, &stFd, &stdinFd, &stderrFd })
+            {
+                if (*fd >= 0)
+                    close(*fd);
+                *fd = -1;
+            }
+#ifdef CAPTURE_STDOUT
+            if (stdoutFd >= 0)
+                close(stdoutFd);
+            stdoutFd = -1;
+#endif
+            if (stoppedChild > 0)
+                kill(stoppedChild, SIGKILL); // Not our child, the server reaps it
+            stoppedChild = -1;
+            if (serverPid > 0)
+            {
+                // Closed control pipe makes the server exit on its own, unless it is not a fork server at all
+                kill(serverPid, SIGKILL);
+                waitpid(serverPid, nullptr, 0);
+            }
+            serverPid = -1;
         }
-
-        virtual ~ReturnCodeError() = default;
-
-        const int returnCode;
     };
 
     /// <summary>
-    /// Oracle that catches hangs of the program
+    /// Starts a new process for every execution, like execute_in_new_process, but without the overhead of boost::process.
+    /// Arguments and environment are prepared once, the program is started by posix_spawn (vfork + execve), the output pipes are reused by all runs,
+    /// and on timeout the whole process group is killed, so that children of the program do not survive it.
     /// </summary>
-    struct TimeoutError final : public DetectedError
+    struct SpawnExecutor final : public Executor
     {
-        bool operator==(const TimeoutError& other) const
+        /// <param name="memoryStdin">Give the program its standard input in a rewound file in memory (memfd) instead of a pipe</param>
+        explicit SpawnExecutor(const ExecutionInput& executionInput, bool memoryStdin = false) : path(executionInput.executablePath.string()), arguments(executionInput.getArguments())
         {
-            return true; //All timeouts are treated as equal
-            // return timeout == other.timeout;
-        }
+            signal(SIGPIPE, SIG_IGN); // Program that does not read its whole input must not kill the fuzzer
 
-        TimeoutError(std::chrono::duration<double, std::milli> timeout) : timeout(std::move(timeout)) {}
-        TimeoutError(TimeoutError&&) = default;
-        TimeoutError(const TimeoutError&) = default;
+            argv.push_back(path.data());
+            for (auto& i : arguments)
+                argv.push_back(i.data());
+            argv.push_back(nullptr);
 
-        virtual bool operator == (const DetectedError& Other) const override {
-            if (typeid(Other) == typeid(*this))
+            for (char** i = environ; *i != nullptr; ++i)
             {
-                const TimeoutError& other = static_cast<const TimeoutError&>(Other);
-
-                return *this == other;
+                std::string_view variable(*i);
+                if (!executionInput.environment.contains(std::string(variable.substr(0, variable.find('=')))))
+                    environment.emplace_back(variable);
             }
-            else
-                return false;
+            for (const auto& [name, value] : executionInput.environment)
+                environment.push_back(name + '=' + value);
+            for (auto& i : environment)
+                envp.push_back(i.data());
+            envp.push_back(nullptr);
+
+            // Parent keeps both ends open, so the pipes survive between the runs. Everything is closed on exec, the child gets only its copies from the file actions.
+            // Only the ends of the fuzzer are non-blocking, the program must see ordinary blocking pipes.
+            if (pipe2(stderrPipe, O_CLOEXEC) != 0 || fcntl(stderrPipe[0], F_SETFL, O_NONBLOCK) != 0) [[unlikely]]
+                throw std::runtime_error("Cannot create pipes for the program");
+#ifdef CAPTURE_STDOUT
+            if (pipe2(stdoutPipe, O_CLOEXEC) != 0 || fcntl(stdoutPipe[0], F_SETFL, O_NONBLOCK) != 0) [[unlikely]]
+                throw std::runtime_error("Cannot create pipes for the program");
+#else
+            stdoutPipe[1] = open("/dev/null", O_WRONLY | O_CLOEXEC);
+#endif
+            // Standard input gets a new pipe every run (it has to be closed to signal the end), always moved to this descriptor, so that the file actions do not change
+            if (memoryStdin)
+            {
+                // Or the input is written into memory once and the program reads it from a read-only descriptor of its own, which is rewound before every run.
+                // Nothing blocks if the program does not read it, and the program can seek in it.
+                stdinMemFd = memfd_create("fuzz_stdin", MFD_CLOEXEC);
+                if (stdinMemFd >= 0)
+                    stdinFd = open(("/proc/self/fd/" + std::to_string(stdinMemFd)).c_str(), O_RDONLY | O_CLOEXEC);
+                if (stdinFd < 0 && stdinMemFd >= 0) [[unlikely]]
+                {
+                    close(stdinMemFd);
+                    stdinMemFd = -1;
+                }
+            }
+            if (stdinFd < 0)
+                stdinFd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+
+            posix_spawn_file_actions_init(&fileActions);
+            posix_spawn_file_actions_adddup2(&fileActions, stdinFd, STDIN_FILENO);
+            posix_spawn_file_actions_adddup2(&fileActions, stdoutPipe[1], STDOUT_FILENO);
+            posix_spawn_file_actions_adddup2(&fileActions, stderrPipe[1], STDERR_FILENO);
+
+            // Own process group to be able to kill everything it starts, default signal handling as if it was started from a shell
+            posix_spawnattr_init(&attributes);
+            posix_spawnattr_setflags(&attributes, POSIX_SPAWN_SETPGROUP | POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF);
+            posix_spawnattr_setpgroup(&attributes, 0);
+            sigset_t signals;
+            sigemptyset(&signals);
+            posix_spawnattr_setsigmask(&attributes, &signals);
+            sigaddset(&signals, SIGPIPE);
+            posix_spawnattr_setsigdefault(&attributes, &signals);
         }
 
-        static std::optional<TimeoutError> tryDetectError(const ExecutionResult& executionResult)
+        virtual ExecutionResult run(const ExecutionInput& executionInput) override
         {
-            std::optional<TimeoutError> res;
+            ExecutionResult result{};
 
-            if (executionResult.timed_out)
-                res.emplace(executionResult.execution_time);
+            // Leftovers of children of the previous run
+            drainNonBlocking(stderrPipe[0], discarded);
+#ifdef CAPTURE_STDOUT
+            drainNonBlocking(stdoutPipe[0], discarded);
+#endif
+            discarded.clear();
 
-            return res;
-        }
+            auto cin = executionInput.getCin();
+            int stdinWrite = -1;
+            if (stdinMemFd >= 0)
+            {
+                if (pwrite(stdinMemFd, cin.data(), cin.size(), 0) != (ssize_t)cin.size() || ftruncate(stdinMemFd, cin.size()) != 0 || lseek(stdinFd, 0, SEEK_SET) != 0) [[unlikely]]
+                    throw std::runtime_error("Cannot write input for the program");
+                cin = {}; // Nothing left to feed while waiting
+            }
+            else
+            {
+                int inPipe[2];
+                if (pipe2(inPipe, O_CLOEXEC) != 0 || fcntl(inPipe[1], F_SETFL, O_NONBLOCK) != 0 || dup3(inPipe[0], stdinFd, O_CLOEXEC) < 0) [[unlikely]]
+                    throw std::runtime_error("Cannot create pipes for the program");
+                close(inPipe[0]);
+                stdinWrite = inPipe[1];
+            }
 
-        virtual bool isErrorEncountered(const ExecutionResult& executionResult) const final
-        {
-            auto tmp = tryDetectError(executionResult);
-            if (tmp.has_value() && ((*tmp) == (*this)))
-                return true;
+            auto runStart = std::chrono::high_resolution_clock::now();
 
-            return false;
-        }
+            pid_t pid;
+            int error = posix_spawn(&pid, path.c_str(), &fileActions, &attributes, argv.data(), envp.data());
+            if (error != 0) [[unlikely]]
+            {
+                if (stdinWrite >= 0)
+                    close(stdinWrite);
+                throw std::runtime_error("Cannot start the program: " + std::string(strerror(error)));
+            }
 
-        virtual const char* errorName() const final
-        {
-            return "timeout";
-        }
+            int status = 0;
+#ifdef CAPTURE_STDOUT
+            bool exited = events.wait(pid, executionInput.timeout, stdinWrite, cin, stderrPipe[0], result.stderr_output, stdoutPipe[0], result.stdout_output, status);
+#else
+            bool exited = events.wait(pid, executionInput.timeout, stdinWrite, cin, stderrPipe[0], result.stderr_output, -1, discarded, status);
+#endif
+            if (!exited)
+            {
+                kill(-pid, SIGKILL);
+                waitpid(pid, &status, 0);
+                result.timed_out = true;
+                result.return_code = -1;
+            }
+            else
+                result.return_code = statusToReturnCode(status);
 
-        virtual const char* folder() const final
-        {
-            return "hangs";
+            result.execution_time = std::chrono::duration_cast<std::chrono::duration<double, std::milli>>(std::chrono::high_resolution_clock::now() - runStart);
+
+            // The program is dead, everything it wrote is already in the pipes
+            drainNonBlocking(stderrPipe[0], result.stderr_output);
+#ifdef CAPTURE_STDOUT
+            drainNonBlocking(stdoutPipe[0], result.stdout_output);
+#endif
+            return result;
         }
 
-        virtual std::ostream& bugInfo(std::ostream& os) const override
+        virtual ~SpawnExecutor()
         {
-            os << timeout.count();
-            return os;
+            posix_spawn_file_actions_destroy(&fileActions);
+            posix_spawnattr_destroy(&attributes);
+            for (int fd : { stderrPipe[0], stderrPipe[1], stdoutPipe[0], stdoutPipe[1], stdinFd, stdinMemFd })
+                if (fd >= 0)
+                    close(fd);
         }
 
-        virtual ~TimeoutError() = default;
-
-        std::chrono::duration<double, std::milli> timeout;
+    private:
+        std::string path;
+        std::vector<std::string> arguments;
+        std::vector<std::string> environment;
+        std::vector<char*> argv;
+        std::vector<char*> envp;
+
+        posix_spawn_file_actions_t fileActions;
+        posix_spawnattr_t attributes;
+        ProcessEvents events;
+
+        int stdinFd = -1;
+        int stdinMemFd = -1; // Writable end of the standard input in memory, -1 if it is a pipe
+        int stderrPipe[2] = { -1, -1 };
+        int stdoutPipe[2] = { -1, -1 };
+        std::string discarded;
     };
 
-    virtual size_t asanOffset() const = 0;
-
     /// <summary>
-    /// Oracle that catches address sanitizer errors
+    /// Calls a libFuzzer-style harness (LLVMFuzzerTestOneInput) linked into the fuzzer, without any process or pipe in between.
+    /// Crashing signals and timeouts jump back out of the harness and are reported like a program killed by the signal. AddressSanitizer reports are captured through its error report callback.
+    /// The harness keeps running in the same process after a crash, so its state may be corrupted. For AddressSanitizer to survive an error, build with -fsanitize-recover=address and run with ASAN_OPTIONS=halt_on_error=0,
+    /// otherwise it terminates the fuzzer and only the input is saved.
     /// </summary>
-    struct AddressSanitizerError : public ReturnCodeError
+    struct InProcessExecutor final : public Executor
     {
-        AddressSanitizerError(std::string asanType, std::string file, std::string line) : asanType(std::move(asanType)), file(std::move(file)), line(std::move(line)), ReturnCodeError(1) {}
+        using TestOneInput = int (*)(const uint8_t* data, size_t size);
 
-        AddressSanitizerError(AddressSanitizerError&&) = default;
-        AddressSanitizerError(const AddressSanitizerError&) = default;
+        /// <param name="testOneInput">Harness to call</param>
+        /// <param name="afterInput">Called after every input, can be null</param>
+        InProcessExecutor(TestOneInput testOneInput, void (*afterInput)()) : testOneInput(testOneInput), afterInput(afterInput) {}
 
-        bool operator==(const AddressSanitizerError& other) const
+        virtual ExecutionResult run(const ExecutionInput& executionInput) override
         {
-            return other.asanType == asanType && other.file == file && other.line == line;
-        }
+            setup();
 
-        virtual bool operator == (const DetectedError& Other) const override {
-            if (typeid(Other) == typeid(*this))
+            auto input = executionInput.getCin();
+            ExecutionResult result{};
+            RunState state;
+            state.input = input;
+            state.report = &result.stderr_output;
+
+            auto runStart = std::chrono::high_resolution_clock::now();
+            auto timeoutNs = std::chrono::duration_cast<std::chrono::nanoseconds>(executionInput.timeout).count();
+            itimerspec deadline{ { 0, 0 }, { (time_t)(timeoutNs / 1000000000), (long)(timeoutNs % 1000000000) } };
+
+            int signal = sigsetjmp(state.jump, 1);
+            if (signal == 0)
             {
-                const AddressSanitizerError& other = static_cast<const AddressSanitizerError&>(Other);
+                current = &state;
+                timer_settime(timer, 0, &deadline, nullptr);
+                testOneInput(reinterpret_cast<const uint8_t*>(input.data()), input.size());
+            }
 
-                return *this == other;
+            itimerspec disarm{};
+            timer_settime(timer, 0, &disarm, nullptr);
+            current = nullptr;
+
+            result.execution_time = std::chrono::duration_cast<std::chrono::duration<double, std::milli>>(std::chrono::high_resolution_clock::now() - runStart);
+            if (signal == TIMEOUT_SIGNAL)
+            {
+                result.timed_out = true;
+                result.return_code = -1;
             }
-            else
-                return false;
-        }
+            else if (signal != 0)
+                result.return_code = signal;
+            else if (state.sanitizerError)
+                result.return_code = 1; // Exit code of AddressSanitizer
 
-        virtual const char* errorName() const final
-        {
-            return "asan";
+            if (afterInput)
+                afterInput();
+
+            return result;
         }
 
-        static std::optional<AddressSanitizerError> tryDetectError(const ExecutionResult& executionResult)
+        virtual ~InProcessExecutor()
         {
-            std::optional<AddressSanitizerError> res;
+            if (timerCreated)
+                timer_delete(timer);
+        }
 
-            if (executionResult.return_code == 1)
-            {
-                std::smatch match;
-                if (std::regex_search(executionResult.stderr_output, match, errorTypeRegex))
-                {
-                    //std::cerr << "Caught ASAN " << match[1] << " in " << std::endl << executionResult.stderr_output << std::endl;
+    private:
+        static constexpr int TIMEOUT_SIGNAL = SIGALRM;
 
-                    std::smatch match2;
+        /// <summary>
+        /// Input being run on this thread, for the signal handlers and sanitizer callbacks
+        /// </summary>
+        struct RunState
+        {
+            sigjmp_buf jump;
+            std::string_view input;
+            std::string* report;
+            bool sanitizerError = false;
+        };
+        static inline thread_local RunState* current = nullptr;
 
-                    if (std::regex_search(executionResult.stderr_output, match2, locationRegex)) {
-                        std::string asan;
-                        if (match[1] == "heap-buffer-overflow")
-                            asan = "heap";
-                        else if (match[1] == "stack-buffer-overflow")
-                            asan = "stack";
-                        else if (match[1] == "global-buffer-overflow")
-                            asan = "global";
-                        else
-                            asan = match[1];
+        const TestOneInput testOneInput;
+        void (* const afterInput)();
+        timer_t timer{};
+        bool timerCreated = false;
 
-                        res.emplace(std::move(asan), match2[1], std::to_string(std::stoi(match2[2]) - currentAsanOffset));
-                    }
-                }
+        /// <summary>
+        /// Install the handlers and create the timeout timer, on the first run (from the thread that fuzzes)
+        /// </summary>
+        void setup()
+        {
+            if (timerCreated) [[likely]]
+                return;
 
+            // Stack overflow of the harness needs its own stack to be handled
+            static thread_local std::vector<char> alternateStack(std::max<size_t>(SIGSTKSZ, 64 * 1024));
+            stack_t stack{};
+            stack.ss_sp = alternateStack.data();
+            stack.ss_size = alternateStack.size();
+            sigaltstack(&stack, nullptr);
+
+            struct sigaction sa {};
+            sa.sa_handler = crashHandler;
+            sa.sa_flags = SA_ONSTACK | SA_NODEFER;
+            sigemptyset(&sa.sa_mask);
+            for (int i : { SIGSEGV, SIGBUS, SIGFPE, SIGILL, SIGABRT, TIMEOUT_SIGNAL })
+                sigaction(i, &sa, nullptr);
+
+            if (__asan_set_error_report_callback)
+                __asan_set_error_report_callback(sanitizerReport);
+            if (__sanitizer_set_death_callback)
+                __sanitizer_set_death_callback(sanitizerDeath);
+
+            // Timer signals only this thread, other threads of the fuzzer must not be interrupted
+            sigevent event{};
+            event.sigev_notify = SIGEV_THREAD_ID;
+            event.sigev_signo = TIMEOUT_SIGNAL;
+            event._sigev_un._tid = gettid();
+            if (timer_create(CLOCK_MONOTONIC, &event, &timer) != 0) [[unlikely]]
+                throw std::runtime_error("Cannot create timer for the in-process harness");
+            timerCreated = true;
+        }
+
+        static void crashHandler(int signal)
+        {
+            if (current == nullptr) [[unlikely]]
+            {
+                // Not caused by the harness
+                if (signal == TIMEOUT_SIGNAL)
+                    return;
+                std::signal(signal, SIG_DFL);
+                raise(signal);
+                return;
             }
-
-            return res;
+            siglongjmp(current->jump, signal);
         }
 
-        virtual bool isErrorEncountered(const ExecutionResult& executionResult) const override
+        static void sanitizerReport(const char* report)
         {
-            auto tmp = tryDetectError(executionResult);
-            if (tmp.has_value() && ((*tmp) == (*this)))
-                return true;
-
-            return false;
+            if (current == nullptr)
+                return;
+            current->sanitizerError = true;
+            current->report->append(report);
         }
 
-        virtual std::ostream& bugInfo(std::ostream& os) const override
+        /// <summary>
+        /// AddressSanitizer is going to terminate the process, save at least the input that caused it
+        /// </summary>
+        static void sanitizerDeath()
         {
-            os << "{"
-                "\"file\":\"" << file << "\","
-                "\"line\":" << line << ","
-                "\"kind\":\"" << asanType << "\""
-                "}"
-                ;
-            return os;
+            if (current == nullptr)
+                return;
+            std::ofstream("fatal_input", std::ios::binary) << current->input;
+            std::cerr << "AddressSanitizer terminates the fuzzer, input saved to fatal_input" << std::endl;
         }
-
-        const std::string asanType;
-        const std::string file;
-        const std::string line;
-
-        virtual ~AddressSanitizerError() = default;
     };
+#endif
 
     /// <summary>
-    /// Catch error from runner output
+    /// Execute program in the system with a timeout and return its results
     /// </summary>
-    /// <param name="result">Output from the runner</param>
-    /// <returns>Error present in this output. Nullptr if no error present.</returns>
-    static std::unique_ptr<DetectedError> detectError(const ExecutionResult& result)
-    {
-        {
-            auto tmp = TimeoutError::tryDetectError(result);
-            if (tmp.has_value())
-                return std::make_unique<TimeoutError>(std::move(*tmp));
-        }
-        {
-            auto tmp = AddressSanitizerError::tryDetectError(result);
-            if (tmp.has_value())
-                return std::make_unique<AddressSanitizerError>(std::move(*tmp));
-        }
+    /// <param name="executionInput">What to execute and how</param>
+    /// <param name="confirmHang">Repeat an execution that exceeded a calibrated timeout with the full one, before it counts as a hang</param>
+    /// <returns>Result of the executions</returns>
+    ExecutionResult execute_with_timeout(ExecutionInput& executionInput, bool confirmHang = true) {
+        auto result = executionInput.executor ? executionInput.executor->run(executionInput) : execute_in_new_process(executionInput);
+
+        if (result.timed_out && confirmHang && executionInput.fullTimeout > executionInput.timeout)
         {
-            auto tmp = ReturnCodeError::tryDetectError(result);
-            if (tmp.has_value())
-                return std::make_unique<ReturnCodeError>(std::move(*tmp));
+            nb_suspected_hangs.fetch_add(1, std::memory_order_relaxed);
+            auto calibrated = executionInput.timeout;
+            executionInput.timeout = executionInput.fullTimeout;
+            result = executionInput.executor ? executionInput.executor->run(executionInput) : execute_in_new_process(executionInput);
+            executionInput.timeout = calibrated;
         }
 
-        return std::unique_ptr<DetectedError>();
+        statisticsExecution.addNumber(result.execution_time.count());
+        if (result.timed_out)
+            nb_hanged_runs.fetch_add(1, std::memory_order_relaxed);
+        else if (result.return_code != 0)
+            nb_failed_runs.fetch_add(1, std::memory_order_relaxed);
+
+        return result;
     }
 
     /// <summary>
-    /// Minimize input in a way that the same error still persists, but the input is shortest as possible
+    /// Start the program as a new process, with a timeout, and return its results
     /// </summary>
-    /// <param name="input">Unminimized input string that throws error</param>
-    /// <param name="prevResult">Error that should be hit</param>
-    /// <param name="executionInput">Where to test all the inputs</param>
-    /// <param name="totalRuns">How many times it runs (statistic purposes)</param>
-    /// <returns>Minimized string</returns>
-    std::string minimizeInput(const std::string_view& input, const DetectedError& prevResult, ExecutionInput& executionInput, size_t& totalRuns)
-    {
-        constexpr int divisionsStepStart = 2;
-        int divisionStep = divisionsStepStart - 1;
-        int prevStep = -1;
+    /// <param name="executionInput">What to execute</param>
+    /// <returns>Result of the executions</returns>
+    static ExecutionResult execute_in_new_process(const ExecutionInput& executionInput) {
+        using namespace boost::process;
 
-        while (true)
-        {
-            int step;
+#ifdef CAPTURE_STDOUT
+        ipstream stdout_stream;  // To capture standard output
+#endif
+        ipstream stderr_stream;  // To capture standard error
+        opstream stdin_stream;   // To provide input
 
-            do
-            {
-                step = input.length() / ++divisionStep;
-            } while (step == prevStep);
-            prevStep = step;
+        auto environment = boost::this_process::environment();
+        for (const auto& [name, value] : executionInput.environment)
+            environment[name] = value;
 
-            if (step < 1)
-                return std::string(input);
+        auto start = std::chrono::high_resolution_clock::now();
+        child process(
+            executionInput.executablePath.c_str(),
+            executionInput.getArguments(),
+            environment,
+#ifdef CAPTURE_STDOUT
+            std_out > stdout_stream,
+#else
+            std_out > boost::process::null,
+#endif
+            std_err > stderr_stream,
+            std_in < stdin_stream
+        );
 
-            //Step 1
-            for (size_t i = 0; i < input.length(); i += step)
-            {
-                auto cropped = input.substr(i, step);
-                executionInput.setInput(cropped);
+#ifndef _MSC_VER
+        // Feed the input, collect the outputs and wait for the exit all at once, a program writing more than a pipe buffer would otherwise never finish
+        static thread_local ProcessEvents events;
+        int stdinFd = stdin_stream.pipe().native_sink();
+        stdin_stream.pipe().assign_sink(-1); // Closed by the events once the input is written
+        int stderrFd = stderr_stream.pipe().native_source();
+        fcntl(stdinFd, F_SETFL, O_NONBLOCK);
+        fcntl(stderrFd, F_SETFL, O_NONBLOCK);
+#ifdef CAPTURE_STDOUT
+        int stdoutFd = stdout_stream.pipe().native_source();
+        fcntl(stdoutFd, F_SETFL, O_NONBLOCK);
+#endif
 
-                totalRuns += 1;
-                auto result = execute_with_timeout(executionInput);
-                if (prevResult.isErrorEncountered(result))
-                {
-                    return minimizeInput(cropped, prevResult, executionInput, totalRuns);
-                }
-                else
-                {
-                    dealWithResult(input, std::move(result), executionInput, true);// Minimization discovered a different bug, remember for later
-                }
-            }
+        ExecutionResult result{};
+        int status = 0;
+#ifdef CAPTURE_STDOUT
+        bool finished_in_time = events.wait(process.id(), executionInput.timeout, stdinFd, executionInput.getCin(), stderrFd, result.stderr_output, stdoutFd, result.stdout_output, status);
+#else
+        std::string discarded;
+        bool finished_in_time = events.wait(process.id(), executionInput.timeout, stdinFd, executionInput.getCin(), stderrFd, result.stderr_output, -1, discarded, status);
+#endif
+        if (!finished_in_time) {
+            process.terminate();  // Kill the process if it times out
+            result.return_code = -1;
+            result.timed_out = true;
+        }
+        else
+            result.return_code = statusToReturnCode(status);
 
-            //Step 2
-            for (size_t i = 0; i < input.length(); i += step)
-            {
-                std::string complement;
-                complement.reserve(input.size() - step);
-                complement += input.substr(0, i);
-                if (i + step < input.length())
-                    complement += input.substr(i + step);
+        result.execution_time = std::chrono::duration_cast<std::chrono::duration<double, std::milli>>(std::chrono::high_resolution_clock::now() - start);
 
-                executionInput.setInput(complement);
+        // Whatever is left in the pipes, without waiting for children of the program that may still hold them open
+        drainNonBlocking(stderrFd, result.stderr_output);
+#ifdef CAPTURE_STDOUT
+        drainNonBlocking(stdoutFd, result.stdout_output);
+#endif
+        return result;
+#else
+        // Feed the process's standard input.
+        stdin_stream << executionInput.getCin();
+        stdin_stream.flush();
+        stdin_stream.close();
+        stdin_stream.pipe().close();  // Close stdin to signal end of input
 
-                totalRuns += 1;
-                auto result = execute_with_timeout(executionInput);
-                if (prevResult.isErrorEncountered(result))
-                {
-                    return minimizeInput(complement, prevResult, executionInput, totalRuns);
-                }
-                else
-                {
-                    dealWithResult(input, std::move(result), executionInput, true);// Minimization discovered a different bug, remember for later
-                }
-            }
+        // Read all content from ipstream after the process finishes
+        auto read_stream = [](ipstream& stream) {
+            std::ostringstream oss;
+            oss << stream.rdbuf(); // Efficiently reads the entire stream buffer
+            return oss.str();
+        };
+        
+        // Wait for process completion with a timeout.
+        bool finished_in_time = process.wait_for(executionInput.timeout);
+        if (!finished_in_time) {
+            process.terminate();  // Kill the process if it times out
+            auto duration = std::chrono::duration_cast<std::chrono::duration<double, std::milli>>(std::chrono::high_resolution_clock::now() - start);
+            return {
+                -1,
+#ifdef CAPTURE_STDOUT
+                read_stream(stdout_stream),
+#endif
+                read_stream(stderr_stream),
+                true,
+                duration 
+           };  // Indicate a timeout occurred
+        }
 
-            //Step 3
+        auto duration = std::chrono::duration_cast<std::chrono::duration<double, std::milli>>(std::chrono::high_resolution_clock::now() - start);
 
-            //If it arrives here, it means we can't minimize at this granularity
-        }
+        // Retrieve the outputs and return code
+        return { 
+            std::move(process.exit_code()),
+#ifdef CAPTURE_STDOUT
+            read_stream(stdout_stream),
+#endif
+            read_stream(stderr_stream),
+            false,
+            duration
+        };
+#endif
     }
 
     /// <summary>
-    /// JSON crash report
+    /// Base class for various errors that the oracle catches
     /// </summary>
-    struct CrashReport
+    struct DetectedError
     {
-        std::string input;
-        DetectedError* detectedError;
-        std::chrono::duration<double, std::milli> execution_time;
-        size_t unminimized_size;
-        size_t nb_steps;
-        std::chrono::duration<double, std::milli> minimization_time;
-    };
+        /// <summary>
+        /// Checks whether this error was present in the output
+        /// </summary>
+        virtual bool isErrorEncountered(const ExecutionResult& executionResult) const = 0;
 
-    /// <summary>
-    /// Export information same for all fuzzers about a crash into a stream
-    /// </summary>
-    static void exportReportCommon(const CrashReport& report, std::ostream& output)
-    {
-        output <<
+        /// <summary>
+        /// Name of the oracle, as it should be in JSON export
+        /// </summary>
+        virtual const char* errorName() const = 0;
 
-            "\"input\":"            "\""  ; escape(output, report.input) << "\","
-            "\"oracle\":"           "\"" << report.detectedError->errorName() << "\","
-            "\"bug_info\":";                report.detectedError->bugInfo(output) << ","
-            "\"execution_time\":" << report.execution_time.count() <<
-            ",\"minimization\":{"
-            "\"unminimized_size\":" << report.unminimized_size << ","
-            "\"nb_steps\":" << report.nb_steps << ","
-            "\"execution_time\":" << report.minimization_time.count() << ""
-            "}"
-            ;
-    }
+        /// <summary>
+        /// Folder that the oracle should export to
+        /// </summary>
+        virtual const char* folder() const = 0;
 
-    /// <summary>
-    /// Export information about the report into a stream
-    /// </summary>
-    virtual void exportReport(const CrashReport& report, std::ostream& output) const = 0;
+        /// <summary>
+        /// Export info about this bug to a stream
+        /// </summary>
+        virtual std::ostream& bugInfo(std::ostream& os) const = 0;
+
+        /// <summary>
+        /// Compares if two errors are the same for deduplication purposes
+        /// </summary>
+        virtual bool operator == (const DetectedError& Other) const = 0;
+
+        virtual ~DetectedError() = default;
+    };
 
     /// <summary>
-    /// Save the report about an error into a file
+    /// Oracle that catches a non-zero return code
     /// </summary>
-    /// <param name="report">Report to save</param>
-    /// <param name="name">Name of the file to save to</param>
-    /// <param name="resultFolder">Where to save it</param>
-    void saveReport(const CrashReport& report, const std::string& name, const std::filesystem::path& resultFolder)
+    struct ReturnCodeError : public DetectedError
     {
-        std::filesystem::path resultFile;
+        ReturnCodeError(int returnCode) : returnCode(std::move(returnCode)) {}
 
-        resultFile = resultFolder / report.detectedError->folder();
+        bool operator==(const ReturnCodeError& other) const
+        {
+            return returnCode == other.returnCode;
+        }
+        virtual bool operator == (const DetectedError& Other) const override {
+            if (typeid(Other) == typeid(*this))
+            {
+                const ReturnCodeError& other = static_cast<const ReturnCodeError&>(Other);
 
-        std::filesystem::create_directories(resultFile);
+                return *this == other;
+            }
+            else
+                return false;
+        }
 
-        resultFile /= name;
+        ReturnCodeError(ReturnCodeError&&) = default;
+        ReturnCodeError(const ReturnCodeError&) = default;
 
-        std::ofstream output(resultFile);
+        static std::optional<ReturnCodeError> tryDetectError(const ExecutionResult& executionResult)
+        {
+            std::optional<ReturnCodeError> res;
 
-        exportReport(report, output);
+            if (executionResult.return_code != EXIT_SUCCESS)
+                res.emplace(executionResult.return_code);
 
-        std::cout << "New error report: \n";
-        exportReport(report, std::cout);
-        std::cout << std::endl;
+            return res;
+        }
 
-        if (!output)
-            std::cerr << "Error saving report!" << std::endl;
-    }
+        virtual bool isErrorEncountered(const ExecutionResult& executionResult) const override
+        {
+            auto tmp = tryDetectError(executionResult);
+            if (tmp.has_value() && ((*tmp) == (*this)))
+                return true;
 
-    const std::filesystem::path FUZZED_PROG;
-    const std::filesystem::path RESULT_FUZZ;
-    const bool MINIMIZE;
-    const std::string_view fuzzInputType;
-    const std::chrono::seconds TIMEOUT;
-    const size_t NB_KNOWN_BUGS;
+            return false;
+        }
 
+        virtual const char* errorName() const override
+        {
+            return "return_code";
+        }
 
-    std::mutex m;
-    std::vector<std::unique_ptr<DetectedError>> uniqueResults;
+        virtual const char* folder() const override
+        {
+            return "crashes";
+        }
 
-    /// <summary>
-    /// Export statistics same for both fuzzers into a stream
-    /// </summary>
-    void exportStatisticsCommon(std::ostream& output)
-    {
-        std::lock_guard guard(m);
-        output <<
-            //"{"
-                "\"fuzzer_name\":"              "\"kocoumat\","
-                "\"fuzzed_program\":"           "\"" ; escape(output, FUZZED_PROG.string())  << "\","
-                "\"nb_runs\":" << statisticsExecution.count() << ","
-                "\"nb_failed_runs\":" << nb_failed_runs.load(std::memory_order_relaxed) << ","
-                "\"nb_hanged_runs\":" << nb_hanged_runs.load(std::memory_order_relaxed) << ","
-                "\"execution_time\": {"
-                    "\"average\":" << statisticsExecution.avg() << ","
-                    "\"median\":" << statisticsExecution.median() << ","
-                    "\"min\":" << statisticsExecution.min() << ","
-                    "\"max\":" << statisticsExecution.max() <<
-                "},"
-                "\"nb_unique_failures\":" << uniqueResults.size() << ","
-                "\"minimization\": {"
-                    "\"before\":" << nb_before_min.load(std::memory_order_relaxed) << ","
-                    "\"avg_steps\":" << std::lround(statisticsMinimizationSteps.avg()) << ","
-                    "\"execution_time\": {"
-                        "\"average\":" << statisticsMinimization.avg() << ","
-                        "\"median\":" << statisticsMinimization.median() << ","
-                        "\"min\":" << statisticsMinimization.min() << ","
-                        "\"max\":" << statisticsMinimization.max() <<
-                    "}"
-                "}"
-            //"}"
-            ;
-    }
+        virtual std::ostream& bugInfo(std::ostream& os) const override
+        {
+            os << returnCode;
+            return os;
+        }
 
-    /// <summary>
-    /// Export all statistics into a stream
-    /// </summary>
-    /// <param name="output"></param>
-    virtual void exportStatistics(std::ostream& output) = 0;
+        virtual ~ReturnCodeError() = default;
+
+        const int returnCode;
+    };
 
     /// <summary>
-    /// Save stats into a file
+    /// Oracle that catches hangs of the program
     /// </summary>
-    void saveStatistics()
+    struct TimeoutError final : public DetectedError
     {
-        auto path = RESULT_FUZZ / "stats.json";
-        //std::cerr << "Saving statistics to " << path << std::endl;
+        bool operator==(const TimeoutError& other) const
+        {
+            return true; //All timeouts are treated as equal
+            // return timeout == other.timeout;
+        }
 
-        std::ofstream output(path);
-        exportStatistics(output);
+        TimeoutError(std::chrono::duration<double, std::milli> timeout) : timeout(std::move(timeout)) {}
+        TimeoutError(TimeoutError&&) = default;
+        TimeoutError(const TimeoutError&) = default;
 
-        std::cout << "Current stats: \n";
-        exportStatistics(std::cout);
-        std::cout << std::endl;
+        virtual bool operator == (const DetectedError& Other) const override {
+            if (typeid(Other) == typeid(*this))
+            {
+                const TimeoutError& other = static_cast<const TimeoutError&>(Other);
 
-        if (!output)
-            std::cerr << "Error saving statistics!" << std::endl;
-    }
+                return *this == other;
+            }
+            else
+                return false;
+        }
+
+        static std::optional<TimeoutError> tryDetectError(const ExecutionResult& executionResult)
+        {
+            std::optional<TimeoutError> res;
+
+            if (executionResult.timed_out)
+                res.emplace(executionResult.execution_time);
+
+            return res;
+        }
+
+        virtual bool isErrorEncountered(const ExecutionResult& executionResult) const final
+        {
+            auto tmp = tryDetectError(executionResult);
+            if (tmp.has_value() && ((*tmp) == (*this)))
+                return true;
+
+            return false;
+        }
+
+        virtual const char* errorName() const final
+        {
+            return "timeout";
+        }
+
+        virtual const char* folder() const final
+        {
+            return "hangs";
+        }
+
+        virtual std::ostream& bugInfo(std::ostream& os) const override
+        {
+            os << timeout.count();
+            return os;
+        }
+
+        virtual ~TimeoutError() = default;
+
+        std::chrono::duration<double, std::milli> timeout;
+    };
+
+    virtual size_t asanOffset() const = 0;
 
     /// <summary>
-    /// Checks whether error is present in runner output and do appropriate actions with it
+    /// Oracle that catches address sanitizer errors
     /// </summary>
-    /// <param name="input">Input string that was ran by the runner</param>
-    /// <param name="result">Result of the runner</param>
-    /// <param name="executionInput">Where to test inputs</param>
-    /// <param name="fromMin">Is this random or from minimization</param>
-    /// <returns>Pointer to erorr if occured. Owned by result vector. Do not free!</returns>
-    DetectedError* dealWithResult(const std::string_view& input, ExecutionResult result, ExecutionInput& executionInput, bool fromMin = false)
+    struct AddressSanitizerError : public ReturnCodeError
     {
-        CrashReport report;
-        size_t errorCount;
+        AddressSanitizerError(std::string asanType, std::string file, std::string line) : asanType(std::move(asanType)), file(std::move(file)), line(std::move(line)), ReturnCodeError(1) {}
+
+        AddressSanitizerError(AddressSanitizerError&&) = default;
+        AddressSanitizerError(const AddressSanitizerError&) = default;
+
+        bool operator==(const AddressSanitizerError& other) const
         {
-            auto err = detectError(result);
+            return other.asanType == asanType && other.file == file && other.line == line;
+        }
 
-            if (err == nullptr)
-                return nullptr; //OK, no error
+        virtual bool operator == (const DetectedError& Other) const override {
+            if (typeid(Other) == typeid(*this))
+            {
+                const AddressSanitizerError& other = static_cast<const AddressSanitizerError&>(Other);
+
+                return *this == other;
+            }
+            else
+                return false;
+        }
+
+        virtual const char* errorName() const final
+        {
+            return "asan";
+        }
+
+        static std::optional<AddressSanitizerError> tryDetectError(const ExecutionResult& executionResult)
+        {
+            std::optional<AddressSanitizerError> res;
 
+            if (executionResult.return_code == 1)
             {
-                std::unique_lock lock(m);
-                errorCount = uniqueResults.size();
-                for (size_t i = 0; i < uniqueResults.size(); i++)
+                std::smatch match;
+                if (std::regex_search(executionResult.stderr_output, match, errorTypeRegex))
                 {
-                    if (*err == *uniqueResults[i])//Error already logged
-                    {
-                        //std::cerr << "This error was already found, nothing new" << std::endl;
-                        return uniqueResults[i].get();
-                    }
+                    //std::cerr << "Caught ASAN " << match[1] << " in " << std::endl << executionResult.stderr_output << std::endl;
+
+                    std::smatch match2;
+
+                    if (std::regex_search(executionResult.stderr_output, match2, locationRegex)) {
+                        std::string asan;
+                        if (match[1] == "heap-buffer-overflow")
+                            asan = "heap";
+                        else if (match[1] == "stack-buffer-overflow")
+                            asan = "stack";
+                        else if (match[1] == "global-buffer-overflow")
+                            asan = "global";
+                        else
+                            asan = match[1];
 
+                        res.emplace(std::move(asan), match2[1], std::to_string(std::stoi(match2[2]) - currentAsanOffset));
+                    }
                 }
-                //std::cerr << "Detected new error " << err->errorName() << " for input " << pop.first << std::endl;
-                uniqueResults.push_back(std::move(err));
 
-                if (uniqueResults.size() >= NB_KNOWN_BUGS)
-                    keepRunning = false;
             }
+
+            return res;
         }
 
-        if (!fromMin) // this was generated by random, not discovered while minimizing
-            nb_before_min.fetch_add(1, std::memory_order_relaxed);
+        virtual bool isErrorEncountered(const ExecutionResult& executionResult) const override
+        {
+            auto tmp = tryDetectError(executionResult);
+            if (tmp.has_value() && ((*tmp) == (*this)))
+                return true;
 
-        report.nb_steps = 0;
-        report.unminimized_size = input.size();
+            return false;
+        }
 
-        report.execution_time = result.execution_time;
-        report.detectedError = uniqueResults[errorCount].get();
+        virtual std::ostream& bugInfo(std::ostream& os) const override
+        {
+            os << "{"
+                "\"file\":\"" << file << "\","
+                "\"line\":" << line << ","
+                "\"kind\":\"" << asanType << "\""
+                "}"
+                ;
+            return os;
+        }
 
-        report.minimization_time = std::chrono::milliseconds(0);
+        const std::string asanType;
+        const std::string file;
+        const std::string line;
 
-        if (MINIMIZE)
-        {
-            auto start = std::chrono::high_resolution_clock::now();
-            report.input = minimizeInput(input, *report.detectedError, executionInput, report.nb_steps);
-            auto end = std::chrono::high_resolution_clock::now();
+        virtual ~AddressSanitizerError() = default;
+    };
+
+    /// <summary>
+    /// Catch error from runner output
+    /// </summary>
+    /// <param name="result">Output from the runner</param>
+    /// <returns>Error present in this output. Nullptr if no error present.</returns>
+    static std::unique_ptr<DetectedError> detectError(const ExecutionResult& result)
+    {
+        {
+            auto tmp = TimeoutError::tryDetectError(result);
+            if (tmp.has_value())
+                return std::make_unique<TimeoutError>(std::move(*tmp));
+        }
+        {
+            auto tmp = AddressSanitizerError::tryDetectError(result);
+            if (tmp.has_value())
+                return std::make_unique<AddressSanitizerError>(std::move(*tmp));
+        }
+        {
+            auto tmp = ReturnCodeError::tryDetectError(result);
+            if (tmp.has_value())
+                return std::make_unique<ReturnCodeError>(std::move(*tmp));
+        }
+
+        return std::unique_ptr<DetectedError>();
+    }
+
+    /// <summary>
+    /// Minimize input in a way that the same error still persists, but the input is shortest as possible
+    /// </summary>
+    /// <param name="input">Unminimized input string that throws error</param>
+    /// <param name="prevResult">Error that should be hit</param>
+    /// <param name="executionInput">Where to test all the inputs</param>
+    /// <param name="totalRuns">How many times it runs (statistic purposes)</param>
+    /// <returns>Minimized string</returns>
+    std::string minimizeInput(const std::string_view& input, const DetectedError& prevResult, ExecutionInput& executionInput, size_t& totalRuns)
+    {
+        constexpr int divisionsStepStart = 2;
+        int divisionStep = divisionsStepStart - 1;
+        int prevStep = -1;
+
+        // The hang is already confirmed, a candidate exceeding the calibrated timeout is taken as the same hang instead of waiting for the full one
+        bool confirmHang = typeid(prevResult) != typeid(TimeoutError);
+
+        while (true)
+        {
+            int step;
+
+            do
+            {
+                step = input.length() / ++divisionStep;
+            } while (step == prevStep);
+            prevStep = step;
+
+            if (step < 1)
+                return std::string(input);
+
+            //Step 1
+            for (size_t i = 0; i < input.length(); i += step)
+            {
+                auto cropped = input.substr(i, step);
+                executionInput.setInput(cropped);
+
+                totalRuns += 1;
+                auto result = execute_with_timeout(executionInput, confirmHang);
+                if (prevResult.isErrorEncountered(result))
+                {
+                    return minimizeInput(cropped, prevResult, executionInput, totalRuns);
+                }
+                else
+                {
+                    dealWithResult(input, std::move(result), executionInput, true);// Minimization discovered a different bug, remember for later
+                }
+            }
+
+            //Step 2
+            for (size_t i = 0; i < input.length(); i += step)
+            {
+                std::string complement;
+                complement.reserve(input.size() - step);
+                complement += input.substr(0, i);
+                if (i + step < input.length())
+                    complement += input.substr(i + step);
+
+                executionInput.setInput(complement);
+
+                totalRuns += 1;
+                auto result = execute_with_timeout(executionInput, confirmHang);
+                if (prevResult.isErrorEncountered(result))
+                {
+                    return minimizeInput(complement, prevResult, executionInput, totalRuns);
+                }
+                else
+                {
+                    dealWithResult(input, std::move(result), executionInput, true);// Minimization discovered a different bug, remember for later
+                }
+            }
+
+            //Step 3
+
+            //If it arrives here, it means we can't minimize at this granularity
+        }
+    }
+
+    /// <summary>
+    /// JSON crash report
+    /// </summary>
+    struct CrashReport
+    {
+        std::string input;
+        DetectedError* detectedError;
+        std::chrono::duration<double, std::milli> execution_time;
+        size_t unminimized_size;
+        size_t nb_steps;
+        std::chrono::duration<double, std::milli> minimization_time;
+    };
+
+    /// <summary>
+    /// Export information same for all fuzzers about a crash into a stream
+    /// </summary>
+    static void exportReportCommon(const CrashReport& report, std::ostream& output)
+    {
+        output <<
+
+            "\"input\":"            "\""  ; escape(output, report.input) << "\","
+            "\"oracle\":"           "\"" << report.detectedError->errorName() << "\","
+            "\"bug_info\":";                report.detectedError->bugInfo(output) << ","
+            "\"execution_time\":" << report.execution_time.count() <<
+            ",\"minimization\":{"
+            "\"unminimized_size\":" << report.unminimized_size << ","
+            "\"nb_steps\":" << report.nb_steps << ","
+            "\"execution_time\":" << report.minimization_time.count() << ""
+            "}"
+            ;
+    }
+
+    /// <summary>
+    /// Export information about the report into a stream
+    /// </summary>
+    virtual void exportReport(const CrashReport& report, std::ostream& output) const = 0;
+
+    /// <summary>
+    /// Save the report about an error into a file
+    /// </summary>
+    /// <param name="report">Report to save</param>
+    /// <param name="name">Name of the file to save to</param>
+    /// <param name="resultFolder">Where to save it</param>
+    void saveReport(const CrashReport& report, const std::string& name, const std::filesystem::path& resultFolder)
+    {
+        std::filesystem::path resultFile;
+
+        resultFile = resultFolder / report.detectedError->folder();
+
+        std::filesystem::create_directories(resultFile);
+
+        resultFile /= name;
+
+        std::ofstream output(resultFile);
+
+        exportReport(report, output);
+
+        std::cout << "New error report: \n";
+        exportReport(report, std::cout);
+        std::cout << std::endl;
+
+        if (!output)
+            std::cerr << "Error saving report!" << std::endl;
+    }
+
+    const std::filesystem::path FUZZED_PROG;
+    const std::filesystem::path RESULT_FUZZ;
+    const bool MINIMIZE;
+    const std::string_view fuzzInputType;
+    const std::chrono::seconds TIMEOUT;
+    const size_t NB_KNOWN_BUGS;
+    const FuzzerSettings settings;
+
+
+    std::mutex m;
+    std::vector<std::unique_ptr<DetectedError>> uniqueResults;
+
+    /// <summary>
+    /// Export statistics same for both fuzzers into a stream
+    /// </summary>
+    void exportStatisticsCommon(std::ostream& output)
+    {
+        std::lock_guard guard(m);
+        output <<
+            //"{"
+                "\"fuzzer_name\":"              "\"kocoumat\","
+                "\"fuzzed_program\":"           "\"" ; escape(output, FUZZED_PROG.string())  << "\","
+                "\"nb_runs\":" << statisticsExecution.count() << ","
+                "\"nb_failed_runs\":" << nb_failed_runs.load(std::memory_order_relaxed) << ","
+                "\"nb_hanged_runs\":" << nb_hanged_runs.load(std::memory_order_relaxed) << ","
+                "\"execution_time\": {"
+                    "\"average\":" << statisticsExecution.avg() << ","
+                    "\"median\":" << statisticsExecution.median() << ","
+                    "\"min\":" << statisticsExecution.min() << ","
+                    "\"max\":" << statisticsExecution.max() <<
+                "},"
+                "\"nb_unique_failures\":" << uniqueResults.size() << ","
+                "\"timeout\": {"
+                    "\"full\":" << settings.timeout.count() << ","
+                    "\"calibrated\":" << calibratedTimeout.load().count() << ","
+                    "\"suspected_hangs\":" << nb_suspected_hangs.load(std::memory_order_relaxed) <<
+                "},"
+                "\"minimization\": {"
+                    "\"before\":" << nb_before_min.load(std::memory_order_relaxed) << ","
+                    "\"avg_steps\":" << std::lround(statisticsMinimizationSteps.avg()) << ","
+                    "\"execution_time\": {"
+                        "\"average\":" << statisticsMinimization.avg() << ","
+                        "\"median\":" << statisticsMinimization.median() << ","
+                        "\"min\":" << statisticsMinimization.min() << ","
+                        "\"max\":" << statisticsMinimization.max() <<
+                    "}"
+                "}"
+            //"}"
+            ;
+
+#ifndef _MSC_VER
+        if (auto forkServer = dynamic_cast<const ForkServerExecutor*>(executionInput->executor.get()))
+        {
+            output <<
+                ",\"fork_server\": {"
+                    "\"startup_time\":" << forkServer->startupTime.count() << ","
+                    "\"deferred_init_time\":" << forkServer->deferredInitTime.count() << ","
+                    "\"persistent\":" << (forkServer->persistent ? "true" : "false") << ","
+                    "\"saved_time\":" << forkServer->startupTime.count() * statisticsExecution.count() <<
+                "}"
+                ;
+        }
+#endif
+    }
+
+    /// <summary>
+    /// Export all statistics into a stream
+    /// </summary>
+    /// <param name="output"></param>
+    virtual void exportStatistics(std::ostream& output) = 0;
+
+    /// <summary>
+    /// Save stats into a file
+    /// </summary>
+    void saveStatistics()
+    {
+        auto path = RESULT_FUZZ / "stats.json";
+        //std::cerr << "Saving statistics to " << path << std::endl;
+
+        std::ofstream output(path);
+        exportStatistics(output);
+
+        std::cout << "Current stats: \n";
+        exportStatistics(std::cout);
+        std::cout << std::endl;
+
+        if (!output)
+            std::cerr << "Error saving statistics!" << std::endl;
+    }
+
+    /// <summary>
+    /// Checks whether error is present in runner output and do appropriate actions with it
+    /// </summary>
+    /// <param name="input">Input string that was ran by the runner</param>
+    /// <param name="result">Result of the runner</param>
+    /// <param name="executionInput">Where to test inputs</param>
+    /// <param name="fromMin">Is this random or from minimization</param>
+    /// <returns>Pointer to erorr if occured. Owned by result vector. Do not free!</returns>
+    DetectedError* dealWithResult(const std::string_view& input, ExecutionResult result, ExecutionInput& executionInput, bool fromMin = false)
+    {
+        CrashReport report;
+        size_t errorCount;
+        DetectedError* detected;
+        {
+            auto err = detectError(result);
+
+            if (err == nullptr)
+                return nullptr; //OK, no error
+
+            {
+                std::unique_lock lock(m);
+                errorCount = uniqueResults.size();
+                for (size_t i = 0; i < uniqueResults.size(); i++)
+                {
+                    if (*err == *uniqueResults[i])//Error already logged
+                    {
+                        //std::cerr << "This error was already found, nothing new" << std::endl;
+                        return uniqueResults[i].get();
+                    }
+
+                }
+                //std::cerr << "Detected new error " << err->errorName() << " for input " << pop.first << std::endl;
+                uniqueResults.push_back(std::move(err));
+                // Other workers may grow the vector once the lock is released, the error itself does not move
+                detected = uniqueResults.back().get();
+
+                if (uniqueResults.size() >= NB_KNOWN_BUGS)
+                    keepRunning = false;
+            }
+        }
+
+        if (!fromMin) // this was generated by random, not discovered while minimizing
+            nb_before_min.fetch_add(1, std::memory_order_relaxed);
+
+        report.nb_steps = 0;
+        report.unminimized_size = input.size();
+
+        report.execution_time = result.execution_time;
+        report.detectedError = detected;
+
+        report.minimization_time = std::chrono::milliseconds(0);
+
+        if (MINIMIZE)
+        {
+            auto start = std::chrono::high_resolution_clock::now();
+            report.input = minimizeInput(input, *report.detectedError, executionInput, report.nb_steps);
+            auto end = std::chrono::high_resolution_clock::now();
+
+            report.minimization_time = std::chrono::duration_cast<std::chrono::duration<double, std::milli>>(end - start);
+
+            statisticsMinimization.addNumber(report.minimization_time.count());
+            statisticsMinimizationSteps.addNumber(report.nb_steps);
+        }
+        else
+            report.input = input;
+
+
+        saveReport(report, std::to_string(errorCount) + ".json", RESULT_FUZZ);
+        return report.detectedError;
+    }
+
+    /// <summary>
+    /// Fuzzing loop of one worker. Runs concurrently with the other workers, each with its own input.
+    /// </summary>
+    /// <param name="executionInput">Input of this worker</param>
+    /// <param name="worker">Index of this worker</param>
+    virtual void fuzz(ExecutionInput& executionInput, size_t worker) = 0;
+
+
+    std::unique_ptr<ExecutionInput> executionInput;
+
+public:
+    fuzzer(std::filesystem::path FUZZED_PROG, std::filesystem::path RESULT_FUZZ, bool MINIMIZE, std::string_view fuzzInputType, std::chrono::seconds TIMEOUT, size_t NB_KNOWN_BUGS, FuzzerSettings settings = {}) : FUZZED_PROG(FUZZED_PROG), RESULT_FUZZ(RESULT_FUZZ), MINIMIZE(MINIMIZE), fuzzInputType(fuzzInputType), TIMEOUT(TIMEOUT), NB_KNOWN_BUGS(NB_KNOWN_BUGS), settings(std::move(settings))//, minSize(minSize), maxSize(maxSize)
+    {
+        if (!std::filesystem::exists(this->FUZZED_PROG) || std::filesystem::is_directory(this->FUZZED_PROG))
+            throw std::runtime_error("Program to fuzz does not exist");
+
+        std::filesystem::create_directories(RESULT_FUZZ);
+        std::filesystem::create_directories(RESULT_FUZZ / "crashes");
+        std::filesystem::create_directories(RESULT_FUZZ / "hangs");
+
+        if (this->settings.testOneInput && fuzzInputType != "stdin") [[unlikely]]
+            throw std::runtime_error("In-process harness takes the input as data, input type must be stdin");
+
+        executionInput = createExecutionInput(0);
+    }
+
+    /// <summary>
+    /// Create input for a worker. Every worker gets its own input file, so that they do not overwrite each other.
+    /// </summary>
+    /// <param name="worker">Index of the worker</param>
+    std::unique_ptr<ExecutionInput> createExecutionInput(size_t worker) const
+    {
+        const std::chrono::milliseconds timeout = settings.timeout;
+
+        if (fuzzInputType == "stdin")
+        {
+            //std::cerr << "Using cin as input" << std::endl;
+            return std::make_unique<CinInput>(FUZZED_PROG, timeout);
+        }
+        else
+        {
+            //std::cerr << "Using file as input" << std::endl;
+            std::string path(fuzzInputType);
+            if (worker != 0)
+                path += '.' + std::to_string(worker);
+#ifndef _MSC_VER
+            if (settings.memoryInput)
+                return std::make_unique<MemoryFileInput>(FUZZED_PROG, timeout, path);
+#endif
+            return std::make_unique<FileInput>(FUZZED_PROG, timeout, std::move(path));
+        }
+    }
+
+    /// <summary>
+    /// Set up the environment of the program of a worker, before it is started
+    /// </summary>
+    /// <param name="executionInput">Input of the worker</param>
+    /// <param name="worker">Index of the worker</param>
+    virtual void prepareWorker(ExecutionInput& executionInput, size_t /*worker*/)
+    {
+#ifndef _MSC_VER
+        if (settings.forkServer)
+            executionInput.environment[std::string(ForkServerExecutor::PERSISTENT_ITERATIONS_ENV)] = std::to_string(settings.persistentIterations);
+#endif
+    }
+
+    /// <summary>
+    /// Choose how the program of a worker is run: in-process, through a fork server, or as a new process for every execution
+    /// </summary>
+    /// <param name="executionInput">Input of the worker</param>
+    /// <param name="verbose">Report what was chosen</param>
+    void startExecutor(ExecutionInput& executionInput, bool verbose)
+    {
+#ifndef _MSC_VER
+        if (settings.testOneInput)
+        {
+            executionInput.executor = std::make_unique<InProcessExecutor>(settings.testOneInput, settings.afterInput);
+            if (verbose)
+                std::cerr << "Running the harness in-process" << std::endl;
+        }
+        else if (settings.forkServer)
+        {
+            auto forkServer = std::make_unique<ForkServerExecutor>();
+            if (forkServer->start(executionInput))
+            {
+                if (verbose)
+                {
+                    std::cerr << "Fork server started in " << forkServer->startupTime.count() << " ms" << std::endl;
+                    if (forkServer->deferredInitTime.count() > 0)
+                        std::cerr << "Fork point is deferred, this saves " << forkServer->deferredInitTime.count() << " ms of initialization per execution" << std::endl;
+                    if (forkServer->persistent)
+                        std::cerr << "Program is persistent, running " << settings.persistentIterations << " inputs per process" << std::endl;
+                }
+                executionInput.executor = std::move(forkServer);
+            }
+            else if (verbose)
+                std::cerr << "Program does not have a fork server, starting a new process for every execution" << std::endl;
+        }
+
+        if (!executionInput.executor && settings.spawn)
+            executionInput.executor = std::make_unique<SpawnExecutor>(executionInput, settings.memoryStdin);
+#endif
+    }
+
+    /// <summary>
+    /// Work done once before the workers start, on the input of the first worker
+    /// </summary>
+    virtual void prepare(ExecutionInput& /*executionInput*/)
+    {
+    }
+
+    /// <summary>
+    /// Work done once after all workers stopped
+    /// </summary>
+    virtual void finish()
+    {
+    }
+
+    /// <summary>
+    /// Least executions needed to derive the timeout from their times
+    /// </summary>
+    static constexpr size_t CALIBRATION_MIN_RUNS = 5;
+
+    /// <summary>
+    /// Timeout derived from the times of the executions so far (of the seeds), full timeout if there are not enough of them
+    /// </summary>
+    std::chrono::milliseconds calibrateTimeout() const
+    {
+        if (!settings.adaptiveTimeout || statisticsExecution.count() < CALIBRATION_MIN_RUNS)
+            return settings.timeout;
+
+        auto timeout = std::chrono::ceil<std::chrono::milliseconds>(std::chrono::duration<double, std::milli>(statisticsExecution.percentile(0.99) * settings.timeoutMultiplier));
+        return std::clamp(timeout, settings.minTimeout, settings.timeout);
+    }
+
+    /// <summary>
+    /// Fuzz until stopped, in one worker
+    /// </summary>
+    void runWorker(ExecutionInput& executionInput, size_t worker)
+    {
+        try
+        {
+            fuzz(executionInput, worker);
+        }
+        catch (const std::exception& e)
+        {
+            std::cerr << "ERROR: " << e.what() << std::endl;
+            keepRunning = false;
+        }
+    }
+
+    /// <summary>
+    /// Run the fuzzer (blocking call)
+    /// </summary>
+    void run()
+    {
+        currentAsanOffset = asanOffset();
+
+        std::atomic<bool> threadsRunning = true;
+
+        // Thread for updating the stats in real-time
+        std::jthread updateStats([&]() {
+            uint8_t counter = 0;
+            while (threadsRunning)
+            {
+                if (counter++ == 10)
+                {
+                    counter = 0;
+                    saveStatistics();
+                }
+                std::this_thread::sleep_for(std::chrono::seconds(1));
+            }
+            std::cerr << "Program can end, writing one last statistics report and exiting..." << std::endl;
+            saveStatistics();
+            });
+
+        // Thread for terminating the process if it runs for too long
+        std::jthread timeoutThread([&]() {
+            const auto start = std::chrono::high_resolution_clock::now();
+            const auto timeout = TIMEOUT - std::chrono::seconds(1);
+            while (std::chrono::duration_cast<std::chrono::seconds>(std::chrono::high_resolution_clock::now() - start) < timeout && keepRunning)
+            {
+                std::this_thread::sleep_for(std::chrono::seconds(1)); // Wait for the set time
+            }
+            
+            keepRunning = false;
+            std::cerr << "Timeout reached or everything found, ending." << std::endl;
+            });
+
+        try
+        {
+            // Every worker has its own program to run, everything else is shared
+            size_t threadCount = settings.workers != 0 ? settings.workers : std::max(1u, std::thread::hardware_concurrency());
+            if (settings.testOneInput)
+                threadCount = 1; // The harness and its coverage exist only once in the process
+
+            std::vector<std::unique_ptr<ExecutionInput>> workerInputs;
+            for (size_t i = 0; i < threadCount; i++)
+            {
+                auto& input = i == 0 ? executionInput : workerInputs.emplace_back(createExecutionInput(i));
+                prepareWorker(*input, i);
+                startExecutor(*input, i == 0);
+            }
+
+            std::cerr << "Running " << threadCount << " fuzzers" << std::endl;
+
+            prepare(*executionInput);
+
+            if (auto timeout = calibrateTimeout(); timeout < settings.timeout)
+            {
+                calibratedTimeout = timeout;
+                executionInput->calibrateTimeout(timeout);
+                for (auto& input : workerInputs)
+                    input->calibrateTimeout(timeout);
+                std::cerr << "Timeout calibrated to " << timeout.count() << " ms from " << statisticsExecution.count() << " executions" << std::endl;
+            }
+
+            std::vector<std::jthread> threads;
+            threads.reserve(threadCount - 1);
+            for (size_t i = 1; i < threadCount; i++)
+                threads.emplace_back([this, &input = *workerInputs[i - 1], i]() { runWorker(input, i); });
+
+            runWorker(*executionInput, 0);
+        }
+        catch (const std::exception& e)
+        {
+            std::cerr << "ERROR: " << e.what() << std::endl;
+        }
+
+        try
+        {
+            finish();
+        }
+        catch (const std::exception& e)
+        {
+            std::cerr << "ERROR: " << e.what() << std::endl;
+        }
+
+        std::cerr << "All fuzzers done, ready to exit" << std::endl;
+        threadsRunning = false;
+    }
+
+    void requestStop()
+    {
+        keepRunning = false;
+    }
+
+};
+
+/// <summary>
+/// Fuzzer that does not have any information about the file it is fuzzing
+/// </summary>
+struct fuzzer_blackbox : public fuzzer
+{
+    /// <summary>
+    /// Fuzzer that does not have any information about the file it is fuzzing
+    /// </summary>
+    /// <param name="FUZZED_PROG">Path to the executable the fuzzer will be running</param>
+    /// <param name="RESULT_FUZZ">Path to a folder where crashes will be saved</param>
+    /// <param name="MINIMIZE">If the fuzzer should minimize crashing inputs</param>
+    /// <param name="INPUT">Input method for given executable. "stdin" if through standard input, file name otherwise.</param>
+    /// <param name="TIMEOUT">Time passed before the fuzzer is stopped</param>
+    /// <param name="NB_KNOWN_BUGS">After the fuzzer finds this many bugs, it terminates.</param>
+    /// <param name="settings">Optional features</param>
+    fuzzer_blackbox(std::filesystem::path FUZZED_PROG, std::filesystem::path RESULT_FUZZ, bool MINIMIZE, std::string_view INPUT, std::chrono::seconds TIMEOUT, size_t NB_KNOWN_BUGS, FuzzerSettings settings = {}/*, size_t minSize = 1, size_t maxSize = 1024*/) : fuzzer(std::move(FUZZED_PROG), std::move(RESULT_FUZZ), std::move(MINIMIZE), std::move(INPUT), std::move(TIMEOUT), std::move(NB_KNOWN_BUGS), std::move(settings))//, minSize(minSize), maxSize(maxSize)
+    {
+
+    }
+
+    virtual size_t asanOffset() const override
+    {
+        return 0;
+    }
+
+    virtual void fuzz(ExecutionInput& executionInput, size_t /*worker*/) override
+    {
+        while (keepRunning)
+        {
+            auto input = generators::generateRandomInput();
+
+            executionInput.setInput(input);
+
+            auto res = execute_with_timeout(executionInput);
+
+            dealWithResult(input, std::move(res), executionInput, false);
+        }
+        //std::cerr << "Exiting fuzzer" << std::endl;
+    }
+
+    virtual void exportStatistics(std::ostream& out) override
+    {
+        out << '{';
+        exportStatisticsCommon(out);
+        out << '}';
+    }
+
+    virtual void exportReport(const CrashReport& report, std::ostream& out) const override
+    {
+        out << '{';
+        exportReportCommon(report, out);
+        out << '}';
+    }
+};
+
+/// <summary>
+/// Load the whole file into a string
+/// </summary>
+/// <param name="path">Path to the file</param>
+/// <returns>Contents of given file</returns>
+static std::string loadFile(const std::filesystem::path& path)
+{
+    auto file = std::ifstream(path, std::ios::binary);
+
+    if (!file.is_open()) [[unlikely]]
+        throw std::runtime_error("Cannot open file: " + path.string());
+
+    std::string res;
+    file.seekg(0, std::ios::end);
+    res.resize(file.tellg());
+    file.seekg(0, std::ios::beg);
+    file.read(&res[0], res.size());
+
+    if (file.fail()) [[unlikely]]
+        throw std::runtime_error("Error reading file: " + path.string());
+
+    return res;
+}
+
+/// <summary>
+/// Fuzzer that works with source code of fuzzing file
+/// </summary>
+struct fuzzer_greybox : public fuzzer
+{
+    /// <summary>
+    /// Identifier of the path an execution took, hash of its hit counts classified into buckets (pathId::hash)
+    /// </summary>
+    typedef uint64_t coveragePath;
+
+    virtual size_t asanOffset() const override
+    {
+        return settings.sanitizerCoverage ? 0 : 4; // Our tool has this offset
+    }
+
+    enum class POWER_SCHEDULE_T : uint8_t
+    {
+        simple,
+        boosted,
+        directed
+    };
+
+    /// <summary>
+    /// Seed that fuzzer keeps in queue
+    /// </summary>
+    struct seed
+    {
+        seed(std::string input) : input(std::move(input)) {};
+        const std::string input;
+
+        /// <summary>
+        /// Input-to-state replacement already ran on this seed (FuzzerSettings::cmpLog), guarded by queueMutex
+        /// </summary>
+        bool cmpLogDone = false;
+
+        /// <summary>
+        /// Increment the counter for this seed counting how many times it was selected (if needed)
+        /// </summary>
+        virtual void incrementSelected() = 0;
+        /// <summary>
+        /// Increment the counter for this seed counting how many times it improved the coverage (if needed)
+        /// </summary>
+        virtual void incrementImproved() = 0;
+        /// <summary>
+        /// Update the energy of this seed from set information.
+        /// </summary>
+        virtual void update() = 0;
+        virtual ~seed() = default;
+    };
+
+    struct seedSimple : public seed
+    {
+        double e; //energy
+
+        const double T; // execution time
+        size_t nm; // how many times it was already selected to be mutated
+        size_t nc; // how many times it led to an increase in coverage
+
+        /// <summary>
+        /// Seed for the simple power method
+        /// </summary>
+        /// <param name="input">String that should be associated with this seed</param>
+        /// <param name="T">Time it took to execute this seed</param>
+        /// <param name="nm">How many times it was already selected to be mutated</param>
+        /// <param name="nc">How many times it led to an increase in coverage</param>
+        seedSimple(std::string input, double T, size_t nm = 1, size_t nc = 1) : seed(std::move(input)), T(T), nm(nm), nc(nc)
+        {
+            e = power();
+        }
+
+        bool operator< (const seedSimple& other) const
+        {
+            return e > other.e;
+        }
+
+        double power() const
+        {
+            return 1.0 / (T * input.size() * nm / nc);
+        }
+
+        virtual void incrementSelected() override final
+        {
+            nm++;
+        }
+        virtual void incrementImproved() override final
+        {
+            nc++;
+        }
+        virtual void update() override final
+        {
+            e = power();
+        }
+        virtual ~seedSimple() = default;
+    };
+
+    struct seedBoosted : public seed
+    {
+        const coveragePath h; //hash of the output
+
+        /// <summary>
+        /// Seed for the boosted power method
+        /// </summary>
+        /// <param name="input">String that should be associated with this seed</param>
+        /// <param name="h">Path that is executed when this seed is run</param>
+        seedBoosted(std::string input, coveragePath h) : seed(std::move(input)), h(h)
+        {
+        }
+
+        double power(const std::unordered_map<coveragePath, size_t>& hashmap) const
+        {
+            return 1.0 / std::pow(hashmap.at(h), 5);
+        }
+
+        virtual void incrementSelected() override final
+        {
+            // Do nothing
+        }
+
+        virtual void incrementImproved() override final
+        {
+            // Do nothing
+        }
+
+        virtual void update() override final
+        {
+            // Do nothing (will be done when selecting)
+        }
+        virtual ~seedBoosted() = default;
+    };
+
+    struct seedDirected : public seedBoosted
+    {
+        const double distance; // mean distance of its lines from the targets, negative if it hit none that leads to them
+
+        /// <summary>
+        /// Seed for the directed power method
+        /// </summary>
+        /// <param name="input">String that should be associated with this seed</param>
+        /// <param name="h">Path that is executed when this seed is run</param>
+        /// <param name="distance">Distance of the seed from the targets (seedDistance)</param>
+        seedDirected(std::string input, coveragePath h, double distance) : seedBoosted(std::move(input), h), distance(distance)
+        {
+        }
+
+        /// <summary>
+        /// Power of the boosted schedule scaled by the closeness to the targets (AFLGo): up to 32 times more for the closest seed and 32 times less for the farthest one, as the temperature falls
+        /// </summary>
+        /// <param name="normalized">Distance of the seed between the closest (0) and the farthest (1) one of the queue</param>
+        /// <param name="temperature">1 while exploring, falling to 0 for exploitation</param>
+        static double directedPower(double boosted, double normalized, double temperature)
+        {
+            const double closeness = (1 - normalized) * (1 - temperature) + 0.5 * temperature;
+            return boosted * std::pow(2.0, 10 * (closeness - 0.5));
+        }
+
+        /// <summary>
+        /// Temperature of the annealing, 0.05 after the exploitation time and falling further
+        /// </summary>
+        static double temperature(double elapsed, double exploitation)
+        {
+            return std::pow(20.0, -elapsed / exploitation);
+        }
+
+        virtual ~seedDirected() = default;
+    };
+
+    struct powerStructure
+    {
+        /// <summary>
+        /// Add new seed into the queue
+        /// </summary>
+        /// <param name="input">String that was fuzzed and should be recorded</param>
+        /// <param name="h">Associated output path from the program</param>
+        /// <param name="T">Runtime for this input</param>
+        /// <param name="nm">How many times it was selected</param>
+        /// <param name="nc">How many times it led to increased coverage</param>
+        /// <param name="distance">Distance from the target lines, negative if unknown</param>
+        virtual void add(std::string input, coveragePath h, double T, size_t nm = 1, size_t nc = 1, double distance = -1) = 0;
+
+        /// <summary>
+        /// Size of the queue
+        /// </summary>
+        virtual size_t size() const = 0;
+
+        /// <summary>
+        /// Retrives seed at given index
+        /// </summary>
+        /// <param name="n">Index</param>
+        /// <returns>Constant reference to the element</returns>
+        virtual const seed& at(size_t n) = 0;
+
+        /// <summary>
+        /// Perform a weighted random choice and borrow the seed, expecting to return it
+        /// </summary>
+        /// <returns>Reference to the selected seed</returns>
+        virtual seed& weightedRandomChoiceBorrow() = 0;
+
+        /// <summary>
+        /// Return borrowed seed (must be done before borrowing a new one!)
+        /// </summary>
+        virtual void weightedRandomChoiceReturn() = 0;
+
+        virtual ~powerStructure() = default;
+
+        std::unordered_map<coveragePath, size_t> hashmap;
+    };
+
+    struct powerSimple : public powerStructure
+    {
+        // Currently borrowed seed of this thread. Store in in this way to avoid copying.
+        static inline thread_local std::pair<std::multiset<seedSimple>::node_type, std::multiset<seedSimple>::const_iterator> borrowed;
+
+    public:
+        void add(std::string input, double T, size_t nm = 1, size_t nc = 1)
+        {
+            queue.emplace(std::move(input), T, nm, nc);
+        }
+        virtual void add(std::string input, coveragePath h, double T, size_t nm = 1, size_t nc = 1, double /*distance*/ = -1) override
+        {
+            add(std::move(input), T, nm, nc);
+        }
+        virtual size_t size() const override
+        {
+            return queue.size();
+        }
+        virtual const seed& at(size_t n) override
+        {
+            // Cannot access directly, needs to jump over LL
+            auto it = queue.cbegin();
+            std::advance(it, n);
+            return *it;
+        }
+
+        virtual seed& weightedRandomChoiceBorrow() override
+        {
+            if (!borrowed.first.empty()) [[unlikely]]
+                throw std::runtime_error("Attempted to borrow another seed without returning previous one!");
+
+            // Store the random choice in this structure, and give reference to it
+            borrowed = weightedRandomChoiceExtract();
+            return borrowed.first.value();
+        }
+        virtual void weightedRandomChoiceReturn() override
+        {
+            // No hint, other workers could have extracted the element it points to
+            queue.insert(std::move(borrowed.first));
+        }
+        virtual ~powerSimple() = default;
+
+        /// <summary>
+        /// Weighted random choice of a seed, where some portion of best seeds will be given 50% choice be selected
+        /// </summary>
+        /// <returns>Selected seed extracted from the queue</returns>
+        std::pair<std::multiset<seedSimple>::node_type, std::multiset<seedSimple>::const_iterator> weightedRandomChoiceExtract()
+        {
+            if (queue.empty()) [[unlikely]]
+                throw std::runtime_error("Queue is empty, cannot choose");
+            else if (queue.size() == 1)
+                return { queue.extract(queue.cbegin()), std::move(queue.cend()) };
+
+            const size_t firstTenPercent = queue.size() * 0.1f;
+            const double coefficientGood = 0.5 / firstTenPercent;
+            const double coefficientWorse = 0.5 / (queue.size() - firstTenPercent);
 
-            report.minimization_time = std::chrono::duration_cast<std::chrono::duration<double, std::milli>>(end - start);
+            std::uniform_real_distribution<> dis(0.0, 1.0); // Range [0, totalWeight)
 
-            statisticsMinimization.addNumber(report.minimization_time.count());
-            statisticsMinimizationSteps.addNumber(report.nb_steps);
-        }
-        else
-            report.input = input;
+            // Generate a random number
+            double randomValue = dis(gen);
 
+            // Find the chosen option based on the random value
+            double cumulativeWeight = 0.0;
 
-        saveReport(report, std::to_string(errorCount) + ".json", RESULT_FUZZ);
-        return report.detectedError;
-    }
+            size_t i = 0;
+            for (auto it = queue.cbegin(); it != queue.cend(); it++) {
+                if (i <= firstTenPercent)
+                    cumulativeWeight += coefficientGood;// Better score
+                else
+                    cumulativeWeight += coefficientWorse;// Worse score
 
-    virtual void fuzz() = 0;
+                if (randomValue <= cumulativeWeight) {
+                    auto nextIt = it++;
+                    return { queue.extract(it), std::move(nextIt) };
+                }
+                i++;
+            }
 
+            // If we get here, there was an issue (e.g., no options, weights not positive)
+            throw std::runtime_error("Failed to select a weighted random choice.");
+        }
 
-    std::unique_ptr<ExecutionInput> executionInput;
+        std::multiset<seedSimple> queue;
+    };
 
-public:
-    fuzzer(std::filesystem::path FUZZED_PROG, std::filesystem::path RESULT_FUZZ, bool MINIMIZE, std::string_view fuzzInputType, std::chrono::seconds TIMEOUT, size_t NB_KNOWN_BUGS) : FUZZED_PROG(FUZZED_PROG), RESULT_FUZZ(RESULT_FUZZ), MINIMIZE(MINIMIZE), fuzzInputType(fuzzInputType), TIMEOUT(TIMEOUT), NB_KNOWN_BUGS(NB_KNOWN_BUGS)//, minSize(minSize), maxSize(maxSize)
+    struct powerBoosted : public powerStructure
     {
-        if (!std::filesystem::exists(this->FUZZED_PROG) || std::filesystem::is_directory(this->FUZZED_PROG))
-            throw std::runtime_error("Program to fuzz does not exist");
-
-        std::filesystem::create_directories(RESULT_FUZZ);
-        std::filesystem::create_directories(RESULT_FUZZ / "crashes");
-        std::filesystem::create_directories(RESULT_FUZZ / "hangs");
+        void add(std::string input, coveragePath h)
+        {
+            queue.emplace_back(std::move(input), h); // Deque keeps borrowed seeds of other workers in place
+        }
+        virtual void add(std::string input, coveragePath h, double T, size_t nm = 1, size_t nc = 1, double /*distance*/ = -1) override
+        {
+            add(std::move(input), h);
+        }
+        virtual size_t size() const override
+        {
+            return queue.size();
+        }
 
-        constexpr std::chrono::milliseconds timeout = std::chrono::seconds(5);
+        virtual const seed& at(size_t n) override
+        {
+            return queue.at(n);
+        }
 
-        if (fuzzInputType == "stdin")
+        virtual seed& weightedRandomChoiceBorrow() override
         {
-            //std::cerr << "Using cin as input" << std::endl;
-            executionInput = std::make_unique<CinInput>(FUZZED_PROG, timeout);
+            return weightedRandomChoice();
         }
-        else
+
+        virtual void weightedRandomChoiceReturn() override
         {
-            //std::cerr << "Using file as input" << std::endl;
-            executionInput = std::make_unique<FileInput>(FUZZED_PROG, timeout, std::string(fuzzInputType));
+            // Seeds never leave the queue
         }
-    }
+        virtual ~powerBoosted() = default;
 
-    /// <summary>
-    /// Run the fuzzer (blocking call)
-    /// </summary>
-    void run()
-    {
-        currentAsanOffset = asanOffset();
+        /// <summary>
+        /// Weighted random choice of a seed
+        /// </summary>
+        /// <returns>Reference to the selected seed</returns>
+        virtual seed& weightedRandomChoice()
+        {
+            if (queue.empty()) [[unlikely]]
+                throw std::runtime_error("Queue is empty, cannot choose");
 
-        std::atomic<bool> threadsRunning = true;
+            // Calculate the total weight
+            double totalWeight = 0.0;
+            for (const auto& option : queue)
+                totalWeight += option.power(hashmap);
 
-        // Thread for updating the stats in real-time
-        std::jthread updateStats([&]() {
-            uint8_t counter = 0;
-            while (threadsRunning)
+            std::uniform_real_distribution<> dis(0.0, totalWeight); // Range [0, totalWeight)
+
+            // Generate a random number
+            double randomValue = dis(gen);
+
+            // Find the chosen option based on the random value
+            double cumulativeWeight = 0.0;
+
+            for (auto& i : queue)
             {
-                if (counter++ == 10)
-                {
-                    counter = 0;
-                    saveStatistics();
-                }
-                std::this_thread::sleep_for(std::chrono::seconds(1));
+                cumulativeWeight += i.power(hashmap);
+                if (randomValue <= cumulativeWeight)
+                    return i;
             }
-            std::cerr << "Program can end, writing one last statistics report and exiting..." << std::endl;
-            saveStatistics();
-            });
 
-        // Thread for terminating the process if it runs for too long
-        std::jthread timeoutThread([&]() {
-            const auto start = std::chrono::high_resolution_clock::now();
-            const auto timeout = TIMEOUT - std::chrono::seconds(1);
-            while (std::chrono::duration_cast<std::chrono::seconds>(std::chrono::high_resolution_clock::now() - start) < timeout && keepRunning)
+            // If we get here, there was an issue (e.g., no options, weights not positive)
+            throw std::runtime_error("Failed to select a weighted random choice.");
+        }
+
+        std::deque<seedBoosted> queue;
+    };
+
+    struct powerDirected : public powerStructure
+    {
+        /// <param name="exploitation">Time after which the seeds close to the targets are mostly chosen</param>
+        powerDirected(std::chrono::duration<double> exploitation) : exploitation(exploitation)
+        {
+        }
+
+        virtual void add(std::string input, coveragePath h, double T, size_t nm = 1, size_t nc = 1, double distance = -1) override
+        {
+            if (distance >= 0)
             {
-                std::this_thread::sleep_for(std::chrono::seconds(1)); // Wait for the set time
+                minDistance = std::min(minDistance, distance);
+                maxDistance = std::max(maxDistance, distance);
             }
-            
-            keepRunning = false;
-            std::cerr << "Timeout reached or everything found, ending." << std::endl;
-            });
-
-        try
+            queue.emplace_back(std::move(input), h, distance); // Deque keeps borrowed seeds of other workers in place
+        }
+        virtual size_t size() const override
         {
-            // Run the actual fuzzing. Ready for multiple threads of execution, but not implemented.
+            return queue.size();
+        }
 
-            std::vector<std::jthread> threads;
-            auto threadCount = 1;// std::thread::hardware_concurrency();
+        virtual const seed& at(size_t n) override
+        {
+            return queue.at(n);
+        }
 
-            std::cerr << "Running " << threadCount << " fuzzers" << std::endl;
+        virtual seed& weightedRandomChoiceBorrow() override
+        {
+            if (queue.empty()) [[unlikely]]
+                throw std::runtime_error("Queue is empty, cannot choose");
 
-            //threads.reserve(threadCount - 1);
-            //for (size_t i = 0; i < threadCount - 1; i++)
-            //    threads.emplace_back(fuzz, this);
+            const double temperature = seedDirected::temperature(std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count(), exploitation.count());
+            std::vector<double> weights;
+            weights.reserve(queue.size());
+            for (const auto& i : queue)
+                weights.push_back(seedDirected::directedPower(i.power(hashmap), normalized(i.distance), temperature));
 
-            fuzz();
+            std::discrete_distribution<size_t> dis(weights.begin(), weights.end());
+            return queue[dis(gen)];
         }
-        catch (const std::exception& e)
+
+        virtual void weightedRandomChoiceReturn() override
         {
-            std::cerr << "ERROR: " << e.what() << std::endl;
+            // Seeds never leave the queue
         }
+        virtual ~powerDirected() = default;
 
-        std::cerr << "All fuzzers done, ready to exit" << std::endl;
-        threadsRunning = false;
-    }
-
-    void requestStop()
-    {
-        keepRunning = false;
-    }
+        /// <summary>
+        /// Distance between the closest (0) and the farthest (1) seed, seeds that do not lead to the targets are the farthest
+        /// </summary>
+        double normalized(double distance) const
+        {
+            if (distance < 0 || maxDistance <= minDistance)
+                return distance < 0 ? 1 : 0;
+            return (distance - minDistance) / (maxDistance - minDistance);
+        }
 
-};
+        std::deque<seedDirected> queue;
+        const std::chrono::steady_clock::time_point started = std::chrono::steady_clock::now();
+        const std::chrono::duration<double> exploitation;
+        double minDistance = std::numeric_limits<double>::infinity();
+        double maxDistance = 0;
+    };
 
-/// <summary>
-/// Fuzzer that does not have any information about the file it is fuzzing
-/// </summary>
-struct fuzzer_blackbox : public fuzzer
-{
     /// <summary>
-    /// Fuzzer that does not have any information about the file it is fuzzing
+    /// Joins random number of seeds together, possible with delimiters
     /// </summary>
-    /// <param name="FUZZED_PROG">Path to the executable the fuzzer will be running</param>
-    /// <param name="RESULT_FUZZ">Path to a folder where crashes will be saved</param>
-    /// <param name="MINIMIZE">If the fuzzer should minimize crashing inputs</param>
-    /// <param name="INPUT">Input method for given executable. "stdin" if through standard input, file name otherwise.</param>
-    /// <param name="TIMEOUT">Time passed before the fuzzer is stopped</param>
-    /// <param name="NB_KNOWN_BUGS">After the fuzzer finds this many bugs, it terminates.</param>
-    fuzzer_blackbox(std::filesystem::path FUZZED_PROG, std::filesystem::path RESULT_FUZZ, bool MINIMIZE, std::string_view INPUT, std::chrono::seconds TIMEOUT, size_t NB_KNOWN_BUGS/*, size_t minSize = 1, size_t maxSize = 1024*/) : fuzzer(std::move(FUZZED_PROG), std::move(RESULT_FUZZ), std::move(MINIMIZE), std::move(INPUT), std::move(TIMEOUT), std::move(NB_KNOWN_BUGS))//, minSize(minSize), maxSize(maxSize)
+    /// <param name="input"></param>
+    void createMashups(std::string& input)
     {
+        std::exponential_distribution<float> distVal(0.5);
+        size_t mashups = 1 + round(distVal(gen));
+        for (size_t i = 0; i < mashups; i++)
+        {
+            switch (generators::randomInt(6))
+            {
+            case 0:
+                input += '\n';
+                break;
+            case 1:
+                input += generators::randomDigit();
+                break;
+            case 2:
+                input += generators::randomASCII();
+                break;
+            case 3:
+            case 4:
+            case 5:
+            {
+                input += queue->at(generators::randomInt(queue->size())).input;
+            } break;
 
+            default:
+                UNREACHABLE;
+            }
+        }
     }
 
-    virtual size_t asanOffset() const override
-    {
-        return 0;
-    }
-
-    virtual void fuzz() override
+    /// <summary>
+    /// Perform generation of a new mutant. Given the chance from the constructor, also splice/join multiple existing seeds together.
+    /// </summary>
+    /// <param name="input"></param>
+    /// <returns></returns>
+    std::string randomNumberOfRandomMutants(std::string input)
     {
-        while (keepRunning)
-        {
-            auto input = generators::generateRandomInput();
-
-            executionInput->setInput(input);
-
-            auto res = execute_with_timeout(*executionInput);
+        if (generators::randomFloat() < concatenatedness)
+            createMashups(input); // Perform joining
+        else
+            mutators::randomNumberOfRandomMutants(input); // Perform mutation
 
-            dealWithResult(input, std::move(res), *executionInput, false);
-        }
-        //std::cerr << "Exiting fuzzer" << std::endl;
+        return input;
     }
 
     virtual void exportStatistics(std::ostream& out) override
     {
         out << '{';
         exportStatisticsCommon(out);
+        std::lock_guard lock(queueMutex);
+        out << ",\"nb_queued_seed\":" << queue->size() << ",";
+        out << "\"coverage\":" << bestCoverage * 100 << ",";
+        out << "\"nb_unique_hash\":" << queue->hashmap.size();
+        if (settings.pathCollisionCheck)
+            out << ",\"path_collisions\":" << pathCollisions;
+#ifndef _MSC_VER
+        if (pruneProbes())
+            out << ",\"pruned_probes\":" << prunedProbes;
+#endif
+        if (settings.mapLimit != 0)
+            out << ",\"map_entries\":" << virgin.countHit();
+        if (settings.cmpLog)
+            out << ",\"cmplog\": {\"executions\":" << cmpLogExecutions << ",\"mutants\":" << cmpLogMutants << ",\"new_paths\":" << cmpLogNewPaths << '}';
         out << '}';
     }
-
     virtual void exportReport(const CrashReport& report, std::ostream& out) const override
     {
         out << '{';
         exportReportCommon(report, out);
+        out << ",\"coverage\":" << bestCoverage * 100;
         out << '}';
     }
-};
 
-/// <summary>
-/// Load the whole file into a string
-/// </summary>
-/// <param name="path">Path to the file</param>
-/// <returns>Contents of given file</returns>
-static std::string loadFile(const std::filesystem::path& path)
-{
-    auto file = std::ifstream(path, std::ios::binary);
+    /// <summary>
+    /// Get line from the input, split by the delimiter
+    /// </summary>
+    /// <param name="str">String to read from. Will be eaten</param>
+    /// <param name="delimiter">Delimiter to read line to. Will be removed from input</param>
+    /// <returns>Read line, without delimiter</returns>
+    static std::string_view getLine(std::string_view& str, char delimiter='\n')
+    {
+        size_t i = 0;
+        for (; i < str.size(); ++i)
+        {
+            if (str[i] == delimiter)
+                break;
+        }
+        auto res = str.substr(0, i);
+        if (i >= str.size())
+            str = "";
+        else
+            str = str.substr(i + 1);
+        return res;
+    }
 
-    if (!file.is_open()) [[unlikely]]
-        throw std::runtime_error("Cannot open file: " + path.string());
+    /// <summary>
+    /// Reads coverage percentage and path from a input
+    /// </summary>
+    static std::pair<double, coveragePath> coverage(const std::string& lcov)
+    {
+        return coverage(lcovHits(lcov));
+    }
 
-    std::string res;
-    file.seekg(0, std::ios::end);
-    res.resize(file.tellg());
-    file.seekg(0, std::ios::beg);
-    file.read(&res[0], res.size());
+    static constexpr const char* COVERAGE_FORMAT_ENV = "FUZZ_COVERAGE_FORMAT"; // Must be the same as in the coverage tool
+    static constexpr const char* COVERAGE_FORMAT_BINARY = "binary";
+    static constexpr uint64_t COVERAGE_BINARY_MAGIC = 0x33564F435A5A5546; // "FUZZCOV3"
 
-    if (file.fail()) [[unlikely]]
-        throw std::runtime_error("Error reading file: " + path.string());
+    /// <summary>
+    /// Reads counters from a binary dump of the program (FUZZ_COVERAGE_FORMAT=binary): a header of the magic, number of counters, size of the edge map, bytes of a counter (1 or 8)
+    /// and number of line counters, followed by the counters (of the lines, then of split comparisons) and the edge map
+    /// </summary>
+    /// <param name="lines">Number of the counters that are of lines</param>
+    /// <returns>False if the content is not a binary dump</returns>
+    static bool binaryCoverage(const std::string& content, std::vector<uint64_t>& counters, std::vector<uint8_t>& edges, size_t& lines)
+    {
+        uint64_t header[5];
+        if (content.size() < sizeof(header))
+            return false;
+        std::memcpy(header, content.data(), sizeof(header));
+        if (header[0] != COVERAGE_BINARY_MAGIC || (header[3] != 1 && header[3] != sizeof(uint64_t)) || content.size() != sizeof(header) + header[1] * header[3] + header[2]) [[unlikely]]
+            return false;
 
-    return res;
-}
+        const char* data = content.data() + sizeof(header);
+        counters.resize(header[1]);
+        if (header[3] == 1)
+            std::copy_n(reinterpret_cast<const uint8_t*>(data), header[1], counters.begin());
+        else
+            std::memcpy(counters.data(), data, header[1] * sizeof(uint64_t));
+        edges.assign(data + header[1] * header[3], content.data() + content.size());
+        lines = std::min<size_t>(header[4], header[1]);
+        return true;
+    }
 
-/// <summary>
-/// Fuzzer that works with source code of fuzzing file
-/// </summary>
-struct fuzzer_greybox : public fuzzer
-{
-    typedef std::vector<bool> coveragePath;
+    /// <summary>
+    /// Reads hit counts of all lines from a LCOV report, in their order
+    /// </summary>
+    static std::vector<uint64_t> lcovHits(std::string_view lcov)
+    {
+        std::vector<uint64_t> res;
+        LcovParser().parse(lcov, res);
+        return res;
+    }
 
-    virtual size_t asanOffset() const override
+    /// <summary>
+    /// Part of the lines that were hit
+    /// </summary>
+    static double coveredRatio(std::span<const uint64_t> counters)
     {
-        return 4; // Our tool has this offset
+        size_t covered = std::count_if(counters.begin(), counters.end(), [](uint64_t countHit) { return countHit > 0; });
+        return static_cast<double>(covered) / counters.size();
     }
 
-    enum class POWER_SCHEDULE_T : uint8_t
+    static double coveredRatio(std::span<const uint8_t> counters)
     {
-        simple,
-        boosted
-    };
+        size_t covered = std::count_if(counters.begin(), counters.end(), [](uint8_t countHit) { return countHit > 0; });
+        return static_cast<double>(covered) / counters.size();
+    }
 
     /// <summary>
-    /// Seed that fuzzer keeps in queue
+    /// Reads coverage percentage and path from the counters of the program, the same as from its LCOV report
     /// </summary>
-    struct seed
+    /// <param name="counters">Hits of the lines</param>
+    /// <param name="edges">Hits of the edges, if the program records them. The path is then made of the edges instead of the lines.</param>
+    static std::pair<double, coveragePath> coverage(std::span<const uint64_t> counters, std::span<const uint8_t> edges = {})
     {
-        seed(std::string input) : input(std::move(input)) {};
-        const std::string input;
+        std::vector<uint8_t> classified(edges.empty() ? counters.size() : edges.size());
+        if (edges.empty())
+            hitBuckets::classify(counters, classified);
+        else
+            hitBuckets::classify(edges, classified);
 
-        /// <summary>
-        /// Increment the counter for this seed counting how many times it was selected (if needed)
-        /// </summary>
-        virtual void incrementSelected() = 0;
-        /// <summary>
-        /// Increment the counter for this seed counting how many times it improved the coverage (if needed)
-        /// </summary>
-        virtual void incrementImproved() = 0;
-        /// <summary>
-        /// Update the energy of this seed from set information.
-        /// </summary>
-        virtual void update() = 0;
-        virtual ~seed() = default;
-    };
+        return { coveredRatio(counters), pathId::hash(classified) };
+    }
 
-    struct seedSimple : public seed
+    /// <summary>
+    /// Replace the hit counts in an LCOV report with given ones, in the order of its lines (which is the order of the counters)
+    /// </summary>
+    /// <param name="lcov">Report giving the files and lines</param>
+    /// <param name="hits">New hit counts</param>
+    /// <returns>Report with the new counts</returns>
+    static std::string fillLcov(const std::string& lcov, std::span<const uint64_t> hits)
     {
-        double e; //energy
-
-        const double T; // execution time
-        size_t nm; // how many times it was already selected to be mutated
-        size_t nc; // how many times it led to an increase in coverage
+        std::ostringstream res;
+        std::string_view str(lcov);
+        size_t counter = 0;
+        size_t linesHit = 0;
 
-        /// <summary>
-        /// Seed for the simple power method
-        /// </summary>
-        /// <param name="input">String that should be associated with this seed</param>
-        /// <param name="T">Time it took to execute this seed</param>
-        /// <param name="nm">How many times it was already selected to be mutated</param>
-        /// <param name="nc">How many times it led to an increase in coverage</param>
-        seedSimple(std::string input, double T, size_t nm = 1, size_t nc = 1) : seed(std::move(input)), T(T), nm(nm), nc(nc)
+        while (!str.empty())
         {
-            e = power();
-        }
+            auto line = getLine(str);
+            if (line.starts_with("SF:"))
+                linesHit = 0;
 
-        bool operator< (const seedSimple& other) const
-        {
-            return e > other.e;
+            if (line.starts_with("DA:") && counter < hits.size())
+            {
+                auto hit = hits[counter++];
+                if (hit > 0)
+                    linesHit++;
+                res << line.substr(0, line.find(',')) << ',' << hit << '\n';
+            }
+            else if (line.starts_with("LH:"))
+                res << "LH:" << linesHit << '\n';
+            else
+                res << line << '\n';
         }
 
-        double power() const
-        {
-            return 1.0 / (T * input.size() * nm / nc);
-        }
+        return res.str();
+    }
 
-        virtual void incrementSelected() override final
-        {
-            nm++;
-        }
-        virtual void incrementImproved() override final
-        {
-            nc++;
-        }
-        virtual void update() override final
+#ifndef _MSC_VER
+    /// <summary>
+    /// Coverage counters of the program of one worker, in a SysV shared memory segment that the instrumented program maps (its id is passed in FUZZ_COVERAGE_SHM).
+    /// The segment starts with the number of counters, the size of the edge map, the bytes of a counter and how many of the counters are of lines, written by the program when it maps the segment,
+    /// followed by the counters (of the lines, then of split comparisons) and the edge map.
+    /// </summary>
+    struct SharedCoverage
+    {
+        static constexpr const char* COVERAGE_SHM_ENV = "FUZZ_COVERAGE_SHM"; // Must be the same as in the coverage tool
+        static constexpr size_t EDGE_MAP_SIZE = 1 << 16; // Must be the same as in the coverage tool
+        static constexpr size_t HEADER = 4;
+
+        /// <param name="capacity">Most counters the program can have</param>
+        explicit SharedCoverage(size_t capacity) : capacity(capacity)
         {
-            e = power();
+            id = shmget(IPC_PRIVATE, (capacity + HEADER) * sizeof(uint64_t) + EDGE_MAP_SIZE, IPC_CREAT | IPC_EXCL | 0600);
+            if (id < 0) [[unlikely]]
+                throw std::runtime_error("Cannot create shared memory for the coverage");
+
+            void* address = shmat(id, nullptr, 0);
+            // Removed right away, Linux still lets the programs attach it and it disappears with the last one attached, even if the fuzzer is killed
+            shmctl(id, IPC_RMID, nullptr);
+            if (address == (void*)-1) [[unlikely]]
+                throw std::runtime_error("Cannot map shared memory for the coverage");
+            map = static_cast<uint64_t*>(address);
         }
-        virtual ~seedSimple() = default;
-    };
 
-    struct seedBoosted : public seed
-    {
-        const coveragePath& h; //hash of the output
+        SharedCoverage(const SharedCoverage&) = delete;
+        SharedCoverage& operator=(const SharedCoverage&) = delete;
 
         /// <summary>
-        /// Seed for the boosted power method
+        /// Number of counters of the program, zero if it never mapped the segment (e.g. it is not instrumented by this version of the tool)
         /// </summary>
-        /// <param name="input">String that should be associated with this seed</param>
-        /// <param name="h">Path that is executed when this seed is run</param>
-        seedBoosted(std::string input, const coveragePath& h) : seed(std::move(input)), h(h)
-        {
-        }
-
-        double power(const std::unordered_map<coveragePath, size_t>& hashmap) const
+        size_t size() const
         {
-            return 1.0 / std::pow(hashmap.at(h), 5);
+            return std::min<size_t>(map[0], capacity);
         }
 
-        virtual void incrementSelected() override final
+        /// <summary>
+        /// Number of the counters that are of lines, the first ones. The others (split comparisons) only tell paths apart, they are not in the coverage percentage and the LCOV report.
+        /// </summary>
+        size_t lines() const
         {
-            // Do nothing
+            return std::min<size_t>(map[3], size());
         }
 
-        virtual void incrementImproved() override final
+        /// <summary>
+        /// Bytes of a line counter, 1 (saturating at 255) or 8
+        /// </summary>
+        size_t counterBytes() const
         {
-            // Do nothing
+            return map[2] == 1 ? 1 : sizeof(uint64_t);
         }
 
-        virtual void update() override final
+        /// <summary>
+        /// Call a function with the line counters, a span of uint8_t or uint64_t depending on the instrumentation
+        /// </summary>
+        template <typename F>
+        decltype(auto) withCounters(F&& f) const
         {
-            // Do nothing (will be done when selecting)
+            if (counterBytes() == 1)
+                return f(std::span<const uint8_t>(lineMap(), size()));
+            return f(std::span<const uint64_t>(reinterpret_cast<const uint64_t*>(lineMap()), size()));
         }
-        virtual ~seedBoosted() = default;
-    };
 
-    struct powerStructure
-    {
         /// <summary>
-        /// Add new seed into the queue
+        /// Edge map, empty if the program records only lines
         /// </summary>
-        /// <param name="input">String that was fuzzed and should be recorded</param>
-        /// <param name="h">Associated output path from the program</param>
-        /// <param name="T">Runtime for this input</param>
-        /// <param name="nm">How many times it was selected</param>
-        /// <param name="nc">How many times it led to increased coverage</param>
-        virtual void add(std::string input, const coveragePath& h, double T, size_t nm = 1, size_t nc = 1) = 0;
+        std::span<const uint8_t> edges() const
+        {
+            return { edgeMap(), std::min<size_t>(map[1], EDGE_MAP_SIZE) };
+        }
 
         /// <summary>
-        /// Size of the queue
+        /// Clear the counters before the next execution, known ones are set to 255 instead
         /// </summary>
-        virtual size_t size() const = 0;
+        /// <param name="known">Value of every line counter and edge before an execution (learn), empty if nothing is pruned</param>
+        void reset(std::span<const uint8_t> known = {})
+        {
+            if (!known.empty())
+            {
+                std::memcpy(lineMap(), known.data(), known.size());
+                return;
+            }
+            std::memset(lineMap(), 0, size() * counterBytes());
+            std::memset(edgeMap(), 0, edges().size());
+        }
 
         /// <summary>
-        /// Retrives seed at given index
+        /// Mark the 8-bit counters and edges hit by the last execution as known (FuzzerSettings::pruneProbes). Probes of known ones stop at 255 in the next executions.
         /// </summary>
-        /// <param name="n">Index</param>
-        /// <returns>Constant reference to the element</returns>
-        virtual const seed& at(size_t n) = 0;
+        /// <param name="known">Known counters and edges of all workers, 255 for the known ones</param>
+        /// <returns>Number of known counters and edges</returns>
+        size_t learn(std::vector<uint8_t>& known) const
+        {
+            if (counterBytes() != 1)
+                return 0;
+            std::span<const uint8_t> current(lineMap(), size() + edges().size());
+            if (known.size() != current.size())
+                known.assign(current.size(), 0);
+            size_t count = 0;
+            for (size_t i = 0; i < current.size(); i++)
+            {
+                known[i] |= current[i] != 0 ? 0xFF : 0;
+                count += known[i] & 1;
+            }
+            return count;
+        }
 
         /// <summary>
-        /// Perform a weighted random choice and borrow the seed, expecting to return it
+        /// Clear the buckets of known counters (edges if the program has them), whose 255 tells nothing about the execution
         /// </summary>
-        /// <returns>Reference to the selected seed</returns>
-        virtual seed& weightedRandomChoiceBorrow() = 0;
+        /// <param name="known">Known counters and edges (learn)</param>
+        /// <returns>Whether the execution hit anything not known yet</returns>
+        bool forgetKnown(std::span<uint8_t> classified, std::span<const uint8_t> known) const
+        {
+            const size_t offset = edges().empty() ? 0 : size();
+            const size_t count = std::min(classified.size(), known.size() > offset ? known.size() - offset : 0);
+            // 8 buckets at a time, most of them are zero
+            uint64_t hit = 0;
+            size_t i = 0;
+            for (; i + sizeof(uint64_t) <= count; i += sizeof(uint64_t))
+            {
+                uint64_t current, mask;
+                std::memcpy(&current, classified.data() + i, sizeof(current));
+                if (current == 0) [[likely]]
+                    continue;
+                std::memcpy(&mask, known.data() + offset + i, sizeof(mask));
+                current &= ~mask;
+                std::memcpy(classified.data() + i, &current, sizeof(current));
+                hit |= current;
+            }
+            for (; i < classified.size(); i++)
+            {
+                if (i < count)
+                    classified[i] &= ~known[offset + i];
+                hit |= classified[i];
+            }
+            return hit != 0;
+        }
 
         /// <summary>
-        /// Return borrowed seed (must be done before borrowing a new one!)
+        /// Add the counters of the last execution to the totals of the campaign
         /// </summary>
-        virtual void weightedRandomChoiceReturn() = 0;
-
-        virtual ~powerStructure() = default;
-
-        std::unordered_map<coveragePath, size_t> hashmap;
-    };
-
-    struct powerSimple : public powerStructure
-    {
-        // Currently borrowed seed. Store in in this way to avoid copying.
-        std::pair<std::multiset<seedSimple>::node_type, std::multiset<seedSimple>::const_iterator> borrowed;
-
-    public:
-        void add(std::string input, double T, size_t nm = 1, size_t nc = 1)
-        {
-            queue.emplace(std::move(input), T, nm, nc);
-        }
-        virtual void add(std::string input, const coveragePath& h, double T, size_t nm = 1, size_t nc = 1) override
-        {
-            add(std::move(input), T, nm, nc);
-        }
-        virtual size_t size() const override
-        {
-            return queue.size();
-        }
-        virtual const seed& at(size_t n) override
-        {
-            // Cannot access directly, needs to jump over LL
-            auto it = queue.cbegin();
-            std::advance(it, n);
-            return *it;
+        void accumulate()
+        {
+            withCounters([this](auto current) {
+                if (totalHits.size() < current.size())
+                    totalHits.resize(current.size());
+                // Most counters are zero, the totals are written only for the hit ones
+                for (size_t i = 0; i < current.size(); i++)
+                    if (current[i] != 0)
+                        totalHits[i] += current[i];
+            });
         }
 
-        virtual seed& weightedRandomChoiceBorrow() override
-        {
-            if (!borrowed.first.empty()) [[unlikely]]
-                throw std::runtime_error("Attempted to borrow another seed without returning previous one!");
-
-            // Store the random choice in this structure, and give reference to it
-            borrowed = weightedRandomChoiceExtract();
-            return borrowed.first.value();
-        }
-        virtual void weightedRandomChoiceReturn() override
+        ~SharedCoverage()
         {
-            queue.insert(borrowed.second, std::move(borrowed.first));
+            shmdt(map);
         }
-        virtual ~powerSimple() = default;
+
+        int id = -1;
 
         /// <summary>
-        /// Weighted random choice of a seed, where some portion of best seeds will be given 50% choice be selected
+        /// Hits of every counter in all executions so far
         /// </summary>
-        /// <returns>Selected seed extracted from the queue</returns>
-        std::pair<std::multiset<seedSimple>::node_type, std::multiset<seedSimple>::const_iterator> weightedRandomChoiceExtract()
-        {
-            if (queue.empty()) [[unlikely]]
-                throw std::runtime_error("Queue is empty, cannot choose");
-            else if (queue.size() == 1)
-                return { queue.extract(queue.cbegin()), std::move(queue.cend()) };
-
-            const size_t firstTenPercent = queue.size() * 0.1f;
-            const double coefficientGood = 0.5 / firstTenPercent;
-            const double coefficientWorse = 0.5 / (queue.size() - firstTenPercent);
-
-            std::uniform_real_distribution<> dis(0.0, 1.0); // Range [0, totalWeight)
-
-            // Generate a random number
-            double randomValue = dis(gen);
-
-            // Find the chosen option based on the random value
-            double cumulativeWeight = 0.0;
-
-            size_t i = 0;
-            for (auto it = queue.cbegin(); it != queue.cend(); it++) {
-                if (i <= firstTenPercent)
-                    cumulativeWeight += coefficientGood;// Better score
-                else
-                    cumulativeWeight += coefficientWorse;// Worse score
+        std::vector<uint64_t> totalHits;
 
-                if (randomValue <= cumulativeWeight) {
-                    auto nextIt = it++;
-                    return { queue.extract(it), std::move(nextIt) };
-                }
-                i++;
-            }
+    private:
+        uint8_t* lineMap() const
+        {
+            return reinterpret_cast<uint8_t*>(map + HEADER);
+        }
 
-            // If we get here, there was an issue (e.g., no options, weights not positive)
-            throw std::runtime_error("Failed to select a weighted random choice.");
+        uint8_t* edgeMap() const
+        {
+            return lineMap() + size() * counterBytes();
         }
 
-        std::multiset<seedSimple> queue;
+        uint64_t* map = nullptr;
+        const size_t capacity;
     };
 
-    struct powerBoosted : public powerStructure
+    /// <summary>
+    /// Shared memory of every worker, empty if the coverage is read from files
+    /// </summary>
+    std::vector<std::unique_ptr<SharedCoverage>> sharedCoverage;
+
+    /// <summary>
+    /// Table of the comparisons of the program of one worker (cmpLog::Table), in a SysV shared memory segment that the instrumented program maps (its id is passed in FUZZ_CMPLOG_SHM)
+    /// </summary>
+    struct SharedCmpLog
     {
-        bool isBorrowed = false;
-
-        void add(std::string input, const coveragePath& h)
-        {
-            if(isBorrowed) [[unlikely]]
-                throw std::logic_error("Cannot add to queue with borrowed element"); // Else it could cause reallocation of vector memory and this damned bug would be so difficult to find that you would spend your whole day finding it and not doing anythine else ask me how I know
-            queue.emplace_back(std::move(input), h);
-        }
-        virtual void add(std::string input, const coveragePath& h, double T, size_t nm = 1, size_t nc = 1) override
-        {
-            add(std::move(input), h);
-        }
-        virtual size_t size() const override
+        SharedCmpLog()
         {
-            return queue.size();
+            id = shmget(IPC_PRIVATE, sizeof(cmpLog::Table), IPC_CREAT | IPC_EXCL | 0600);
+            if (id < 0) [[unlikely]]
+                throw std::runtime_error("Cannot create shared memory for the comparisons");
+
+            void* address = shmat(id, nullptr, 0);
+            shmctl(id, IPC_RMID, nullptr);
+            if (address == (void*)-1) [[unlikely]]
+                throw std::runtime_error("Cannot map shared memory for the comparisons");
+            table = static_cast<cmpLog::Table*>(address);
         }
 
-        virtual const seed& at(size_t n) override
+        SharedCmpLog(const SharedCmpLog&) = delete;
+        SharedCmpLog& operator=(const SharedCmpLog&) = delete;
+
+        /// <summary>
+        /// Log the comparisons of the next execution
+        /// </summary>
+        void start()
         {
-            return queue.at(n);
+            table->count = 0;
+            table->enabled = 1;
         }
 
-        virtual seed& weightedRandomChoiceBorrow() override
+        void stop()
         {
-            isBorrowed = true;
-            return weightedRandomChoice();
+            table->enabled = 0;
         }
 
-        virtual void weightedRandomChoiceReturn() override
+        /// <summary>
+        /// The program mapped the table, so it logs its comparisons
+        /// </summary>
+        bool mapped() const
         {
-            isBorrowed = false;
+            return table->mapped != 0;
         }
-        virtual ~powerBoosted() = default;
 
         /// <summary>
-        /// Weighted random choice of a seed
+        /// Comparisons logged since start, whose operands differed
         /// </summary>
-        /// <returns>Reference to the selected seed</returns>
-        virtual seed& weightedRandomChoice()
+        std::span<const cmpLog::Entry> entries() const
         {
-            if (queue.empty()) [[unlikely]]
-                throw std::runtime_error("Queue is empty, cannot choose");
-
-            // Calculate the total weight
-            double totalWeight = 0.0;
-            for (const auto& option : queue)
-                totalWeight += option.power(hashmap);
-
-            std::uniform_real_distribution<> dis(0.0, totalWeight); // Range [0, totalWeight)
+            return { table->entries, std::min<size_t>(table->count, cmpLog::ENTRIES) };
+        }
 
-            // Generate a random number
-            double randomValue = dis(gen);
+        ~SharedCmpLog()
+        {
+            shmdt(table);
+        }
 
-            // Find the chosen option based on the random value
-            double cumulativeWeight = 0.0;
+        int id = -1;
 
-            for (auto& i : queue)
-            {
-                cumulativeWeight += i.power(hashmap);
-                if (randomValue <= cumulativeWeight)
-                    return i;
-            }
+    private:
+        cmpLog::Table* table = nullptr;
+    };
 
-            // If we get here, there was an issue (e.g., no options, weights not positive)
-            throw std::runtime_error("Failed to select a weighted random choice.");
-        }
+    /// <summary>
+    /// Comparisons of every worker, empty without input-to-state replacement
+    /// </summary>
+    std::vector<std::unique_ptr<SharedCmpLog>> cmpLogs;
+#endif
 
-        std::vector<seedBoosted> queue;
-    };
+    /// <summary>
+    /// Program of the worker logs its comparisons: it was instrumented with --cmplog and already mapped the table in an execution
+    /// </summary>
+    bool hasCmpLog(size_t worker) const
+    {
+#ifndef _MSC_VER
+        return worker < cmpLogs.size() && cmpLogs[worker] && cmpLogs[worker]->mapped();
+#else
+        return false;
+#endif
+    }
 
     /// <summary>
-    /// Joins random number of seeds together, possible with delimiters
+    /// Clear the coverage of a worker before its program runs
     /// </summary>
-    /// <param name="input"></param>
-    void createMashups(std::string& input)
+    void resetCoverage(size_t worker)
     {
-        std::exponential_distribution<float> distVal(0.5);
-        size_t mashups = 1 + round(distVal(gen));
-        for (size_t i = 0; i < mashups; i++)
+#ifndef _MSC_VER
+        if (worker < sharedCoverage.size() && sharedCoverage[worker])
         {
-            switch (generators::randomInt(6))
-            {
-            case 0:
-                input += '\n';
-                break;
-            case 1:
-                input += generators::randomDigit();
-                break;
-            case 2:
-                input += generators::randomASCII();
-                break;
-            case 3:
-            case 4:
-            case 5:
+            if (pruneProbes())
             {
-                input += queue->at(generators::randomInt(queue->size())).input;
-            } break;
-
-            default:
-                UNREACHABLE;
+                std::lock_guard lock(queueMutex);
+                sharedCoverage[worker]->reset(known);
             }
+            else
+                sharedCoverage[worker]->reset();
         }
+#endif
     }
 
     /// <summary>
-    /// Perform generation of a new mutant. Given the chance from the constructor, also splice/join multiple existing seeds together.
+    /// Hit counts of the last execution of every worker, classified into buckets (edges if the program has them, otherwise lines)
     /// </summary>
-    /// <param name="input"></param>
-    /// <returns></returns>
-    std::string randomNumberOfRandomMutants(std::string input)
-    {
-        if (generators::randomFloat() < concatenatedness)
-            createMashups(input); // Perform joining
-        else
-            mutators::randomNumberOfRandomMutants(input); // Perform mutation
+    std::vector<std::vector<uint8_t>> buckets;
 
-        return input;
-    }
+    /// <summary>
+    /// Hit counts of the lines of the last execution of every worker, when read from a file
+    /// </summary>
+    std::vector<std::vector<uint64_t>> lineHits;
 
-    virtual void exportStatistics(std::ostream& out) override
+    /// <summary>
+    /// Slots of the lines in LCOV reports, the same for all workers
+    /// </summary>
+    LcovParser lcovParser;
+
+    /// <summary>
+    /// Buckets seen by all workers so far, guarded by queueMutex
+    /// </summary>
+    VirginMap virgin;
+
+    /// <summary>
+    /// Value of every 8-bit line counter and edge before an execution of any worker, 255 if known, empty if nothing is pruned (pruneProbes). Guarded by queueMutex.
+    /// </summary>
+    std::vector<uint8_t> known;
+
+    /// <summary>
+    /// Number of known line counters and edges, guarded by queueMutex
+    /// </summary>
+    size_t prunedProbes = 0;
+
+    /// <summary>
+    /// Whether the coverage of the campaign is exported at the end (FuzzerSettings::lcovExport), which is done only for programs with their own LCOV report
+    /// </summary>
+    bool exportsLcov() const
     {
-        out << '{';
-        exportStatisticsCommon(out);
-        out << ",\"nb_queued_seed\":" << queue->size() << ",";
-        out << "\"coverage\":" << bestCoverage * 100 << ",";
-        out << "\"nb_unique_hash\":" << queue->hashmap.size();
-        out << '}';
+        return settings.lcovExport && !settings.sanitizerCoverage && !settings.testOneInput;
     }
-    virtual void exportReport(const CrashReport& report, std::ostream& out) const override
+
+    /// <summary>
+    /// Whether probes of known counters are pruned (FuzzerSettings::pruneProbes). Not when the coverage is exported, since the hits of a pruned probe are lost.
+    /// </summary>
+    bool pruneProbes() const
     {
-        out << '{';
-        exportReportCommon(report, out);
-        out << ",\"coverage\":" << bestCoverage * 100;
-        out << '}';
+        return settings.pruneProbes && !exportsLcov();
     }
 
     /// <summary>
-    /// Get line from the input, split by the delimiter
+    /// Distances of the line counters from the targets (FuzzerSettings::distances), negative for the ones that do not lead to them. Empty when not directed.
     /// </summary>
-    /// <param name="str">String to read from. Will be eaten</param>
-    /// <param name="delimiter">Delimiter to read line to. Will be removed from input</param>
-    /// <returns>Read line, without delimiter</returns>
-    static std::string_view getLine(std::string_view& str, char delimiter='\n')
+    std::vector<int> counterDistances;
+
+    /// <summary>
+    /// Distance of the last execution of every worker from the targets (seedDistance), sized by prepareWorker before the workers start
+    /// </summary>
+    std::vector<double> seedDistances;
+
+    /// <summary>
+    /// Distance of an execution from the targets: the mean distance of the lines it hit that lead to them, negative if none does
+    /// </summary>
+    template <typename T>
+    double seedDistance(std::span<const T> counters) const
     {
-        size_t i = 0;
-        for (; i < str.size(); ++i)
+        double sum = 0;
+        size_t count = 0;
+        for (size_t i = 0; i < std::min(counters.size(), counterDistances.size()); i++)
         {
-            if (str[i] == delimiter)
-                break;
+            if (counters[i] != 0 && counterDistances[i] >= 0)
+            {
+                sum += counterDistances[i];
+                count++;
+            }
         }
-        auto res = str.substr(0, i);
-        if (i >= str.size())
-            str = "";
-        else
-            str = str.substr(i + 1);
-        return res;
+        return count == 0 ? -1 : sum / count;
     }
 
     /// <summary>
-    /// Reads coverage percentage from a input
+    /// Read the coverage of the last execution of a worker, from its shared memory if the program mapped it, otherwise from the file it wrote.
+    /// Its hit counts are classified into buckets of the worker.
     /// </summary>
-    static std::pair<double, coveragePath> coverage(const std::string& lcov)
+    /// <returns>Nothing if the program did not produce any coverage (error etc.)</returns>
+    std::optional<std::pair<double, coveragePath>> readCoverage(size_t worker)
     {
-        std::pair<double, coveragePath> res;
-        std::string_view str(lcov);
-        size_t covered = 0;
-
-        //Read lines until name of the file is present. (This is probably just for our coverage tool)
-        while (true)
-        {
-            while (!getLine(str).starts_with("SF:"))
+        if (buckets.size() <= worker)
+            buckets.resize(worker + 1);
+        if (lineHits.size() <= worker)
+            lineHits.resize(worker + 1);
+        auto& classified = buckets[worker];
+        seedDistances[worker] = -1;
+
+#ifndef _MSC_VER
+        if (worker < sharedCoverage.size() && sharedCoverage[worker] && sharedCoverage[worker]->size() > 0)
+        {
+            auto& shared = *sharedCoverage[worker];
+            shared.accumulate();
+            double ratio = shared.withCounters([&](auto counters) {
+                // Pruned counters of known lines stay at 255, they tell nothing about this execution
+                if (!pruneProbes())
+                    seedDistances[worker] = seedDistance(counters);
+                if (shared.edges().empty())
+                {
+                    classified.resize(counters.size());
+                    hitBuckets::classify(counters, classified);
+                }
+                return coveredRatio(counters.first(shared.lines()));
+            });
+            if (!shared.edges().empty())
             {
-                if (str.empty())
-                    goto foundEverything;
+                classified.resize(shared.edges().size());
+                hitBuckets::classify(shared.edges(), classified);
             }
-
-            while (str.starts_with("DA:"))
+            if (pruneProbes())
             {
-                getLine(str, ','); // Eat up to the comma
-                std::string_view numStr = getLine(str, '\n'); // Get the number
-                size_t countHit;
-                std::from_chars(numStr.data(), numStr.data() + numStr.size(), countHit); // Parse number
-                res.second.push_back(countHit > 0);
-                if (countHit > 0)
-                    covered++;
+                // Nothing to learn from an execution that hit only known ones, which is most of them
+                std::lock_guard lock(queueMutex);
+                if (shared.forgetKnown(classified, known))
+                    prunedProbes = shared.learn(known);
             }
+            return std::pair(ratio, pathId::hash(classified));
         }
-        foundEverything:
-
-        size_t total = res.second.size();
+#endif
+        classified.clear();
+        const auto coverageFile = coverageFileOf(worker);
+        if (!std::filesystem::exists(coverageFile))
+            return {};
 
-        res.first = static_cast<double>(covered) / total;
+        auto content = loadFile(coverageFile);
+        std::filesystem::remove(coverageFile);
+        auto& hits = lineHits[worker];
+        std::vector<uint8_t> edges;
+        size_t lines;
+        // Lines of an LCOV report are not in the order of the counters, so they have no distance
+        if (binaryCoverage(content, hits, edges, lines))
+            seedDistances[worker] = seedDistance(std::span<const uint64_t>(hits));
+        else
+        {
+            lcovParser.parse(content, hits);
+            lines = hits.size();
+        }
 
-        return res;
+        if (edges.empty())
+        {
+            classified.resize(hits.size());
+            hitBuckets::classify(std::span<const uint64_t>(hits), classified);
+        }
+        else
+        {
+            classified.resize(edges.size());
+            hitBuckets::classify(edges, classified);
+        }
+        return std::pair(coveredRatio(std::span<const uint64_t>(hits).first(lines)), pathId::hash(classified));
     }
 
     /// <summary>
@@ -1772,38 +3712,42 @@ struct fuzzer_greybox : public fuzzer
     /// <param name="parent">Seed that the mutant was taken from, nullptr if orphan (initial seed)</param>
     /// <param name="mutant">Mutant to run on</param>
     /// <typeparam name="alwaysInsert">Always insert in the queue, even if no improvement occurs</param>
+    /// <returns>Whether the mutant reached something new</returns>
     template <bool alwaysInsert = false>
-    void trySeed(seed * parent, std::string mutant)
+    bool trySeed(ExecutionInput& executionInput, size_t worker, seed * parent, std::string mutant)
     {
         // Prepare input for execution
-        executionInput->setInput(mutant);
+        executionInput.setInput(mutant);
+        resetCoverage(worker);
 
         // Execute the actual program
-        auto res = execute_with_timeout(*executionInput);
+        auto res = execute_with_timeout(executionInput);
 
-        // Check whether error occured, record it and minimize
-        auto error = dealWithResult(mutant, res, *executionInput, false);
-
-        // Load coverage from file
+        // Load coverage, before minimization runs the program again
         double executedCoveragePercent = 0;
-        coveragePath executedCoveragePath;
-        if (std::filesystem::exists(COVERAGE_FILE)) //Sometimes no coverage file is available (error etc.)
+        coveragePath executedCoveragePath = 0;
+        if (auto tmp = readCoverage(worker)) //Sometimes no coverage is available (error etc.)
         {
-            auto lcov = loadFile(COVERAGE_FILE);
-            std::filesystem::remove(COVERAGE_FILE);
-
-            auto tmp = coverage(lcov);
-
-            executedCoveragePercent = std::move(tmp.first);
-            executedCoveragePath = std::move(tmp.second);
+            executedCoveragePercent = std::move(tmp->first);
+            executedCoveragePath = std::move(tmp->second);
         }
         // else use empty path (for errors)
 
+        // Check whether error occured, record it and minimize
+        auto error = dealWithResult(mutant, res, executionInput, false);
+
+        std::lock_guard lock(queueMutex);
+
         // Insert it into hashtable
-        auto it = queue->hashmap.emplace(std::move(executedCoveragePath), 0);
+        auto it = queue->hashmap.emplace(executedCoveragePath, 0);
         it.first->second++;;
         const auto& recordedCoveragePath = it.first->first;
-        bool foundNewPath = it.second; // If this created a new element in the table
+
+        if (settings.pathCollisionCheck)
+            checkPathCollision(executedCoveragePath, buckets[worker]);
+
+        // Interesting if it reached a line (edge) or a number of its hits that was not seen before
+        bool foundNewPath = virgin.update(buckets[worker]) != VirginMap::Novelty::none;
 
         // If this mutant has a parent
         if (parent != nullptr)
@@ -1819,7 +3763,7 @@ struct fuzzer_greybox : public fuzzer
 
         // Add new interesting seed (crashing)
         if (alwaysInsert || foundNewPath)
-            queue->add(std::move(mutant), recordedCoveragePath, res.execution_time.count(), 1, 1);
+            queue->add(std::move(mutant), recordedCoveragePath, res.execution_time.count(), 1, 1, seedDistances[worker]);
 
         // Improve coverage score (if it wasn't error)
         if (!error && executedCoveragePercent > bestCoverage)
@@ -1827,22 +3771,184 @@ struct fuzzer_greybox : public fuzzer
             std::cerr << "Just improved coverage! From " << bestCoverage << " to " << executedCoveragePercent << ". nb_runs=" << statisticsExecution.count() << std::endl;
             bestCoverage = executedCoveragePercent;
         }
+        return foundNewPath;
+    }
+
+    /// <summary>
+    /// Input-to-state replacement (Redqueen): run a seed with the operands of the comparisons of the program logged, then try it with one operand replaced by the other where the seed contains it.
+    /// Solves a comparison with a magic number or string in a few executions, that random mutations would hardly ever hit.
+    /// </summary>
+    void inputToState(ExecutionInput& executionInput, size_t worker, const std::string& input)
+    {
+#ifndef _MSC_VER
+        auto& log = *cmpLogs[worker];
+        // Like any other execution, it may crash or reach something new (the program can be nondeterministic)
+        log.start();
+        trySeed(executionInput, worker, nullptr, input);
+        log.stop();
+        cmpLogExecutions++;
+
+        cmpLog::InputToState replaced(input, settings.cmpLogMutants, isJsonAllowedOrEscapeable);
+        for (const auto& entry : log.entries())
+            replaced.add(entry);
+
+        cmpLogMutants += replaced.size();
+        for (auto& mutant : replaced.mutants)
+        {
+            if (!keepRunning)
+                break;
+            if (trySeed(executionInput, worker, nullptr, std::move(mutant)))
+                cmpLogNewPaths++;
+        }
+#endif
+    }
+
+    /// <summary>
+    /// Executions with the comparisons logged, mutants made by input-to-state replacement and how many of them reached something new
+    /// </summary>
+    std::atomic<size_t> cmpLogExecutions = 0;
+    std::atomic<size_t> cmpLogMutants = 0;
+    std::atomic<size_t> cmpLogNewPaths = 0;
+
+    /// <summary>
+    /// Compare the classified map of a path with the one first seen with its identifier (FuzzerSettings::pathCollisionCheck)
+    /// </summary>
+    void checkPathCollision(coveragePath path, const std::vector<uint8_t>& classified)
+    {
+        auto it = pathMaps.try_emplace(path, classified);
+        if (!it.second && it.first->second != classified) [[unlikely]]
+        {
+            if (pathCollisions++ == 0)
+                std::cerr << "Two different paths have the same identifier " << path << std::endl;
+        }
     }
 
+    /// <summary>
+    /// Classified map of every path, kept only to check the identifiers for collisions
+    /// </summary>
+    std::unordered_map<coveragePath, std::vector<uint8_t>> pathMaps;
+    size_t pathCollisions = 0;
+
     std::unique_ptr<powerStructure> queue;
-    double bestCoverage = 0;
+    std::atomic<double> bestCoverage = 0;
+
+    /// <summary>
+    /// Guards the queue with its hashmap, shared by all workers
+    /// </summary>
+    std::mutex queueMutex;
+
+    /// <summary>
+    /// Where the program of a worker writes its coverage
+    /// </summary>
+    std::filesystem::path coverageFileOf(size_t worker) const
+    {
+        if (worker == 0)
+            return COVERAGE_FILE;
+        return COVERAGE_FILE.string() + '.' + std::to_string(worker);
+    }
+
+    static constexpr const char* COVERAGE_FILE_ENV = "FUZZ_COVERAGE_FILE"; // Must be the same as in the coverage tool
+
+    virtual void prepareWorker(ExecutionInput& executionInput, size_t worker) override
+    {
+        fuzzer::prepareWorker(executionInput, worker);
+        executionInput.environment[COVERAGE_FILE_ENV] = coverageFileOf(worker).string();
+        if (settings.binaryCoverage)
+            executionInput.environment[COVERAGE_FORMAT_ENV] = COVERAGE_FORMAT_BINARY;
+        if (buckets.size() <= worker)
+            buckets.resize(worker + 1);
+        if (lineHits.size() <= worker)
+            lineHits.resize(worker + 1);
+        if (seedDistances.size() <= worker)
+            seedDistances.resize(worker + 1);
+
+#ifndef _MSC_VER
+        // In-process harness is not started with an environment, its runtime maps the segment named in the environment of the fuzzer
+        if (settings.sharedCoverage && (!settings.testOneInput || settings.mapCoverage))
+        {
+            if (sharedCoverage.size() <= worker)
+                sharedCoverage.resize(worker + 1);
+            sharedCoverage[worker] = std::make_unique<SharedCoverage>(settings.coverageMapSize);
+            executionInput.environment[SharedCoverage::COVERAGE_SHM_ENV] = std::to_string(sharedCoverage[worker]->id);
+            if (settings.testOneInput)
+            {
+                setenv(SharedCoverage::COVERAGE_SHM_ENV, std::to_string(sharedCoverage[worker]->id).c_str(), 1);
+                settings.mapCoverage();
+            }
+
+            if (settings.cmpLog && !settings.sanitizerCoverage && !settings.testOneInput)
+            {
+                if (cmpLogs.size() <= worker)
+                    cmpLogs.resize(worker + 1);
+                cmpLogs[worker] = std::make_unique<SharedCmpLog>();
+                executionInput.environment[cmpLog::SHM_ENV] = std::to_string(cmpLogs[worker]->id);
+            }
+        }
+#endif
+    }
+
+    virtual void finish() override
+    {
+#ifndef _MSC_VER
+        if (!exportsLcov() || sharedCoverage.empty() || !sharedCoverage[0] || sharedCoverage[0]->totalHits.empty())
+            return;
+
+        std::vector<uint64_t> hits;
+        for (const auto& i : sharedCoverage)
+        {
+            if (!i)
+                continue;
+            if (hits.size() < i->totalHits.size())
+                hits.resize(i->totalHits.size());
+            for (size_t j = 0; j < i->totalHits.size(); j++)
+                hits[j] += i->totalHits[j];
+        }
+
+        // Without the shared memory, the program writes the files and lines of the report, in the order of the counters
+        auto path = std::filesystem::absolute(RESULT_FUZZ / "coverage.lcov");
+        auto input = createExecutionInput(0);
+        input->environment = executionInput->environment;
+        input->environment.erase(SharedCoverage::COVERAGE_SHM_ENV);
+        input->environment.erase(cmpLog::SHM_ENV);
+        input->environment.erase(COVERAGE_FORMAT_ENV);
+        input->environment[COVERAGE_FILE_ENV] = path.string();
+        input->setInput("");
+        execute_in_new_process(*input);
+
+        if (!std::filesystem::exists(path))
+        {
+            std::cerr << "Program did not write its coverage, cannot export it" << std::endl;
+            return;
+        }
+        auto lcov = fillLcov(loadFile(path), hits);
+        std::ofstream(path) << lcov;
+        std::cerr << "Coverage of the campaign exported to " << path << std::endl;
+#endif
+    }
 
-    virtual void fuzz() override
+    virtual void prepare(ExecutionInput& executionInput) override
     {
         // Run for initial seeds without mutating
         std::cerr << "Executing on empty input to set a coverage" << std::endl;
-        executionInput->setInput("");
-        execute_with_timeout(*executionInput);
-        if (std::filesystem::exists(COVERAGE_FILE))
-        {
-            auto lcov = loadFile(COVERAGE_FILE);
-            std::filesystem::remove(COVERAGE_FILE);
-            bestCoverage = coverage(lcov).first;
+        virgin.limit = settings.mapLimit;
+        if (settings.pruneProbes && !pruneProbes())
+            std::cerr << "Probes are not pruned, the exported coverage needs all their hits (FUZZ_EXPORT_LCOV=0 to prune them)" << std::endl;
+        if (!settings.distances.empty())
+        {
+            std::ifstream in(settings.distances);
+            if (!in)
+                throw std::runtime_error("Cannot open the distances of the counters");
+            for (int distance; in >> distance; )
+                counterDistances.push_back(distance);
+            std::cerr << "Loaded distances of " << counterDistances.size() << " counters" << std::endl;
+        }
+        executionInput.setInput("");
+        resetCoverage(0);
+        execute_with_timeout(executionInput);
+        if (auto tmp = readCoverage(0))
+        {
+            bestCoverage = tmp->first;
+            virgin.update(buckets[0]);
         }
         std::cerr << "Initial coverage set to " << bestCoverage << std::endl;
 
@@ -1861,7 +3967,7 @@ struct fuzzer_greybox : public fuzzer
                     if (!isJsonAllowedOrEscapeable(c))
                         goto containsEscapes;
 
-                trySeed<true>(nullptr, std::move(input));
+                trySeed<true>(executionInput, 0, nullptr, std::move(input));
 
             containsEscapes:
                 while (0);
@@ -1870,19 +3976,39 @@ struct fuzzer_greybox : public fuzzer
         std::cerr << "Loaded " << queue->size() << " seeds." << std::endl;
 
         std::cerr << "Mutating..." << std::endl;
+    }
+
+    virtual void fuzz(ExecutionInput& executionInput, size_t worker) override
+    {
         while (keepRunning)
         {
-            // Make this a hybrid between greybox and blackbox fuzzing. Sometimes, instead of a mutating existing seed, test random input - if working, add it as seed.
-            if (generators::randomFloat() < greyness)
-            {
-                trySeed(nullptr, generators::generateRandomInput());
-            }
-            else
+            seed* selected = nullptr;
+            std::string mutant;
+            bool replaceOperands = false;
             {
-                auto& selected = queue->weightedRandomChoiceBorrow();
-                selected.incrementImproved();
-                trySeed(&selected, randomNumberOfRandomMutants(selected.input));
+                std::lock_guard lock(queueMutex);
+
+                // Make this a hybrid between greybox and blackbox fuzzing. Sometimes, instead of a mutating existing seed, test random input - if working, add it as seed.
+                // Queue can also be empty when the other workers borrowed all the seeds.
+                if (queue->size() == 0 || generators::randomFloat() < greyness)
+                {
+                    mutant = generators::generateRandomInput();
+                }
+                else
+                {
+                    selected = &queue->weightedRandomChoiceBorrow();
+                    selected->incrementImproved();
+                    mutant = randomNumberOfRandomMutants(selected->input);
+                    if (selected->cmpLogDone || !hasCmpLog(worker))
+                        replaceOperands = false;
+                    else
+                        replaceOperands = selected->cmpLogDone = true;
+                }
             }
+            // Seed is borrowed, no other worker touches it until trySeed returns it
+            if (replaceOperands)
+                inputToState(executionInput, worker, selected->input);
+            trySeed(executionInput, worker, selected, std::move(mutant));
         }
     }
 
@@ -1902,7 +4028,7 @@ struct fuzzer_greybox : public fuzzer
         }
     }
 
-    fuzzer_greybox(std::filesystem::path FUZZED_PROG, std::filesystem::path RESULT_FUZZ, bool MINIMIZE, std::string_view INPUT, std::chrono::seconds TIMEOUT, size_t NB_KNOWN_BUGS, POWER_SCHEDULE_T POWER_SCHEDULE, std::filesystem::path COVERAGE_FILE, float greyness, float concatenatedness, std::filesystem::path INPUT_SEEDS) : fuzzer(std::move(FUZZED_PROG), std::move(RESULT_FUZZ), std::move(MINIMIZE), std::move(INPUT), std::move(TIMEOUT), std::move(NB_KNOWN_BUGS)), POWER_SCHEDULE(std::move(POWER_SCHEDULE)), COVERAGE_FILE(std::move(COVERAGE_FILE)), INPUT_SEEDS(std::move(INPUT_SEEDS)), greyness(std::move(greyness)), concatenatedness(std::move(concatenatedness))
+    fuzzer_greybox(std::filesystem::path FUZZED_PROG, std::filesystem::path RESULT_FUZZ, bool MINIMIZE, std::string_view INPUT, std::chrono::seconds TIMEOUT, size_t NB_KNOWN_BUGS, POWER_SCHEDULE_T POWER_SCHEDULE, std::filesystem::path COVERAGE_FILE, float greyness, float concatenatedness, std::filesystem::path INPUT_SEEDS, FuzzerSettings settings = {}) : fuzzer(std::move(FUZZED_PROG), std::move(RESULT_FUZZ), std::move(MINIMIZE), std::move(INPUT), std::move(TIMEOUT), std::move(NB_KNOWN_BUGS), std::move(settings)), POWER_SCHEDULE(std::move(POWER_SCHEDULE)), COVERAGE_FILE(std::move(COVERAGE_FILE)), INPUT_SEEDS(std::move(INPUT_SEEDS)), greyness(std::move(greyness)), concatenatedness(std::move(concatenatedness))
     {
         switch (POWER_SCHEDULE)
         {
@@ -1912,12 +4038,15 @@ struct fuzzer_greybox : public fuzzer
         case fuzzer_greybox::POWER_SCHEDULE_T::boosted:
             queue = std::make_unique<powerBoosted>();
             break;
+        case fuzzer_greybox::POWER_SCHEDULE_T::directed:
+            queue = std::make_unique<powerDirected>(this->TIMEOUT * this->settings.directedExploitation);
+            break;
         default:
             UNREACHABLE;
         }
     }
 
-    fuzzer_greybox(std::filesystem::path FUZZED_PROG, std::filesystem::path RESULT_FUZZ, bool MINIMIZE, std::string_view INPUT, std::chrono::seconds TIMEOUT, size_t NB_KNOWN_BUGS, POWER_SCHEDULE_T POWER_SCHEDULE, std::filesystem::path COVERAGE_FILE, float greyness, float concatenatedness) : fuzzer_greybox(std::move(FUZZED_PROG), std::move(RESULT_FUZZ), std::move(MINIMIZE), std::move(INPUT), std::move(TIMEOUT), std::move(NB_KNOWN_BUGS), std::move(POWER_SCHEDULE), std::move(COVERAGE_FILE), std::move(greyness), std::move(concatenatedness), "MY_SEED")
+    fuzzer_greybox(std::filesystem::path FUZZED_PROG, std::filesystem::path RESULT_FUZZ, bool MINIMIZE, std::string_view INPUT, std::chrono::seconds TIMEOUT, size_t NB_KNOWN_BUGS, POWER_SCHEDULE_T POWER_SCHEDULE, std::filesystem::path COVERAGE_FILE, float greyness, float concatenatedness, FuzzerSettings settings = {}) : fuzzer_greybox(std::move(FUZZED_PROG), std::move(RESULT_FUZZ), std::move(MINIMIZE), std::move(INPUT), std::move(TIMEOUT), std::move(NB_KNOWN_BUGS), std::move(POWER_SCHEDULE), std::move(COVERAGE_FILE), std::move(greyness), std::move(concatenatedness), "MY_SEED", std::move(settings))
     {
         populateWithMySeeds();
     }
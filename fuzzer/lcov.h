@@ -0,0 +1,217 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <charconv>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <unordered_map>
+#include <shared_mutex>
+#include <mutex>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+/// <summary>
+/// Call a function for every line of a text, without the line ending (also \r\n). Ends of lines are found by comparing 64 bytes at a time, and a bit mask of them is walked.
+/// </summary>
+template <typename F>
+inline void forEachLine(std::string_view text, F&& f)
+{
+    const char* data = text.data();
+    const size_t size = text.size();
+    size_t lineStart = 0;
+
+    auto line = [&](size_t end) {
+        size_t length = end - lineStart;
+        if (length > 0 && data[end - 1] == '\r')
+            length--;
+        f(std::string_view(data + lineStart, length));
+        lineStart = end + 1;
+    };
+
+    size_t i = 0;
+#if defined(__AVX2__)
+    const auto newline = _mm256_set1_epi8('\n');
+    for (; i + 64 <= size; i += 64)
+    {
+        auto low = _mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i)), newline);
+        auto high = _mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i + 32)), newline);
+        uint64_t mask = static_cast<uint32_t>(_mm256_movemask_epi8(low)) | (static_cast<uint64_t>(static_cast<uint32_t>(_mm256_movemask_epi8(high))) << 32);
+        while (mask != 0)
+        {
+            line(i + static_cast<size_t>(__builtin_ctzll(mask)));
+            mask &= mask - 1;
+        }
+    }
+#endif
+
+    // Rest (or everything without AVX2) by memchr, vectorized by the C library
+    while (lineStart < size)
+    {
+        const size_t from = std::max(i, lineStart);
+        auto end = static_cast<const char*>(std::memchr(data + from, '\n', size - from));
+        if (end == nullptr)
+        {
+            line(size);
+            break;
+        }
+        line(end - data);
+    }
+}
+
+/// <summary>
+/// Parser of LCOV reports, from our coverage tool as well as from gcov (lcov, gcovr) or llvm-cov of builds not instrumented by it.
+/// Every line of every source file gets a slot in the counters the first time it is seen. The slots stay the same for all later reports,
+/// even if they list the files in a different order, leave some files out or list lines that were not seen before (those get new slots at the end).
+/// A line listed more times in one file (e.g. our split counters or inlined functions) gets a slot for each of its entries, told apart by their order.
+/// Can be used by several threads at once.
+/// </summary>
+class LcovParser
+{
+public:
+    /// <summary>
+    /// Read hit counts of all lines of a report
+    /// </summary>
+    /// <param name="report">LCOV report</param>
+    /// <param name="counters">Hits of every slot known so far, zero for lines the report does not mention. Reused between calls to avoid allocations.</param>
+    void parse(std::string_view report, std::vector<uint64_t>& counters)
+    {
+        {
+            std::shared_lock lock(mutex);
+            if (parse<false>(report, counters))
+                return;
+        }
+
+        // Report has files or lines not seen before
+        std::unique_lock lock(mutex);
+        parse<true>(report, counters);
+    }
+
+    /// <summary>
+    /// Number of lines of all files seen so far
+    /// </summary>
+    size_t size() const
+    {
+        std::shared_lock lock(mutex);
+        return slots;
+    }
+
+    /// <summary>
+    /// Number of source files seen so far
+    /// </summary>
+    size_t fileCount() const
+    {
+        std::shared_lock lock(mutex);
+        return files.size();
+    }
+
+private:
+    struct File
+    {
+        std::vector<uint32_t> lines; // In the order of the first report with this file
+        std::vector<uint32_t> slots; // Slot of each of the lines
+        std::vector<uint32_t> occurrences; // How many entries of the same line precede each of the lines
+        std::vector<uint32_t> firsts; // Index of the first entry of the same line, which counts its entries during a parse
+        std::unordered_map<uint64_t, uint32_t> indexOfLine; // By line and occurrence, for reports with lines in a different order
+
+        static uint64_t key(uint32_t line, uint32_t occurrence) { return (static_cast<uint64_t>(occurrence) << 32) | line; }
+    };
+
+    /// <returns>False if the report has something without a slot and extend is false</returns>
+    template <bool extend>
+    bool parse(std::string_view report, std::vector<uint64_t>& counters)
+    {
+        counters.assign(slots, 0);
+        File* file = nullptr;
+        size_t next = 0; // Index of the line expected next in the file
+        bool complete = true;
+        thread_local std::vector<uint32_t> seen; // Entries of each line so far in the file, at the index of its first entry
+
+        forEachLine(report, [&](std::string_view line) {
+            if (line.size() < 3 || line[2] != ':' || !complete)
+                return;
+
+            if (line[0] == 'D' && line[1] == 'A')
+            {
+                if (file == nullptr)
+                    return;
+
+                // DA:<line>,<hits>[,<checksum>]
+                const char* end = line.data() + line.size();
+                uint32_t lineNumber;
+                auto parsed = std::from_chars(line.data() + 3, end, lineNumber);
+                if (parsed.ec != std::errc() || parsed.ptr == end || *parsed.ptr != ',') [[unlikely]]
+                    return;
+                uint64_t hits = 0;
+                std::from_chars(parsed.ptr + 1, end, hits); // Stays 0 for "-" and negative numbers of some gcov versions
+
+                size_t index = next;
+                if (index >= file->lines.size() || file->lines[index] != lineNumber || file->occurrences[index] != seen[file->firsts[index]]) [[unlikely]]
+                {
+                    auto first = file->indexOfLine.find(File::key(lineNumber, 0));
+                    uint32_t occurrence = first != file->indexOfLine.end() ? seen[first->second] : 0;
+                    auto it = occurrence == 0 ? first : file->indexOfLine.find(File::key(lineNumber, occurrence));
+                    if (it != file->indexOfLine.end())
+                        index = it->second;
+                    else if constexpr (extend)
+                    {
+                        index = file->lines.size();
+                        file->lines.push_back(lineNumber);
+                        file->slots.push_back(static_cast<uint32_t>(slots++));
+                        file->occurrences.push_back(occurrence);
+                        file->firsts.push_back(occurrence == 0 ? static_cast<uint32_t>(index) : first->second);
+                        file->indexOfLine.emplace(File::key(lineNumber, occurrence), static_cast<uint32_t>(index));
+                        seen.push_back(0);
+                        counters.resize(slots);
+                    }
+                    else
+                    {
+                        complete = false;
+                        return;
+                    }
+                }
+
+                counters[file->slots[index]] += hits;
+                seen[file->firsts[index]]++;
+                next = index + 1;
+            }
+            else if (line[0] == 'S' && line[1] == 'F')
+            {
+                next = 0;
+                auto name = line.substr(3);
+                auto it = fileIndex.find(name);
+                if (it != fileIndex.end())
+                    file = &files[it->second];
+                else if constexpr (extend)
+                {
+                    fileIndex.emplace(std::string(name), files.size());
+                    file = &files.emplace_back();
+                }
+                else
+                {
+                    complete = false;
+                    return;
+                }
+                seen.assign(file->lines.size(), 0);
+            }
+        });
+
+        return complete;
+    }
+
+    struct StringHash
+    {
+        using is_transparent = void;
+        size_t operator()(std::string_view str) const
+        {
+            return std::hash<std::string_view>{}(str);
+        }
+    };
+
+    std::unordered_map<std::string, size_t, StringHash, std::equal_to<>> fileIndex;
+    std::vector<File> files;
+    size_t slots = 0;
+    mutable std::shared_mutex mutex;
+};
@@ -3,6 +3,9 @@
 #include <queue>
 #include <vector>
 #include <mutex>
+#include <array>
+#include <cmath>
+#include <algorithm>
 
 template <typename T>
 class StreamingMedian {
@@ -43,6 +46,51 @@ public:
     }
 };
 
+/// <summary>
+/// Approximate percentiles from a histogram with logarithmic buckets, four per power of two (values are rounded up by at most 19 %)
+/// </summary>
+template <typename T>
+class StreamingPercentile {
+private:
+    static constexpr int BUCKETS_PER_OCTAVE = 4;
+    static constexpr int MIN_EXPONENT = -32;
+    static constexpr size_t BUCKETS = 64 * BUCKETS_PER_OCTAVE;
+
+    std::array<size_t, BUCKETS> buckets{};
+    size_t count = 0;
+
+    static size_t bucketOf(T num) {
+        if (!(num > 0))
+            return 0;
+        double index = std::ceil((std::log2((double)num) - MIN_EXPONENT) * BUCKETS_PER_OCTAVE);
+        return (size_t)std::clamp(index, 0.0, (double)(BUCKETS - 1));
+    }
+
+public:
+    void addNumber(T num) {
+        buckets[bucketOf(num)]++;
+        count++;
+    }
+
+    /// <summary>
+    /// Smallest bucket bound that at least given fraction of the numbers does not exceed
+    /// </summary>
+    double getPercentile(double fraction) const {
+        if (count == 0) [[unlikely]]
+            return std::numeric_limits<double>::quiet_NaN();
+        size_t target = std::max<size_t>(1, (size_t)std::ceil(fraction * count));
+        size_t seen = 0;
+        size_t i = 0;
+        for (; i < BUCKETS - 1; i++)
+        {
+            seen += buckets[i];
+            if (seen >= target)
+                break;
+        }
+        return std::exp2((double)i / BUCKETS_PER_OCTAVE + MIN_EXPONENT);
+    }
+};
+
 template<typename T>
 inline void update_max(std::atomic<T>& atom, const T& val)
 {
@@ -61,6 +109,7 @@ class StatisticsMemory
     std::atomic<T> _min = std::numeric_limits<T>::max();
     std::atomic<T> _max = std::numeric_limits<T>::min();
     StreamingMedian<T> _median;
+    StreamingPercentile<T> _percentile;
     double currentAverage = 0.0; // Running average
     std::atomic<size_t> _count = 0;
     mutable std::mutex m;
@@ -75,6 +124,7 @@ public:
 
         std::lock_guard lock(m);
         _median.addNumber(num);
+        _percentile.addNumber(num);
         
 
         currentAverage += (num - currentAverage) / myCount; // Incremental average
@@ -105,6 +155,13 @@ public:
         std::lock_guard lock(m);
         return _median.getMedian();
     }
+    double percentile(double fraction) const
+    {
+        if (_count == 0) [[unlikely]]
+            return 0;
+        std::lock_guard lock(m);
+        return _percentile.getPercentile(fraction);
+    }
     size_t count() const
     {
         return _count;
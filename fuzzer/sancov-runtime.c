@@ -0,0 +1,135 @@
+/*
+ * Runtime for programs built by clang with -fsanitize-coverage=trace-pc-guard instead of the coverage tool.
+ * Every guard is a byte counter that stops at 255, kept where the fuzzer expects the line counters of an instrumented program:
+ * in the shared memory named by FUZZ_COVERAGE_SHM (header of four words: number of counters, size of the edge map, bytes of a counter, number of line counters),
+ * or dumped in the binary format to FUZZ_COVERAGE_FILE at exit. It also runs the fork server of the coverage tool.
+ *
+ * Link it into the program, compiled without -fsanitize-coverage:
+ *   clang -c -O2 sancov-runtime.c
+ *   clang -fsanitize=address -fsanitize-coverage=trace-pc-guard -g -O2 *.c sancov-runtime.o -o instr_prog
+ * and fuzz it with FUZZ_SANCOV=1. Constants must be the same as in the coverage tool.
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/shm.h>
+#include <sys/uio.h>
+#include <sys/wait.h>
+
+#define FORKSRV_FD 198
+#define COVERAGE_SHM_ENV "FUZZ_COVERAGE_SHM"
+#define COVERAGE_FILE_ENV "FUZZ_COVERAGE_FILE"
+#define COVERAGE_FORMAT_ENV "FUZZ_COVERAGE_FORMAT"
+#define COVERAGE_FORMAT_BINARY "binary"
+#define COVERAGE_BINARY_MAGIC 0x33564F435A5A5546ull /* "FUZZCOV3" */
+
+/* Counters of the guards, the one of guard i at i - 1. Its own memory until the shared memory is mapped. */
+static unsigned char* _FuzzSancov;
+static uint32_t _FuzzSancovCount;
+static int _FuzzSancovMapped;
+
+/* Called by the module constructor of every instrumented module with its guards, numbers them from 1. Guards of a module loaded after the mapping stay 0 and count nothing. */
+void __sanitizer_cov_trace_pc_guard_init(uint32_t* start, uint32_t* stop)
+{
+    if (start == stop || *start != 0 || _FuzzSancovMapped)
+        return;
+
+    unsigned char* counters = (unsigned char*)realloc(_FuzzSancov, _FuzzSancovCount + (stop - start));
+    if (!counters)
+        return;
+    memset(counters + _FuzzSancovCount, 0, stop - start);
+    _FuzzSancov = counters;
+    for (uint32_t* guard = start; guard < stop; guard++)
+        *guard = ++_FuzzSancovCount;
+}
+
+/* Saturating like the byte probes of the coverage tool, and pruned: a counter the fuzzer set to 255 is only compared */
+void __sanitizer_cov_trace_pc_guard(uint32_t* guard)
+{
+    uint32_t i = *guard;
+    if (i != 0 && _FuzzSancov[i - 1] != 255)
+        _FuzzSancov[i - 1]++;
+}
+
+/* Count into the shared memory of the fuzzer, starting from the hits so far. They are added saturating, so that counters the fuzzer marked as known by 255 stay at it. */
+static void _FuzzSancovMap(void)
+{
+    const char* id = getenv(COVERAGE_SHM_ENV);
+    struct shmid_ds ds;
+    if (!id || _FuzzSancovMapped || shmctl(atoi(id), IPC_STAT, &ds) != 0 || ds.shm_segsz < 4 * sizeof(unsigned long long) + _FuzzSancovCount)
+        return;
+    unsigned long long* shm = (unsigned long long*)shmat(atoi(id), 0, 0);
+    if (shm == (void*)-1)
+        return;
+
+    unsigned char* counters = (unsigned char*)(shm + 4);
+    for (uint32_t i = 0; i < _FuzzSancovCount; i++)
+    {
+        unsigned sum = counters[i] + _FuzzSancov[i];
+        counters[i] = sum > 255 ? 255 : sum;
+    }
+    free(_FuzzSancov);
+    _FuzzSancov = counters;
+    _FuzzSancovMapped = 1;
+    shm[3] = _FuzzSancovCount;
+    shm[2] = 1;
+    shm[1] = 0;
+    shm[0] = _FuzzSancovCount;
+}
+
+/* Without the shared memory, the counters go to the coverage file. There are no lines to write an LCOV report of, so only in the binary format. */
+static void _FuzzSancovWrite(void)
+{
+    const char* path = getenv(COVERAGE_FILE_ENV);
+    const char* format = getenv(COVERAGE_FORMAT_ENV);
+    if (_FuzzSancovMapped || !path || !format || strcmp(format, COVERAGE_FORMAT_BINARY) != 0)
+        return;
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+        return;
+    unsigned long long header[5] = { COVERAGE_BINARY_MAGIC, _FuzzSancovCount, 0, 1, _FuzzSancovCount };
+    struct iovec parts[2] = { { header, sizeof(header) }, { _FuzzSancov, _FuzzSancovCount } };
+    if (writev(fd, parts, 2) < 0) {}
+    close(fd);
+}
+
+/* Runs after the module constructors numbered the guards. The fork server forks here, every child maps the shared memory and goes on into main. */
+__attribute__((constructor)) static void _FuzzSancovStart(void)
+{
+    atexit(_FuzzSancovWrite);
+
+    int msg = 0;
+    if (write(FORKSRV_FD + 1, &msg, 4) != 4)
+    {
+        _FuzzSancovMap();
+        return;
+    }
+
+    fflush(NULL);
+    while (1)
+    {
+        if (read(FORKSRV_FD, &msg, 4) != 4)
+            _exit(0);
+        int pid = fork();
+        if (pid < 0)
+            _exit(1);
+        if (pid == 0)
+        {
+            close(FORKSRV_FD);
+            close(FORKSRV_FD + 1);
+            _FuzzSancovMap();
+            return;
+        }
+        if (write(FORKSRV_FD + 1, &pid, 4) != 4)
+            _exit(1);
+        int status;
+        if (waitpid(pid, &status, 0) < 0)
+            _exit(1);
+        if (write(FORKSRV_FD + 1, &status, 4) != 4)
+            _exit(1);
+    }
+}
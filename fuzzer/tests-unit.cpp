@@ -4,6 +4,7 @@
 
 #include "fuzzer.h"
 #include <optional>
+#include <set>
 #include <string_view>
 
 TEST(InputGenerator, generateRandomAlphaNum) {
@@ -144,6 +145,296 @@ TEST_F(FuzzerSleep, execute_running_error) {
 	}
 }
 
+TEST_F(FuzzerSleep, execute_confirm_hang) {
+	fuzzer_blackbox::FileInput input("/bin/sleep", std::chrono::seconds(2), "0.5");
+	input.calibrateTimeout(std::chrono::milliseconds(100));
+	EXPECT_EQ(input.timeout, std::chrono::milliseconds(100));
+	EXPECT_EQ(input.fullTimeout, std::chrono::seconds(2));
+
+	// Slower than the calibrated timeout, but not a hang
+	auto res = fuzz->execute_with_timeout(input);
+	EXPECT_FALSE(res.timed_out);
+	EXPECT_EQ(res.return_code, 0);
+	EXPECT_EQ(fuzz->nb_suspected_hangs, 1);
+	EXPECT_EQ(fuzz->nb_hanged_runs, 0);
+	EXPECT_EQ(input.timeout, std::chrono::milliseconds(100));
+
+	res = fuzz->execute_with_timeout(input, false);
+	EXPECT_TRUE(res.timed_out);
+}
+
+TEST_F(FuzzerSleep, calibrate_timeout) {
+	// Not enough executions yet
+	EXPECT_EQ(fuzz->calibrateTimeout(), std::chrono::seconds(5));
+
+	for (int i = 0; i < 100; i++)
+		fuzz->statisticsExecution.addNumber(i < 99 ? 10 : 1000);
+
+	// 99th percentile is about 10 ms, times 5, rounded up by the histogram
+	auto timeout = fuzz->calibrateTimeout();
+	EXPECT_GE(timeout, std::chrono::milliseconds(50));
+	EXPECT_LE(timeout, std::chrono::milliseconds(60));
+
+	for (int i = 0; i < 10000; i++)
+		fuzz->statisticsExecution.addNumber(1);
+	EXPECT_EQ(fuzz->calibrateTimeout(), std::chrono::milliseconds(50)); // Floor
+}
+
+TEST(ForkServer, notInstrumented) {
+	fuzzer_blackbox::CinInput input("/bin/cat", std::chrono::seconds(1));
+	fuzzer_blackbox::ForkServerExecutor forkServer;
+
+	// Program runs, but never announces the fork server
+	EXPECT_FALSE(forkServer.start(input));
+}
+
+TEST(ForkServer, restart) {
+	// Fake server that takes longer to start than one execution may take, and dies before serving any input
+	{
+		std::ofstream script("/tmp/kocoumat-forkserver.sh");
+		script << "#!/bin/bash\nsleep 0.2\nprintf '\\000\\000\\000\\000' >&199\n";
+	}
+	std::filesystem::permissions("/tmp/kocoumat-forkserver.sh", std::filesystem::perms::owner_all);
+	fuzzer_blackbox::CinInput input("/tmp/kocoumat-forkserver.sh", std::chrono::seconds(2));
+	input.calibrateTimeout(std::chrono::milliseconds(50));
+	fuzzer_blackbox::ForkServerExecutor forkServer;
+
+	// Startup is not limited by the calibrated timeout
+	EXPECT_TRUE(forkServer.start(input));
+
+	// Restarts are limited instead of recursing forever
+	EXPECT_THROW(forkServer.run(input), std::runtime_error);
+}
+
+TEST(ForkServer, fallback) {
+	FuzzerSettings settings;
+	settings.forkServer = true;
+	fuzzer_blackbox fuzz("/bin/cat", "/tmp/kocoumat-fuzzer/", true, "stdin", std::chrono::seconds(60), 1, settings);
+
+	EXPECT_EQ(fuzz.executionInput->executor, nullptr);
+
+	fuzz.executionInput->setInput("test");
+	auto res = fuzz.execute_with_timeout(*fuzz.executionInput);
+	EXPECT_EQ(res.stdout_output, "test");
+	EXPECT_EQ(res.return_code, 0);
+}
+
+TEST(Workers, blackbox) {
+	FuzzerSettings settings;
+	settings.workers = 2;
+	settings.memoryInput = false;
+	fuzzer_blackbox fuzz("/bin/cat", "/tmp/kocoumat-fuzzer/", false, "/tmp/kocoumat-fuzzer-input", std::chrono::seconds(2), 1, settings);
+	fuzz.run();
+
+	// Both workers ran, each with its own input file, and none of the runs was mistaken for a hang
+	EXPECT_GT(fuzz.statisticsExecution.count(), 1);
+	EXPECT_EQ(fuzz.nb_hanged_runs, 0);
+	EXPECT_TRUE(std::filesystem::exists("/tmp/kocoumat-fuzzer-input"));
+	EXPECT_TRUE(std::filesystem::exists("/tmp/kocoumat-fuzzer-input.1"));
+}
+
+TEST(MemoryFileInput, rewrite) {
+	fuzzer_blackbox::MemoryFileInput input("/bin/cat", std::chrono::seconds(2), "kocoumat-fuzzer-input");
+	auto path = input.getArguments().at(0);
+	EXPECT_TRUE(path.starts_with("/proc/") || path.starts_with("/dev/shm/"));
+
+	// Shorter input must not keep the end of the longer one
+	for (std::string text : { "longer input", "short", "" })
+	{
+		input.setInput(text);
+		EXPECT_EQ(loadFile(path), text);
+
+		auto res = fuzzer_blackbox::SpawnExecutor(input).run(input);
+		EXPECT_EQ(res.stdout_output, text);
+		EXPECT_EQ(res.return_code, 0);
+	}
+}
+
+TEST(SpawnExecutor, run) {
+	fuzzer_blackbox::CinInput input("/bin/cat", std::chrono::seconds(2));
+	fuzzer_blackbox::SpawnExecutor executor(input);
+
+	// Pipes are reused, the output of one run must not leak into another
+	for (std::string text : { "first", "second", "" })
+	{
+		input.setInput(text);
+		auto res = executor.run(input);
+		EXPECT_EQ(res.stdout_output, text);
+		EXPECT_EQ(res.return_code, 0);
+		EXPECT_FALSE(res.timed_out);
+	}
+
+	fuzzer_blackbox::FileInput fail("/bin/false", std::chrono::seconds(2), "/tmp/kocoumat-fuzzer-input");
+	EXPECT_EQ(fuzzer_blackbox::SpawnExecutor(fail).run(fail).return_code, 1);
+}
+
+TEST(SpawnExecutor, timeout) {
+	// The shell starts a child of its own, which must be killed together with it
+	fuzzer_blackbox::FileInput input("/bin/sh", std::chrono::milliseconds(200), "/tmp/kocoumat-fuzzer-input");
+	input.setInput("sleep 10 & wait");
+	fuzzer_blackbox::SpawnExecutor executor(input);
+
+	auto start = std::chrono::steady_clock::now();
+	auto res = executor.run(input);
+	EXPECT_TRUE(res.timed_out);
+	EXPECT_EQ(res.return_code, -1);
+	EXPECT_LT(std::chrono::steady_clock::now() - start, std::chrono::seconds(2));
+}
+
+TEST(SpawnExecutor, memoryStdin) {
+	// Program that never reads its input, which is larger than a pipe buffer
+	fuzzer_blackbox::CinInput input("/bin/true", std::chrono::seconds(2));
+	std::string text(1 << 20, 'a');
+	input.setInput(text);
+	auto res = fuzzer_blackbox::SpawnExecutor(input, true).run(input);
+	EXPECT_FALSE(res.timed_out);
+	EXPECT_EQ(res.return_code, 0);
+
+	// Input is rewound for every run, a shorter input must not keep the end of the longer one
+	fuzzer_blackbox::CinInput cat("/bin/cat", std::chrono::seconds(2));
+	fuzzer_blackbox::SpawnExecutor executor(cat, true);
+	for (std::string text : { "longer input", "short", "" })
+	{
+		cat.setInput(text);
+		EXPECT_EQ(executor.run(cat).stdout_output, text);
+	}
+}
+
+TEST(ProcessEvents, largeOutput) {
+	// More than a pipe buffer in both directions, the input cannot be written before the output is read
+	std::string text(1 << 20, 'a');
+	fuzzer_blackbox::CinInput input("/bin/cat", std::chrono::seconds(5));
+	input.setInput(text);
+	fuzzer_blackbox::SpawnExecutor executor(input);
+
+	for (auto res : { fuzzer_blackbox::execute_in_new_process(input), executor.run(input) })
+	{
+		EXPECT_FALSE(res.timed_out);
+		EXPECT_EQ(res.return_code, 0);
+		EXPECT_EQ(res.stdout_output.size(), text.size());
+		EXPECT_LT(res.execution_time, std::chrono::seconds(2));
+	}
+}
+
+static int afterInputCalls = 0;
+static volatile int hangCounter = 0;
+
+static int testHarness(const uint8_t* data, size_t size)
+{
+	std::string_view input(reinterpret_cast<const char*>(data), size);
+	if (input == "segv")
+		raise(SIGSEGV);
+	else if (input == "abort")
+		abort();
+	else if (input == "hang")
+		while (true)
+			hangCounter = hangCounter + 1;
+	return 0;
+}
+
+static void countCalls()
+{
+	++afterInputCalls;
+}
+
+TEST(InProcess, run) {
+	fuzzer_blackbox::CinInput input("/bin/true", std::chrono::milliseconds(100));
+	fuzzer_blackbox::InProcessExecutor executor(testHarness, countCalls);
+	afterInputCalls = 0;
+
+	input.setInput("test");
+	auto res = executor.run(input);
+	EXPECT_EQ(res.return_code, 0);
+	EXPECT_FALSE(res.timed_out);
+
+	input.setInput("segv");
+	res = executor.run(input);
+	EXPECT_EQ(res.return_code, SIGSEGV);
+
+	input.setInput("abort");
+	res = executor.run(input);
+	EXPECT_EQ(res.return_code, SIGABRT);
+
+	input.setInput("hang");
+	res = executor.run(input);
+	EXPECT_TRUE(res.timed_out);
+
+	// Harness still works after all of that
+	input.setInput("test");
+	res = executor.run(input);
+	EXPECT_EQ(res.return_code, 0);
+	EXPECT_EQ(afterInputCalls, 5);
+}
+
+static uint8_t* harnessCoverage = nullptr;
+
+// Maps the segment named in the environment of the fuzzer, as _MapCoverage of an instrumented harness does
+static void mapHarnessCoverage()
+{
+	auto shm = static_cast<uint64_t*>(shmat(std::atoi(std::getenv("FUZZ_COVERAGE_SHM")), nullptr, 0));
+	ASSERT_NE(shm, (void*)-1);
+	shm[3] = 2;
+	shm[2] = 1;
+	shm[1] = 0;
+	shm[0] = 3;
+	harnessCoverage = reinterpret_cast<uint8_t*>(shm + 4);
+}
+
+// Two lines and a split comparison
+static int coveredHarness(const uint8_t* data, size_t size)
+{
+	harnessCoverage[0]++;
+	if (size > 0 && data[0] == 'a')
+		harnessCoverage[1]++;
+	if (size > 1 && data[1] == 'b')
+		harnessCoverage[2]++;
+	return 0;
+}
+
+TEST(InProcess, sharedCoverage) {
+	std::filesystem::create_directories("/tmp/fuzzer-inprocess/seeds");
+	std::filesystem::remove("/tmp/fuzzer-inprocess/coverage.lcov");
+	FuzzerSettings settings;
+	settings.testOneInput = coveredHarness;
+	settings.mapCoverage = mapHarnessCoverage;
+	fuzzer_greybox fuzz("/bin/true", "/tmp/fuzzer-inprocess/", false, "stdin", std::chrono::seconds(60), 1, fuzzer_greybox::POWER_SCHEDULE_T::boosted, "/tmp/fuzzer-inprocess/coverage.lcov", 50, 25, "/tmp/fuzzer-inprocess/seeds", settings);
+
+	auto input = fuzz.createExecutionInput(0);
+	fuzz.prepareWorker(*input, 0);
+	fuzz.startExecutor(*input, false);
+	ASSERT_NE(harnessCoverage, nullptr);
+
+	// Counters are read straight from the harness, no file is written per input
+	input->setInput("a");
+	fuzz.resetCoverage(0);
+	input->executor->run(*input);
+	auto coverage = fuzz.readCoverage(0);
+	ASSERT_TRUE(coverage);
+	EXPECT_EQ(coverage->first, 1.0);
+	EXPECT_FALSE(std::filesystem::exists("/tmp/fuzzer-inprocess/coverage.lcov"));
+	auto path = coverage->second;
+
+	// Split comparison tells the path apart, but is not a line of the coverage
+	input->setInput("ab");
+	fuzz.resetCoverage(0);
+	input->executor->run(*input);
+	coverage = fuzz.readCoverage(0);
+	ASSERT_TRUE(coverage);
+	EXPECT_EQ(coverage->first, 1.0);
+	EXPECT_NE(coverage->second, path);
+
+	input->setInput("b");
+	fuzz.resetCoverage(0);
+	input->executor->run(*input);
+	coverage = fuzz.readCoverage(0);
+	ASSERT_TRUE(coverage);
+	EXPECT_EQ(coverage->first, 0.5);
+
+	shmdt(harnessCoverage - 4 * sizeof(uint64_t));
+	harnessCoverage = nullptr;
+	unsetenv("FUZZ_COVERAGE_SHM");
+}
+
 TEST(Oracle, detectErrorNum) {
 	const int num = 42;
 	fuzzer_blackbox::ExecutionResult res{ num, "", "", false, std::chrono::milliseconds(1) };
@@ -345,7 +636,7 @@ TEST(Power, powerSimple) {
 	std::string input = "test";
 	fuzzer_greybox::powerSimple power;
 
-	fuzzer_greybox::coveragePath hash;
+	fuzzer_greybox::coveragePath hash = 0;
 	power.hashmap.emplace(hash, 1);
 
 	power.add(input, hash, 1, 1, 1);
@@ -375,7 +666,7 @@ TEST(Power, powerBoosted) {
 	std::string input = "test";
 	fuzzer_greybox::powerBoosted power;
 
-	fuzzer_greybox::coveragePath hash;
+	fuzzer_greybox::coveragePath hash = 0;
 	power.hashmap.emplace(hash, 1);
 
 	power.add(input, hash, 1, 1, 1);
@@ -452,6 +743,391 @@ TEST(Coverage, lcov) {
 	EXPECT_EQ(coverage, 6.0/7.0);
 }
 
+TEST(Coverage, lcovHits) {
+	std::string input = "TN:test\nSF:a.c\nDA:5,0\nDA:8,300\nLH:1\nLF:2\nend_of_record\nSF:b.c\nDA:1,3\nLH:1\nLF:1\nend_of_record\n";
+
+	EXPECT_EQ(fuzzer_greybox::lcovHits(input), (std::vector<uint64_t>{ 0, 300, 3 }));
+}
+
+TEST(Lcov, forEachLine) {
+	// Lines crossing the blocks of 64 bytes, \r\n and no newline at the end
+	std::string text;
+	std::vector<std::string> expected;
+	for (size_t i = 0; i < 50; i++)
+	{
+		expected.push_back(std::string(i % 13, 'a' + i % 26));
+		text += expected.back() + (i % 7 == 0 ? "\r\n" : "\n");
+	}
+	expected.push_back("last");
+	text += "last";
+
+	std::vector<std::string> lines;
+	forEachLine(text, [&](std::string_view line) { lines.emplace_back(line); });
+	EXPECT_EQ(lines, expected);
+}
+
+TEST(Lcov, externalReports) {
+	// gcov and llvm-cov write functions, branches and checksums too
+	LcovParser parser;
+	std::vector<uint64_t> hits;
+	parser.parse("TN:\nSF:/src/a.c\nFN:3,main\nFNDA:1,main\nDA:3,1\nDA:4,12345678901,Xy5j\nBRDA:4,0,0,-\nDA:9,0\nLF:3\nLH:2\nend_of_record\nSF:/src/b.c\nDA:2,4\nend_of_record\n", hits);
+	EXPECT_EQ(hits, (std::vector<uint64_t>{ 1, 12345678901, 0, 4 }));
+	EXPECT_EQ(parser.fileCount(), 2);
+
+	// Files in another order, a file missing and a line not seen before keep the slots
+	parser.parse("SF:/src/b.c\nDA:2,5\nDA:7,1\nend_of_record\nSF:/src/c.c\nDA:1,2\nend_of_record\n", hits);
+	EXPECT_EQ(hits, (std::vector<uint64_t>{ 0, 0, 0, 5, 1, 2 }));
+
+	parser.parse("SF:/src/a.c\nDA:9,3\nDA:3,2\nend_of_record\n", hits);
+	EXPECT_EQ(hits, (std::vector<uint64_t>{ 2, 0, 3, 0, 0, 0 }));
+	EXPECT_EQ(parser.size(), 6);
+}
+
+TEST(Lcov, repeatedLines) {
+	// Entries of the same line (inlined functions, split counters) keep their own slots
+	LcovParser parser;
+	std::vector<uint64_t> hits;
+	parser.parse("SF:a.c\nDA:3,1\nDA:5,2\nDA:3,4\nDA:3,8\nend_of_record\n", hits);
+	EXPECT_EQ(hits, (std::vector<uint64_t>{ 1, 2, 4, 8 }));
+
+	// Told apart by their order among the entries of the line, also in a report in another order
+	parser.parse("SF:a.c\nDA:3,1\nDA:3,4\nDA:5,2\nDA:3,8\nend_of_record\n", hits);
+	EXPECT_EQ(hits, (std::vector<uint64_t>{ 1, 2, 4, 8 }));
+	parser.parse("SF:a.c\nDA:3,1\nDA:3,4\nDA:3,8\nDA:3,16\nend_of_record\n", hits);
+	EXPECT_EQ(hits, (std::vector<uint64_t>{ 1, 0, 4, 8, 16 }));
+	EXPECT_EQ(parser.size(), 5);
+}
+
+TEST(Coverage, binary) {
+	std::vector<uint64_t> header{ fuzzer_greybox::COVERAGE_BINARY_MAGIC, 2, 3, sizeof(uint64_t), 1 }, counters{ 7, 0 };
+	std::string content(reinterpret_cast<const char*>(header.data()), header.size() * sizeof(uint64_t));
+	content.append(reinterpret_cast<const char*>(counters.data()), counters.size() * sizeof(uint64_t));
+	content += std::string("\x01\x00\x05", 3);
+
+	std::vector<uint64_t> read;
+	std::vector<uint8_t> edges;
+	size_t lines = 0;
+	ASSERT_TRUE(fuzzer_greybox::binaryCoverage(content, read, edges, lines));
+	EXPECT_EQ(read, counters);
+	EXPECT_EQ(edges, (std::vector<uint8_t>{ 1, 0, 5 }));
+	EXPECT_EQ(lines, 1); // The other counter is of a split comparison
+
+	// Truncated dump or LCOV
+	EXPECT_FALSE(fuzzer_greybox::binaryCoverage(content.substr(0, content.size() - 1), read, edges, lines));
+	EXPECT_FALSE(fuzzer_greybox::binaryCoverage("TN:test\nSF:a.c\nDA:5,0\nLH:0\nLF:1\nend_of_record\n", read, edges, lines));
+}
+
+TEST(HitBuckets, classify) {
+	EXPECT_EQ(hitBuckets::bucket(0), 0);
+	EXPECT_EQ(hitBuckets::bucket(3), 4);
+	EXPECT_EQ(hitBuckets::bucket(7), 8);
+	EXPECT_EQ(hitBuckets::bucket(8), 16);
+	EXPECT_EQ(hitBuckets::bucket(127), 64);
+	EXPECT_EQ(hitBuckets::bucket(1000), 128);
+
+	// Every value, at every position of a vector and in the tail after it
+	std::vector<uint8_t> counters(256 + 37), out(counters.size());
+	for (size_t i = 0; i < counters.size(); i++)
+		counters[i] = static_cast<uint8_t>(i * 7);
+	hitBuckets::classify(counters, out);
+	for (size_t i = 0; i < counters.size(); i++)
+		EXPECT_EQ(out[i], hitBuckets::bucket(counters[i])) << i;
+
+	std::vector<uint64_t> lines{ 0, 1, 5, 100000 };
+	std::vector<uint8_t> linesOut(lines.size());
+	hitBuckets::classify(std::span<const uint64_t>(lines), linesOut);
+	EXPECT_EQ(linesOut, (std::vector<uint8_t>{ 0, 1, 8, 128 }));
+}
+
+TEST(VirginMap, update) {
+	VirginMap virgin;
+	std::vector<uint8_t> classified(100);
+
+	EXPECT_EQ(virgin.update(classified), VirginMap::Novelty::none);
+
+	classified[40] = hitBuckets::bucket(1);
+	classified[99] = hitBuckets::bucket(1); // In the tail
+	EXPECT_EQ(virgin.update(classified), VirginMap::Novelty::counter);
+	EXPECT_EQ(virgin.update(classified), VirginMap::Novelty::none);
+
+	// Loop running more times
+	classified[40] = hitBuckets::bucket(5);
+	EXPECT_EQ(virgin.update(classified), VirginMap::Novelty::hitCount);
+	classified[40] = hitBuckets::bucket(6);
+	EXPECT_EQ(virgin.update(classified), VirginMap::Novelty::none);
+
+	classified[99] = 0;
+	classified[98] = hitBuckets::bucket(2);
+	EXPECT_EQ(virgin.update(classified), VirginMap::Novelty::counter);
+	EXPECT_EQ(virgin.countHit(), 3);
+}
+
+TEST(VirginMap, limit) {
+	VirginMap virgin;
+	virgin.limit = 2;
+	std::vector<uint8_t> classified(100);
+
+	classified[10] = hitBuckets::bucket(1);
+	classified[20] = hitBuckets::bucket(1);
+	EXPECT_EQ(virgin.update(classified), VirginMap::Novelty::counter);
+
+	// Map is full, a counter hit for the first time is not remembered
+	classified[30] = hitBuckets::bucket(1);
+	EXPECT_EQ(virgin.update(classified), VirginMap::Novelty::none);
+	EXPECT_EQ(virgin.countHit(), 2);
+
+	// Known ones still count their hits
+	classified[10] = hitBuckets::bucket(4);
+	EXPECT_EQ(virgin.update(classified), VirginMap::Novelty::hitCount);
+}
+
+TEST(Coverage, counters) {
+	std::vector<uint64_t> counters{ 0, 1, 1, 10, 1, 1, 1 };
+
+	auto coverage = fuzzer_greybox::coverage(std::span<const uint64_t>(counters));
+
+	EXPECT_EQ(coverage.first, 6.0 / 7.0);
+
+	// Same buckets are the same path, a new bucket is a new one
+	counters[3] = 12;
+	EXPECT_EQ(fuzzer_greybox::coverage(std::span<const uint64_t>(counters)).second, coverage.second);
+	counters[3] = 2;
+	EXPECT_NE(fuzzer_greybox::coverage(std::span<const uint64_t>(counters)).second, coverage.second);
+}
+
+TEST(Coverage, edges) {
+	std::vector<uint64_t> counters{ 1, 1, 0 };
+	std::vector<uint8_t> first(8), second(8);
+	first[1] = first[5] = 1;
+	second[1] = second[6] = 3;
+
+	// Same lines reached through different edges are different paths
+	auto a = fuzzer_greybox::coverage(counters, first);
+	auto b = fuzzer_greybox::coverage(counters, second);
+
+	EXPECT_EQ(a.first, 2.0 / 3.0);
+	EXPECT_EQ(a.first, b.first);
+	EXPECT_NE(a.second, b.second);
+}
+
+TEST(PathId, hash) {
+	std::vector<uint8_t> map(65536 + 5);
+	auto empty = pathId::hash(map);
+
+	// Every position counts, also in the tail and at the end of a vector
+	std::set<uint64_t> ids{ empty };
+	for (size_t i : { 0, 1, 31, 32, 4096, 65535, 65536, 65540 })
+	{
+		map[i] = 1;
+		EXPECT_TRUE(ids.insert(pathId::hash(map)).second) << i;
+		map[i] = 2;
+		EXPECT_TRUE(ids.insert(pathId::hash(map)).second) << i;
+		map[i] = 0;
+	}
+	EXPECT_EQ(pathId::hash(map), empty);
+
+	// Size is part of the path
+	EXPECT_NE(pathId::hash(std::span(map).first(100)), pathId::hash(std::span(map).first(101)));
+}
+
+TEST(Coverage, fillLcov) {
+	std::string input = "TN:test\n"
+		"SF:a.c\n"
+		"DA:5,0\n"
+		"DA:8,1\n"
+		"LH:1\n"
+		"LF:2\n"
+		"end_of_record\n"
+		"SF:b.c\n"
+		"DA:1,1\n"
+		"LH:1\n"
+		"LF:1\n"
+		"end_of_record\n";
+	std::vector<uint64_t> hits{ 3, 7, 0 };
+
+	auto lcov = fuzzer_greybox::fillLcov(input, hits);
+
+	EXPECT_EQ(lcov, "TN:test\nSF:a.c\nDA:5,3\nDA:8,7\nLH:2\nLF:2\nend_of_record\nSF:b.c\nDA:1,0\nLH:0\nLF:1\nend_of_record\n");
+}
+
+#ifndef _MSC_VER
+TEST(Coverage, sharedMemory) {
+	fuzzer_greybox::SharedCoverage shared(16);
+	EXPECT_EQ(shared.size(), 0);
+
+	// Map it the same way as the instrumented program does
+	auto program = static_cast<uint64_t*>(shmat(shared.id, nullptr, 0));
+	ASSERT_NE(program, (void*)-1);
+	program[2] = sizeof(uint64_t);
+	program[0] = 3;
+	program[3] = 3;
+	program[4] = 1;
+	program[6] = 5;
+
+	EXPECT_EQ(shared.size(), 3);
+	EXPECT_EQ(shared.lines(), 3);
+	EXPECT_TRUE(shared.edges().empty());
+	EXPECT_EQ(shared.withCounters([](auto counters) { return fuzzer_greybox::coveredRatio(counters); }), 2.0 / 3.0);
+
+	shared.accumulate();
+	shared.reset();
+	EXPECT_EQ(shared.size(), 3);
+	EXPECT_EQ(program[6], 0);
+
+	program[5] = 2;
+	shared.accumulate();
+	EXPECT_EQ(shared.totalHits, (std::vector<uint64_t>{ 1, 2, 5 }));
+
+	// Edge map follows the line counters
+	program[1] = fuzzer_greybox::SharedCoverage::EDGE_MAP_SIZE;
+	auto edges = reinterpret_cast<uint8_t*>(program + 7);
+	edges[7] = 1;
+	ASSERT_EQ(shared.edges().size(), fuzzer_greybox::SharedCoverage::EDGE_MAP_SIZE);
+	EXPECT_EQ(shared.edges()[7], 1);
+	shared.reset();
+	EXPECT_EQ(edges[7], 0);
+
+	shmdt(program);
+}
+
+TEST(Coverage, sharedMemoryBytes) {
+	fuzzer_greybox::SharedCoverage shared(16);
+	auto program = static_cast<uint64_t*>(shmat(shared.id, nullptr, 0));
+	ASSERT_NE(program, (void*)-1);
+
+	// Byte counters are packed, the edge map follows right after them
+	program[3] = 3;
+	program[2] = 1;
+	program[1] = fuzzer_greybox::SharedCoverage::EDGE_MAP_SIZE;
+	program[0] = 3;
+	auto lines = reinterpret_cast<uint8_t*>(program + 4);
+	lines[0] = 255;
+	lines[2] = 4;
+	lines[3] = 9;
+
+	EXPECT_EQ(shared.counterBytes(), 1);
+	EXPECT_EQ(shared.edges()[0], 9);
+	EXPECT_EQ(shared.withCounters([](auto counters) { return std::vector<uint64_t>(counters.begin(), counters.end()); }), (std::vector<uint64_t>{ 255, 0, 4 }));
+
+	shared.accumulate();
+	shared.accumulate();
+	EXPECT_EQ(shared.totalHits, (std::vector<uint64_t>{ 510, 0, 8 }));
+	shared.reset();
+	EXPECT_EQ(lines[0], 0);
+	EXPECT_EQ(lines[3], 0);
+
+	shmdt(program);
+}
+
+TEST(Coverage, sharedMemoryPrune) {
+	fuzzer_greybox::SharedCoverage shared(16), other(16);
+	auto program = static_cast<uint64_t*>(shmat(shared.id, nullptr, 0));
+	auto otherProgram = static_cast<uint64_t*>(shmat(other.id, nullptr, 0));
+	ASSERT_NE(program, (void*)-1);
+	ASSERT_NE(otherProgram, (void*)-1);
+	for (auto i : { program, otherProgram })
+	{
+		i[3] = 3;
+		i[2] = 1;
+		i[0] = 3;
+	}
+	auto lines = reinterpret_cast<uint8_t*>(program + 4);
+	auto otherLines = reinterpret_cast<uint8_t*>(otherProgram + 4);
+
+	std::vector<uint8_t> known;
+	lines[1] = 2;
+	shared.accumulate();
+	EXPECT_EQ(shared.learn(known), 1);
+
+	// Known counter starts at 255 in every worker and is not classified
+	shared.reset(known);
+	other.reset(known);
+	EXPECT_EQ(lines[0], 0);
+	EXPECT_EQ(lines[1], 255);
+	EXPECT_EQ(otherLines[0], 0);
+	EXPECT_EQ(otherLines[1], 255);
+	lines[2] = 1;
+	std::vector<uint8_t> classified(3);
+	shared.withCounters([&](auto counters) { hitBuckets::classify(counters, classified); });
+	EXPECT_TRUE(shared.forgetKnown(classified, known));
+	EXPECT_EQ(classified[0], 0);
+	EXPECT_EQ(classified[1], 0);
+	EXPECT_NE(classified[2], 0);
+
+	// What one worker learned is known to the others
+	EXPECT_EQ(shared.learn(known), 2);
+	otherLines[2] = 3;
+	std::fill(classified.begin(), classified.end(), 0);
+	other.withCounters([&](auto counters) { hitBuckets::classify(counters, classified); });
+	EXPECT_FALSE(other.forgetKnown(classified, known));
+
+	shmdt(otherProgram);
+	shmdt(program);
+}
+
+// Test that probes are not pruned when the coverage of the campaign is exported, it needs all their hits
+TEST(Coverage, pruneWithoutExport) {
+	FuzzerSettings settings;
+	settings.pruneProbes = true;
+	fuzzer_greybox exported("/bin/cat", "/tmp/fuzzer-prune/", false, "stdin", std::chrono::seconds(1), 1, fuzzer_greybox::POWER_SCHEDULE_T::boosted, "/tmp/fuzzer-prune/coverage.lcov", 0, 0, settings);
+	EXPECT_FALSE(exported.pruneProbes());
+
+	settings.lcovExport = false;
+	fuzzer_greybox pruned("/bin/cat", "/tmp/fuzzer-prune/", false, "stdin", std::chrono::seconds(1), 1, fuzzer_greybox::POWER_SCHEDULE_T::boosted, "/tmp/fuzzer-prune/coverage.lcov", 0, 0, settings);
+	EXPECT_TRUE(pruned.pruneProbes());
+}
+#endif
+
+TEST(CmpLog, notInstrumented) {
+	std::filesystem::create_directories("/tmp/fuzzer-cmplog/seeds");
+	std::ofstream("/tmp/fuzzer-cmplog/seeds/seed") << "seed";
+	FuzzerSettings settings;
+	fuzzer_greybox fuzz("/bin/cat", "/tmp/fuzzer-cmplog/", false, "stdin", std::chrono::seconds(3), 1, fuzzer_greybox::POWER_SCHEDULE_T::boosted, "/tmp/fuzzer-cmplog/coverage.lcov", 0, 0, "/tmp/fuzzer-cmplog/seeds", settings);
+	fuzz.run();
+
+	// Table was offered, but a program without --cmplog never maps it, so no execution is spent on logging
+	EXPECT_GT(fuzz.statisticsExecution.count(), 1);
+	EXPECT_FALSE(fuzz.hasCmpLog(0));
+	EXPECT_EQ(fuzz.cmpLogExecutions, 0);
+}
+
+TEST(CmpLog, inputToState) {
+	auto integer = [](uint64_t a, uint64_t b, uint8_t size) {
+		cmpLog::Entry entry{};
+		entry.kind = cmpLog::Kind::integer;
+		entry.sizeA = entry.sizeB = size;
+		std::memcpy(entry.a, &a, sizeof(a));
+		std::memcpy(entry.b, &b, sizeof(b));
+		return entry;
+	};
+
+	// A character compared as an int is replaced as one byte
+	cmpLog::InputToState character("xay", 16);
+	character.add(integer('a', 'z', 4));
+	EXPECT_EQ(character.mutants, (std::vector<std::string>{ "xzy" }));
+
+	// Decimal numbers are replaced whole, also by the neighbours of the other operand
+	cmpLog::InputToState decimal("n=123 1234\n", 16);
+	decimal.add(integer(123, 4567, 4));
+	EXPECT_EQ(decimal.mutants, (std::vector<std::string>{ "n=4567 1234\n", "n=4568 1234\n", "n=4566 1234\n" }));
+
+	cmpLog::Entry memory{};
+	memory.kind = cmpLog::Kind::memory;
+	memory.sizeA = 5;
+	memory.sizeB = 6;
+	std::memcpy(memory.a, "hello", 5);
+	std::memcpy(memory.b, "s3cret", 6);
+	cmpLog::InputToState string("say hello", 16);
+	string.add(memory);
+	string.add(memory);
+	EXPECT_EQ(string.mutants, (std::vector<std::string>{ "say s3cret" }));
+
+	// Mutants with characters that are not allowed are not made
+	cmpLog::InputToState filtered("say hello", 16, [](char c) { return c >= 'a' && c <= 'z'; });
+	filtered.add(memory);
+	EXPECT_EQ(filtered.size(), 0);
+}
+
 class Greybox : public ::testing::Test {
 protected:
 	std::optional<fuzzer_greybox> fuzz;
@@ -502,4 +1178,27 @@ TEST_F(Greybox, generateMySeeds) {
 		counter++;
 
 	EXPECT_EQ(counter, 1234);
-}
\ No newline at end of file
+}
+
+TEST(PowerSchedule, directed) {
+	using seed = fuzzer_greybox::seedDirected;
+
+	// Exploring, the distance does not matter
+	EXPECT_DOUBLE_EQ(seed::temperature(0, 100), 1);
+	EXPECT_DOUBLE_EQ(seed::directedPower(1, 0, 1), 1);
+	EXPECT_DOUBLE_EQ(seed::directedPower(1, 1, 1), 1);
+
+	// Exploiting, the closest seed gets 32 times the power and the farthest one 32 times less
+	EXPECT_DOUBLE_EQ(seed::temperature(100, 100), 0.05);
+	EXPECT_DOUBLE_EQ(seed::directedPower(1, 0, 0), 32);
+	EXPECT_DOUBLE_EQ(seed::directedPower(1, 1, 0), 1.0 / 32);
+	EXPECT_DOUBLE_EQ(seed::directedPower(2, 0.5, 0), 2);
+
+	fuzzer_greybox::powerDirected queue(std::chrono::seconds(1));
+	queue.add("a", 1, 0, 1, 1, 4);
+	queue.add("b", 2, 0, 1, 1, 2);
+	queue.add("c", 3, 0, 1, 1, -1);
+	EXPECT_DOUBLE_EQ(queue.normalized(2), 0);
+	EXPECT_DOUBLE_EQ(queue.normalized(3), 0.5);
+	EXPECT_DOUBLE_EQ(queue.normalized(-1), 1);
+}